@@ -4,6 +4,7 @@
 #include <mutex>
 #include <random>
 #include <thread>
+#include <vector>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
@@ -60,6 +61,7 @@ static inline uint64_t getus()
 
 static std::atomic<bool> shutdown;
 static std::atomic<uint64_t> op_count;
+static int batch_size;
 
 static std::mutex lock;
 static std::condition_variable cond;
@@ -69,6 +71,91 @@ static void sig_handler(int sig)
   shutdown = true;
 }
 
+static void append_entry(zlog::Log *log, const std::string& entry_data,
+    std::atomic<bool> *stop)
+{
+  if (batch_size > 1) {
+    const std::vector<std::string> batch(batch_size, entry_data);
+    while (!shutdown && !*stop) {
+      int ret = log->appendBatchAsync(batch,
+          [&](int ret, std::vector<uint64_t>& positions) {
+        if (ret && ret != -ESHUTDOWN) {
+          std::cerr << "appendBatchAsync cb failed: " << strerror(-ret) << std::endl;
+          assert(0);
+          return;
+        }
+        op_count += positions.size();
+      });
+      if (ret) {
+        std::cerr << "appendBatchAsync failed: " << strerror(-ret) << std::endl;
+        assert(0);
+        break;
+      }
+    }
+    return;
+  }
+
+  while (!shutdown && !*stop) {
+    int ret = log->appendAsync(entry_data, [&](int ret, uint64_t pos) {
+      if (ret && ret != -ESHUTDOWN) {
+        std::cerr << "appendAsync cb failed: " << strerror(-ret) << std::endl;
+        assert(0);
+        return;
+      }
+      op_count++;
+    });
+    if (ret) {
+      std::cerr << "appendAsync failed: " << strerror(-ret) << std::endl;
+      assert(0);
+      break;
+    }
+  }
+}
+
+// run the append workload with 1, 2, 4, ... up to max_threads submitting
+// threads, and report the average throughput at each step.
+static void scale_threads(zlog::Log *log, const std::string& entry_data,
+    int max_threads, int step_sec)
+{
+  std::vector<int> steps;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    steps.push_back(threads);
+  }
+  steps.push_back(max_threads);
+
+  for (auto threads : steps) {
+    if (shutdown) {
+      break;
+    }
+
+    std::atomic<bool> stop(false);
+    const auto start_ops_count = op_count.load();
+    const auto start_us = getus();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+      workers.emplace_back(append_entry, log, std::cref(entry_data), &stop);
+    }
+
+    {
+      std::unique_lock<std::mutex> lk(lock);
+      cond.wait_for(lk, std::chrono::seconds(step_sec),
+          [&] { return shutdown.load(); });
+    }
+
+    stop = true;
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    const auto elapsed_us = getus() - start_us;
+    const auto iops = (double)((op_count.load() - start_ops_count) *
+        1000000ULL) / (double)elapsed_us;
+
+    std::cout << "threads " << threads << " " << iops << std::endl;
+  }
+}
+
 static void stats_entry()
 {
   while (true) {
@@ -108,6 +195,8 @@ int main(int argc, char **argv)
   std::string pool;
   std::string db_path;
   bool blackhole;
+  int threads;
+  bool scale;
 
   po::options_description opts("Benchmark options");
   opts.add_options()
@@ -120,6 +209,9 @@ int main(int argc, char **argv)
     ("excl", po::bool_switch(&excl_open), "exclusive open")
     ("verify", po::bool_switch(&verify), "verify writes")
     ("runtime", po::value<int>(&runtime)->default_value(0), "runtime")
+    ("threads", po::value<int>(&threads)->default_value(1), "submitting threads")
+    ("scale", po::bool_switch(&scale), "sweep submitting threads (runtime per step)")
+    ("batch", po::value<int>(&batch_size)->default_value(1), "entries per append batch")
 
     ("backend", po::value<std::string>(&backend)->required(), "backend")
     ("pool", po::value<std::string>(&pool)->default_value("zlog"), "pool (ceph)")
@@ -138,6 +230,11 @@ int main(int argc, char **argv)
   po::notify(vm);
 
   runtime = std::max(runtime, 0);
+  threads = std::max(threads, 1);
+
+  if (scale && runtime == 0) {
+    runtime = 10;
+  }
 
   zlog::Options options;
   options.backend_name = backend;
@@ -173,8 +270,10 @@ int main(int argc, char **argv)
   }
 
   signal(SIGINT, sig_handler);
-  signal(SIGALRM, sig_handler);
-  alarm(runtime);
+  if (!scale) {
+    signal(SIGALRM, sig_handler);
+    alarm(runtime);
+  }
 
   rand_data_gen dgen(1ULL << 22, entry_size);
   dgen.generate();
@@ -184,28 +283,26 @@ int main(int argc, char **argv)
   // of and watch out for.
   const auto entry_data = std::string(dgen.sample(), entry_size);
 
-  std::thread stats_thread(stats_entry);
-
   op_count = 0;
-  while (!shutdown) {
-    int ret = log->appendAsync(entry_data, [&](int ret, uint64_t pos) {
-      if (ret && ret != -ESHUTDOWN) {
-        std::cerr << "appendAsync cb failed: " << strerror(-ret) << std::endl;
-        assert(0);
-        return;
-      }
-      op_count++;
-    });
-    if (ret) {
-      std::cerr << "appendAsync failed: " << strerror(-ret) << std::endl;
-      assert(0);
-      break;
+
+  if (scale) {
+    scale_threads(log, entry_data, threads, runtime);
+  } else {
+    std::thread stats_thread(stats_entry);
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+      workers.emplace_back(append_entry, log, std::cref(entry_data), &stop);
+    }
+    for (auto& worker : workers) {
+      worker.join();
     }
-  }
 
-  shutdown = true;
-  cond.notify_one();
-  stats_thread.join();
+    shutdown = true;
+    cond.notify_one();
+    stats_thread.join();
+  }
 
   if (verify) {
     uint64_t tail;
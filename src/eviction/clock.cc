@@ -0,0 +1,98 @@
+#include"zlog/eviction/clock.h"
+#include<cerrno>
+
+namespace zlog{
+
+CLOCK::~CLOCK(){}
+
+int CLOCK::cache_get_hit(uint64_t* pos){
+  uint32_t slot;
+  if(!index.find(*pos, &slot)){
+    return -1;
+  }
+  // avoid dirtying the cache line when the bit is already set
+  if(!referenced[slot].load(std::memory_order_relaxed)){
+    referenced[slot].store(1, std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+int CLOCK::cache_get_miss(uint64_t pos){
+  return 0;
+}
+
+int CLOCK::cache_put_miss(uint64_t pos){
+  if(free_slots.empty()){
+    grow();
+  }
+  const auto slot = free_slots.back();
+  free_slots.pop_back();
+
+  positions[slot] = pos;
+  referenced[slot].store(0, std::memory_order_relaxed);
+  index.insert(pos, slot);
+  return 0;
+}
+
+int CLOCK::cache_remove(uint64_t pos){
+  uint32_t slot;
+  if(!index.find(pos, &slot)){
+    return -1;
+  }
+  index.erase(pos);
+  positions[slot] = FlatIndex::kEmpty;
+  free_slots.push_back(slot);
+  return 0;
+}
+
+int CLOCK::get_evicted(uint64_t* pos){
+  if(index.size() == 0){
+    return -ENOENT;
+  }
+
+  // every referenced entry is cleared on the first pass, so a victim is
+  // found within two sweeps.
+  while(true){
+    const auto slot = hand;
+    hand = (hand + 1) % capacity;
+    if(positions[slot] == FlatIndex::kEmpty){
+      continue;
+    }
+    if(referenced[slot].load(std::memory_order_relaxed)){
+      referenced[slot].store(0, std::memory_order_relaxed);
+      continue;
+    }
+    *pos = positions[slot];
+    index.erase(*pos);
+    positions[slot] = FlatIndex::kEmpty;
+    free_slots.push_back(slot);
+    return 0;
+  }
+}
+
+void CLOCK::grow(){
+  const size_t new_capacity = capacity ? 2 * capacity : 64;
+
+  std::unique_ptr<uint64_t[]> new_positions(new uint64_t[new_capacity]);
+  std::unique_ptr<std::atomic<uint8_t>[]> new_referenced(
+      new std::atomic<uint8_t>[new_capacity]);
+
+  for(size_t i = 0; i < capacity; i++){
+    new_positions[i] = positions[i];
+    new_referenced[i].store(referenced[i].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+
+  free_slots.reserve(new_capacity);
+  for(size_t i = new_capacity; i > capacity; i--){
+    new_positions[i - 1] = FlatIndex::kEmpty;
+    new_referenced[i - 1].store(0, std::memory_order_relaxed);
+    free_slots.push_back(i - 1);
+  }
+
+  positions = std::move(new_positions);
+  referenced = std::move(new_referenced);
+  capacity = new_capacity;
+}
+
+}
@@ -0,0 +1,203 @@
+#include"zlog/eviction/s3fifo.h"
+#include<algorithm>
+#include<cerrno>
+
+namespace zlog{
+
+static const uint8_t kMaxFreq = 3;
+
+S3FIFO::~S3FIFO(){}
+
+int S3FIFO::cache_get_hit(uint64_t* pos){
+  uint32_t slot;
+  if(!index.find(*pos, &slot)){
+    return -1;
+  }
+  // racing hits may lose an increment, which is harmless for an estimate
+  const auto f = freq[slot].load(std::memory_order_relaxed);
+  if(f < kMaxFreq){
+    freq[slot].store(f + 1, std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+int S3FIFO::cache_get_miss(uint64_t pos){
+  return 0;
+}
+
+int S3FIFO::cache_put_miss(uint64_t pos){
+  if(free_slots.empty()){
+    // removed entries hold on to their slots until they leave the queues. if
+    // they make up half of the slots, reclaiming them is cheaper than growing
+    // and keeps the arrays bounded when entries are removed faster than they
+    // are evicted.
+    const auto queued = small_fifo.size() + main_fifo.size();
+    const auto removed = queued - (small_count + main_count);
+    if(2 * removed >= capacity && removed > 0){
+      reclaim(small_fifo);
+      reclaim(main_fifo);
+    }else{
+      grow();
+    }
+  }
+  const auto slot = free_slots.back();
+  free_slots.pop_back();
+
+  positions[slot] = pos;
+  freq[slot].store(0, std::memory_order_relaxed);
+  index.insert(pos, slot);
+
+  // a position that was evicted recently is part of the working set
+  if(ghost_index.erase(pos)){
+    in_main[slot] = true;
+    main_fifo.push_back(slot);
+    main_count++;
+  }else{
+    in_main[slot] = false;
+    small_fifo.push_back(slot);
+    small_count++;
+  }
+
+  return 0;
+}
+
+int S3FIFO::cache_remove(uint64_t pos){
+  uint32_t slot;
+  if(!index.find(pos, &slot)){
+    return -1;
+  }
+  index.erase(pos);
+
+  // the slot stays queued and is released when it reaches the front
+  positions[slot] = FlatIndex::kEmpty;
+  if(in_main[slot]){
+    main_count--;
+  }else{
+    small_count--;
+  }
+  return 0;
+}
+
+int S3FIFO::get_evicted(uint64_t* pos){
+  if(index.size() == 0){
+    return -ENOENT;
+  }
+
+  while(true){
+    const auto resident = small_count + main_count;
+    if(small_count > 0 && (10 * small_count >= resident || main_count == 0)){
+      const auto slot = small_fifo.pop_front();
+      if(positions[slot] == FlatIndex::kEmpty){
+        free_slot(slot);
+        continue;
+      }
+
+      small_count--;
+      if(freq[slot].load(std::memory_order_relaxed) > 0){
+        freq[slot].store(0, std::memory_order_relaxed);
+        in_main[slot] = true;
+        main_fifo.push_back(slot);
+        main_count++;
+        continue;
+      }
+
+      *pos = positions[slot];
+      index.erase(*pos);
+      free_slot(slot);
+      remember(*pos);
+      return 0;
+    }
+
+    const auto slot = main_fifo.pop_front();
+    if(positions[slot] == FlatIndex::kEmpty){
+      free_slot(slot);
+      continue;
+    }
+
+    const auto f = freq[slot].load(std::memory_order_relaxed);
+    if(f > 0){
+      freq[slot].store(f - 1, std::memory_order_relaxed);
+      main_fifo.push_back(slot);
+      continue;
+    }
+
+    main_count--;
+    *pos = positions[slot];
+    index.erase(*pos);
+    free_slot(slot);
+    return 0;
+  }
+}
+
+void S3FIFO::free_slot(uint32_t slot){
+  positions[slot] = FlatIndex::kEmpty;
+  free_slots.push_back(slot);
+}
+
+// release the slots of removed entries, keeping the order of the rest
+void S3FIFO::reclaim(Ring<uint32_t>& fifo){
+  for(auto n = fifo.size(); n > 0; n--){
+    const auto slot = fifo.pop_front();
+    if(positions[slot] == FlatIndex::kEmpty){
+      free_slot(slot);
+    }else{
+      fifo.push_back(slot);
+    }
+  }
+}
+
+// the ghost fifo tracks about as many positions as there are cached entries
+void S3FIFO::remember(uint64_t pos){
+  const auto limit = std::max(small_count + main_count, (size_t)1);
+  while(ghost_fifo.size() > 0 && ghost_fifo.size() >= limit){
+    const auto old_pos = ghost_fifo.pop_front();
+    const auto old_seq = ghost_seqs.pop_front();
+    uint32_t seq;
+    if(ghost_index.find(old_pos, &seq) && seq == old_seq){
+      ghost_index.erase(old_pos);
+    }
+  }
+
+  const auto seq = ghost_seq++;
+  ghost_fifo.push_back(pos);
+  ghost_seqs.push_back(seq);
+  ghost_index.insert(pos, seq);
+}
+
+void S3FIFO::grow(){
+  const size_t new_capacity = capacity ? 2 * capacity : 64;
+
+  std::unique_ptr<uint64_t[]> new_positions(new uint64_t[new_capacity]);
+  std::unique_ptr<std::atomic<uint8_t>[]> new_freq(
+      new std::atomic<uint8_t>[new_capacity]);
+  std::unique_ptr<bool[]> new_in_main(new bool[new_capacity]);
+
+  for(size_t i = 0; i < capacity; i++){
+    new_positions[i] = positions[i];
+    new_freq[i].store(freq[i].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    new_in_main[i] = in_main[i];
+  }
+
+  free_slots.reserve(new_capacity);
+  for(size_t i = new_capacity; i > capacity; i--){
+    new_positions[i - 1] = FlatIndex::kEmpty;
+    new_freq[i - 1].store(0, std::memory_order_relaxed);
+    new_in_main[i - 1] = false;
+    free_slots.push_back(i - 1);
+  }
+
+  positions = std::move(new_positions);
+  freq = std::move(new_freq);
+  in_main = std::move(new_in_main);
+  capacity = new_capacity;
+
+  // every slot is in at most one queue, and the ghost fifo is bounded by the
+  // number of cached entries.
+  small_fifo.reserve(new_capacity);
+  main_fifo.reserve(new_capacity);
+  ghost_fifo.reserve(new_capacity);
+  ghost_seqs.reserve(new_capacity);
+}
+
+}
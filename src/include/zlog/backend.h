@@ -1,9 +1,11 @@
 #pragma once
+#include <cerrno>
 #include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace zlog {
@@ -98,7 +100,9 @@ class Backend {
    *
    * Returns the sequence of views associated with the head object starting from
    * the given epoch (inclusive). The maximum number of views returned per call
-   * is controlled by the backend implementation.
+   * is controlled by the backend implementation. If views before the given
+   * epoch have been removed by TrimViews, the sequence starts at the oldest
+   * view that remains.
    *
    * The staring epoch should be > 0.
    *
@@ -115,6 +119,41 @@ class Backend {
       uint64_t epoch, uint32_t max_views,
       std::map<uint64_t, std::string> *views_out) = 0;
 
+  /**
+   * Read the newest view.
+   *
+   * This is equivalent to reading the view at the current epoch of the head
+   * object, but requires a single request regardless of how far behind the
+   * caller is. If no view has been proposed, the epoch is zero and the view is
+   * empty.
+   *
+   * @param hoid      name of the head object
+   * @param epoch_out epoch of the newest view
+   * @param view_out  the newest view
+   *
+   * @return 0 or non-zero
+   * -EINVAL invalid input
+   * -ENOENT hoid doesn't exist / needs initialized
+   */
+  virtual int ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+      std::string *view_out) = 0;
+
+  /**
+   * Remove the views before an epoch.
+   *
+   * This is used to discard history once a full view has been written at the
+   * given epoch. Trimming an epoch that has already been trimmed succeeds and
+   * has no effect.
+   *
+   * @param hoid  name of the head object
+   * @param epoch views with an epoch less than this are removed
+   *
+   * @return 0 or non-zero
+   * -EINVAL invalid input, or epoch is newer than the current epoch
+   * -ENOENT hoid doesn't exist / needs initialized
+   */
+  virtual int TrimViews(const std::string& hoid, uint64_t epoch) = 0;
+
   /**
    * Propose a new view.
    *
@@ -135,6 +174,50 @@ class Backend {
   virtual int ProposeView(const std::string& hoid,
       uint64_t epoch, const std::string& view) = 0;
 
+  /**
+   * Watch for new views.
+   *
+   * After a successful call @cb is invoked when a new view is proposed for the
+   * head object, until the watch is removed with UnwatchViews. The callback
+   * receives the epoch of the new view, or zero if the backend doesn't know
+   * the epoch (e.g. the watch was interrupted and views may have been missed).
+   * Notifications are hints: they may be coalesced or arrive late, and the
+   * views themselves should be read with ReadLatestView or ReadViews.
+   *
+   * The callback may be invoked from any thread, should not block, and must
+   * not call WatchViews or UnwatchViews. The default implementation doesn't
+   * support watches, in which case clients find new views by polling.
+   *
+   * @param hoid       name of the head object
+   * @param cb         callback invoked with the epoch of new views
+   * @param handle_out handle used to remove the watch
+   *
+   * @return 0 or non-zero
+   * -EINVAL invalid input
+   * -ENOENT hoid doesn't exist / needs initialized
+   * -EOPNOTSUPP watches are not supported
+   */
+  virtual int WatchViews(const std::string& hoid,
+      std::function<void(uint64_t epoch)> cb, uint64_t *handle_out) {
+    return -EOPNOTSUPP;
+  }
+
+  /**
+   * Remove a watch created by WatchViews.
+   *
+   * When this returns the watch callback is not running, and it will not be
+   * invoked again.
+   *
+   * @param handle handle returned by WatchViews
+   *
+   * @return 0 or non-zero
+   * -ENOENT no watch with this handle
+   * -EOPNOTSUPP watches are not supported
+   */
+  virtual int UnwatchViews(uint64_t handle) {
+    return -EOPNOTSUPP;
+  }
+
   /**
    * Generate a unique id.
    *
@@ -228,6 +311,21 @@ class Backend {
    */
   virtual int Seal(const std::string& oid, uint64_t epoch) = 0;
 
+  /**
+   * Initialize a log entries object if it doesn't exist.
+   *
+   * A missing object is created with the given epoch. Unlike Seal, an object
+   * that already exists is left unchanged, so initialization never raises an
+   * object's epoch or causes I/O tagged with the current epoch to fail.
+   *
+   * @oid
+   * @epoch
+   *
+   * @return 0 or non-zero
+   * -EINVAL invalid input params
+   */
+  virtual int InitObject(const std::string& oid, uint64_t epoch) = 0;
+
   /**
    * Return the maximum position (if any) written to an object.
    *
@@ -243,6 +341,189 @@ class Backend {
    */
   virtual int MaxPos(const std::string& oid, uint64_t epoch,
       uint64_t *pos_out, bool *empty_out) = 0;
+
+  /**
+   * Return the maximum position (if any) written to an object without checking
+   * or changing the object's epoch.
+   *
+   * Unlike MaxPos this doesn't require the object to be sealed, so it can be
+   * used by read-only clients without disturbing writers. The object may be
+   * written concurrently, so the result is only a lower bound.
+   *
+   * @param oid
+   * @param pos_out
+   * @param empty_out
+   *
+   * @return 0 or non-zero
+   * -EINVAL bad input params
+   * -ENOENT object doesn't exist / needs init
+   */
+  virtual int PeekMaxPos(const std::string& oid, uint64_t *pos_out,
+      bool *empty_out) = 0;
+
+  /**
+   * Write multiple log positions in the same object.
+   *
+   * When 0 is returned, @results holds one return code per entry, in the same
+   * order as @entries, using the return values of Write. Native
+   * implementations apply the batch atomically with respect to the object's
+   * epoch, so the per-entry results are only 0 or -EROFS. The default
+   * implementation writes the entries one at a time, and may report other
+   * Write errors for individual entries if the object changes during the call.
+   *
+   * A non-zero return value applies to the whole call, and no entries were
+   * written.
+   *
+   * @param oid
+   * @param epoch
+   * @param entries { position: data } pairs
+   * @param results per-entry return codes
+   *
+   * @return 0 or non-zero
+   * -EINVAL bad input params
+   * -ENOENT object doesn't exist / needs init
+   * -ESPIPE stale epoch
+   */
+  virtual int WriteMany(const std::string& oid, uint64_t epoch,
+      const std::vector<std::pair<uint64_t, std::string>>& entries,
+      std::vector<int> *results_out) {
+    if (oid.empty() || epoch == 0) {
+      return -EINVAL;
+    }
+
+    results_out->clear();
+    results_out->reserve(entries.size());
+    for (const auto& entry : entries) {
+      int ret = Write(oid, entry.second, epoch, entry.first);
+      if (results_out->empty() && ret && ret != -EROFS) {
+        return ret;
+      }
+      results_out->push_back(ret);
+    }
+
+    return 0;
+  }
+
+  /**
+   * Read multiple log positions in the same object.
+   *
+   * When 0 is returned, @results holds a { return code: data } pair per
+   * position, in the same order as @positions, using the return values of
+   * Read. A non-zero return value applies to the whole call. The default
+   * implementation reads the positions one at a time.
+   *
+   * @param oid
+   * @param epoch
+   * @param positions
+   * @param results per-position { return code: data } pairs
+   *
+   * @return 0 or non-zero
+   * -EINVAL bad input params
+   * -ENOENT object doesn't exist / needs init
+   * -ESPIPE stale epoch
+   */
+  virtual int ReadMany(const std::string& oid, uint64_t epoch,
+      const std::vector<uint64_t>& positions,
+      std::vector<std::pair<int, std::string>> *results_out) {
+    if (oid.empty() || epoch == 0) {
+      return -EINVAL;
+    }
+
+    results_out->clear();
+    results_out->reserve(positions.size());
+    for (const auto position : positions) {
+      std::string data;
+      int ret = Read(oid, epoch, position, &data);
+      if (results_out->empty() && ret && ret != -ERANGE && ret != -ENODATA) {
+        return ret;
+      }
+      results_out->emplace_back(ret, std::move(data));
+    }
+
+    return 0;
+  }
+
+ public:
+  /**
+   * Asynchronous log entry interfaces.
+   *
+   * Each method starts the corresponding synchronous operation and returns
+   * immediately. When 0 is returned the operation was submitted, and @cb will
+   * be invoked exactly once with the return value that the synchronous method
+   * would have produced. Any other return value means that the operation was
+   * not submitted and @cb will not be invoked.
+   *
+   * The callback may be invoked from any thread, including the calling thread
+   * before the method returns, and should not block. Output parameters must
+   * remain valid until the callback runs.
+   *
+   * The default implementations run the synchronous method and invoke the
+   * callback inline, which is appropriate for backends that have no native
+   * asynchronous interface.
+   */
+  virtual int ReadAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::string *data_out,
+      std::function<void(int)> cb) {
+    cb(Read(oid, epoch, position, data_out));
+    return 0;
+  }
+
+  virtual int WriteAsync(const std::string& oid, const std::string& data,
+      uint64_t epoch, uint64_t position, std::function<void(int)> cb) {
+    cb(Write(oid, data, epoch, position));
+    return 0;
+  }
+
+  virtual int FillAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::function<void(int)> cb) {
+    cb(Fill(oid, epoch, position));
+    return 0;
+  }
+
+  virtual int TrimAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::function<void(int)> cb) {
+    cb(Trim(oid, epoch, position));
+    return 0;
+  }
+
+  virtual int SealAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) {
+    cb(Seal(oid, epoch));
+    return 0;
+  }
+
+  virtual int InitObjectAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) {
+    cb(InitObject(oid, epoch));
+    return 0;
+  }
+
+  virtual int MaxPosAsync(const std::string& oid, uint64_t epoch,
+      uint64_t *pos_out, bool *empty_out, std::function<void(int)> cb) {
+    cb(MaxPos(oid, epoch, pos_out, empty_out));
+    return 0;
+  }
+
+  virtual int PeekMaxPosAsync(const std::string& oid, uint64_t *pos_out,
+      bool *empty_out, std::function<void(int)> cb) {
+    cb(PeekMaxPos(oid, pos_out, empty_out));
+    return 0;
+  }
+
+  virtual int WriteManyAsync(const std::string& oid, uint64_t epoch,
+      const std::vector<std::pair<uint64_t, std::string>>& entries,
+      std::vector<int> *results_out, std::function<void(int)> cb) {
+    cb(WriteMany(oid, epoch, entries, results_out));
+    return 0;
+  }
+
+  virtual int ReadManyAsync(const std::string& oid, uint64_t epoch,
+      const std::vector<uint64_t>& positions,
+      std::vector<std::pair<int, std::string>> *results_out,
+      std::function<void(int)> cb) {
+    cb(ReadMany(oid, epoch, positions, results_out));
+    return 0;
+  }
 };
 
 }
@@ -1,5 +1,8 @@
 #pragma once
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <rados/librados.hpp>
 #include "zlog/backend.h"
 
@@ -30,9 +33,19 @@ class CephBackend : public Backend {
       uint64_t epoch, uint32_t max_views,
       std::map<uint64_t, std::string> *views_out) override;
 
+  int ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+      std::string *view_out) override;
+
+  int TrimViews(const std::string& hoid, uint64_t epoch) override;
+
   int ProposeView(const std::string& hoid,
       uint64_t epoch, const std::string& view) override;
 
+  int WatchViews(const std::string& hoid,
+      std::function<void(uint64_t epoch)> cb, uint64_t *handle_out) override;
+
+  int UnwatchViews(uint64_t handle) override;
+
   int Read(const std::string& oid, uint64_t epoch,
       uint64_t position, std::string *data) override;
 
@@ -48,9 +61,41 @@ class CephBackend : public Backend {
   int Seal(const std::string& oid,
       uint64_t epoch) override;
 
+  int InitObject(const std::string& oid,
+      uint64_t epoch) override;
+
   int MaxPos(const std::string& oid, uint64_t epoch,
       uint64_t *pos, bool *empty) override;
 
+  int PeekMaxPos(const std::string& oid, uint64_t *pos,
+      bool *empty) override;
+
+  int ReadAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::string *data,
+      std::function<void(int)> cb) override;
+
+  int WriteAsync(const std::string& oid, const std::string& data,
+      uint64_t epoch, uint64_t position,
+      std::function<void(int)> cb) override;
+
+  int FillAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::function<void(int)> cb) override;
+
+  int TrimAsync(const std::string& oid, uint64_t epoch,
+      uint64_t position, std::function<void(int)> cb) override;
+
+  int SealAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) override;
+
+  int InitObjectAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) override;
+
+  int MaxPosAsync(const std::string& oid, uint64_t epoch, uint64_t *pos,
+      bool *empty, std::function<void(int)> cb) override;
+
+  int PeekMaxPosAsync(const std::string& oid, uint64_t *pos,
+      bool *empty, std::function<void(int)> cb) override;
+
  private:
   std::map<std::string, std::string> options;
 
@@ -63,6 +108,16 @@ class CephBackend : public Backend {
   int CreateLinkObject(const std::string& name,
       const std::string& hoid);
   int InitHeadObject(const std::string& hoid, const std::string& prefix);
+
+  struct AioContext;
+  static void aio_complete(librados::completion_t c, void *arg);
+  int aio_operate(const std::string& oid, librados::ObjectWriteOperation *op,
+      std::function<void(int)> cb);
+
+  // librados watches on head objects, keyed by watch cookie
+  struct ViewWatch;
+  std::mutex watch_lock_;
+  std::map<uint64_t, std::unique_ptr<ViewWatch>> watches_;
 };
 
 }
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <lmdb.h>
 #include "zlog/backend.h"
 
@@ -13,7 +14,9 @@ namespace lmdb {
 
 class LMDBBackend : public Backend {
  public:
-  LMDBBackend() {
+  LMDBBackend() :
+    next_watch_handle_(1)
+  {
     options["scheme"] = "lmdb";
   }
 
@@ -43,9 +46,19 @@ class LMDBBackend : public Backend {
       uint64_t epoch, uint32_t max_views,
       std::map<uint64_t, std::string> *views_out) override;
 
+  int ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+      std::string *view_out) override;
+
+  int TrimViews(const std::string& hoid, uint64_t epoch) override;
+
   int ProposeView(const std::string& hoid,
       uint64_t epoch, const std::string& view) override;
 
+  int WatchViews(const std::string& hoid,
+      std::function<void(uint64_t epoch)> cb, uint64_t *handle_out) override;
+
+  int UnwatchViews(uint64_t handle) override;
+
   int Read(const std::string& oid, uint64_t epoch,
       uint64_t position, std::string *data) override;
 
@@ -61,9 +74,23 @@ class LMDBBackend : public Backend {
   int Seal(const std::string& oid,
       uint64_t epoch) override;
 
+  int InitObject(const std::string& oid,
+      uint64_t epoch) override;
+
   int MaxPos(const std::string& oid, uint64_t epoch,
       uint64_t *pos, bool *empty) override;
 
+  int PeekMaxPos(const std::string& oid, uint64_t *pos,
+      bool *empty) override;
+
+  int WriteMany(const std::string& oid, uint64_t epoch,
+      const std::vector<std::pair<uint64_t, std::string>>& entries,
+      std::vector<int> *results) override;
+
+  int ReadMany(const std::string& oid, uint64_t epoch,
+      const std::vector<uint64_t>& positions,
+      std::vector<std::pair<int, std::string>> *results) override;
+
  private:
   std::map<std::string, std::string> options;
   MDB_env *env;
@@ -175,6 +202,17 @@ class LMDBBackend : public Backend {
       return Put(key, v, exclusive);
     }
 
+    int Del(const std::string& key) {
+      MDB_val k;
+      k.mv_size = key.size();
+      k.mv_data = (void*)key.data();
+      int ret = mdb_del(txn, be->db_obj, &k, nullptr);
+      assert(ret == 0 || ret == MDB_NOTFOUND);
+      if (ret == MDB_NOTFOUND)
+        return -ENOENT;
+      return 0;
+    }
+
   private:
     bool startsWith(const MDB_val &val, const std::string &prefix) {
       return val.mv_size >= prefix.size()
@@ -206,9 +244,34 @@ class LMDBBackend : public Backend {
     return ss.str();
   }
 
+  // oldest view that hasn't been trimmed. missing until views are trimmed.
+  std::string MinEpochKey(const std::string& oid)
+  {
+    std::stringstream ss;
+    ss << oid << ".min_epoch";
+    return ss.str();
+  }
+
+  int GetMinEpoch(Transaction& txn, const std::string& hoid,
+      uint64_t *epoch);
+
   int CheckEpoch(Transaction& txn, uint64_t epoch, const std::string& oid,
       bool eq = false);
 
+  void NotifyViewWatchers(const std::string& hoid, uint64_t epoch);
+
+  struct ViewWatch {
+    std::string hoid;
+    std::function<void(uint64_t)> cb;
+  };
+
+  // an environment can only be opened once per process, so this backend
+  // instance sees every view proposed from this process. views proposed by
+  // other processes are not seen.
+  std::mutex watch_lock_;
+  uint64_t next_watch_handle_;
+  std::map<uint64_t, ViewWatch> watches_;
+
  private:
   bool need_close = false;
 };
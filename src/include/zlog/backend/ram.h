@@ -16,7 +16,8 @@ class RAMBackend : public Backend {
  public:
   RAMBackend() :
     blackhole_(false),
-    options_{{"scheme", "ram"}}
+    options_{{"scheme", "ram"}},
+    next_watch_handle_(1)
   {}
 
   ~RAMBackend();
@@ -41,9 +42,19 @@ class RAMBackend : public Backend {
       uint64_t epoch, uint32_t max_views,
       std::map<uint64_t, std::string> *views_out) override;
 
+  int ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+      std::string *view_out) override;
+
+  int TrimViews(const std::string& hoid, uint64_t epoch) override;
+
   int ProposeView(const std::string& hoid,
       uint64_t epoch, const std::string& view) override;
 
+  int WatchViews(const std::string& hoid,
+      std::function<void(uint64_t epoch)> cb, uint64_t *handle_out) override;
+
+  int UnwatchViews(uint64_t handle) override;
+
   int Read(const std::string& oid, uint64_t epoch,
       uint64_t position, std::string *data) override;
 
@@ -59,9 +70,23 @@ class RAMBackend : public Backend {
   int Seal(const std::string& oid,
       uint64_t epoch) override;
 
+  int InitObject(const std::string& oid,
+      uint64_t epoch) override;
+
   int MaxPos(const std::string& oid, uint64_t epoch,
       uint64_t *pos, bool *empty) override;
 
+  int PeekMaxPos(const std::string& oid, uint64_t *pos,
+      bool *empty) override;
+
+  int WriteMany(const std::string& oid, uint64_t epoch,
+      const std::vector<std::pair<uint64_t, std::string>>& entries,
+      std::vector<int> *results) override;
+
+  int ReadMany(const std::string& oid, uint64_t epoch,
+      const std::vector<uint64_t>& positions,
+      std::vector<std::pair<int, std::string>> *results) override;
+
  private:
   struct LinkObject {
     std::string hoid;
@@ -92,6 +117,8 @@ class RAMBackend : public Backend {
   int CheckEpoch(uint64_t epoch, const std::string& oid,
       bool eq, LogObject*& lobj);
 
+  void NotifyViewWatchers(const std::string& hoid, uint64_t epoch);
+
   bool startsWith(std::string s, std::string prefix) {
     return s.size() >= prefix.size() && std::equal(prefix.cbegin(), prefix.cend(), s.cbegin());
   }
@@ -102,6 +129,16 @@ class RAMBackend : public Backend {
   std::map<std::string, std::string> options_;
   std::unordered_map<std::string,
     boost::variant<LinkObject, ProjectionObject, LogObject>> objects_;
+
+  struct ViewWatch {
+    std::string hoid;
+    std::function<void(uint64_t)> cb;
+  };
+
+  // watches are only seen by clients sharing this backend instance
+  std::mutex watch_lock_;
+  uint64_t next_watch_handle_;
+  std::map<uint64_t, ViewWatch> watches_;
 };
 
 }
@@ -1,48 +1,83 @@
 #pragma once
+#include<atomic>
 #include<string>
 #include<sstream>
 #include<iostream>
+#include<memory>
 #include<unordered_map>
 #include<mutex>
+#include<vector>
 #include"zlog/eviction/lru.h"
 #include"zlog/eviction/arc.h"
+#include"zlog/eviction/clock.h"
+#include"zlog/eviction/s3fifo.h"
 #include"zlog/options.h"
 #include"zlog/mempool/mempool.h"
 #include"../../monitoring/statistics.h"
+#include"../../port/port_posix.h"
 
 namespace zlog{
+// Log entry cache.
+//
+// The cache is split into a power-of-two number of shards selected by a hash
+// of the position. Each shard has its own lock, eviction policy instance, and
+// byte budget (an equal share of Options::cache_size), so concurrent readers
+// only contend when they hit the same shard. The number of shards is reduced
+// for small caches so that every shard has at least kMinShardCapacity bytes. When the eviction policy can
+// record hits concurrently (CLOCK, S3-FIFO) lookups only share lock the shard.
 class Cache{
   public:
-    Cache(const zlog::Options& ops) : options(ops){
-      current_cache_use = 0;
-
-      switch(options.eviction){
-        case zlog::Eviction::Eviction_Policy::LRU:
-          eviction = new LRU(options.cache_size, this);
-        break;
-        case zlog::Eviction::Eviction_Policy::ARC:
-          eviction = new ARC(options.cache_size, this);
-        break;
-        default:
-          eviction = new LRU(options.cache_size, this);
-          std::cout << "Eviction policy not implemented. Using default: LRU" << std::endl;   
-        break;
-      }
-    }
+    struct ShardStats{
+      size_t entries;
+      size_t bytes;
+      size_t capacity;
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t inserts;
+      uint64_t evictions;
+    };
+
+    explicit Cache(const zlog::Options& ops);
     ~Cache();
 
     int put(uint64_t pos, const std::string& data);
     int get(uint64_t* pos, std::string* data);
     int remove(uint64_t* pos);
 
-    std::unordered_map<uint64_t, zlog_mempool::cache::string> cache_map; //FIX
+    std::vector<ShardStats> shard_stats();
 
+    // smallest byte budget a shard is given when the cache is split
+    static constexpr size_t kMinShardCapacity = 16 * 1024;
+
+    // bytes charged against the capacity for an entry, which includes an
+    // estimate of the per-entry index and policy overhead.
+    static size_t charge(size_t size){
+      return size + sizeof(uint64_t) + sizeof(zlog_mempool::cache::string) +
+        4 * sizeof(void*);
+    }
 
   private:
-    zlog::Eviction* eviction;
-    const zlog::Options& options;
-    int64_t current_cache_use;
-    std::mutex mut;
+    struct Shard{
+      port::RWMutex mut;
+      std::unordered_map<uint64_t, zlog_mempool::cache::string> cache_map;
+      std::unique_ptr<zlog::Eviction> eviction;
+      size_t bytes = 0;
+      size_t capacity = 0;
+      std::atomic<uint64_t> hits{0};
+      std::atomic<uint64_t> misses{0};
+      std::atomic<uint64_t> inserts{0};
+      std::atomic<uint64_t> evictions{0};
+    };
+
+    Shard& shard(uint64_t pos){
+      // fibonacci hashing spreads consecutive positions across shards
+      return *shards[((pos * 0x9E3779B97F4A7C15ULL) >> 32) & shard_mask];
+    }
+
+    static zlog::Eviction* new_eviction(zlog::Eviction::Eviction_Policy policy);
 
+    std::vector<std::unique_ptr<Shard>> shards;
+    uint64_t shard_mask;
+    Statistics* statistics;
 };
 }
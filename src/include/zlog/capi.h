@@ -23,6 +23,12 @@ int zlog_destroy(zlog_log_t log);
  */
 int zlog_checktail(zlog_log_t log, uint64_t *pposition);
 
+/*
+ *
+ */
+int zlog_peektail(zlog_log_t log, uint64_t max_staleness_us,
+    uint64_t *pposition);
+
 /*
  *
  */
@@ -3,20 +3,41 @@
 
 namespace zlog{
 
+// Eviction policies track the positions held by a cache shard and select
+// victims when the shard is over capacity. Policies never touch the cached
+// data, and are always called with the owning shard locked.
 class Eviction{
 
   public:
 
     enum Eviction_Policy{
       LRU,
-      ARC
+      ARC,
+      CLOCK,
+      S3FIFO
     };
 
     virtual ~Eviction(){};
 
+    // a cached position was read
     virtual int cache_get_hit(uint64_t* pos) = 0;
     virtual int cache_get_miss(uint64_t pos) = 0;
+
+    // a position was added to the cache
     virtual int cache_put_miss(uint64_t pos) = 0;
-    virtual uint64_t get_evicted() = 0;
+
+    // a position was removed from the cache by invalidation
+    virtual int cache_remove(uint64_t pos) = 0;
+
+    // select the next position to evict and stop tracking it. returns -ENOENT
+    // when no positions are tracked.
+    virtual int get_evicted(uint64_t* pos) = 0;
+
+    // true if cache_get_hit and cache_get_miss may be called concurrently with
+    // each other while the shard is only share locked, so both must be thread
+    // safe. they still never run concurrently with the other methods.
+    virtual bool concurrent_hits() const{
+      return false;
+    }
   };
-}
\ No newline at end of file
+}
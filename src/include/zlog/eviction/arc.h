@@ -5,25 +5,29 @@
 #include"zlog/eviction.h"
 
 namespace zlog{
-class Cache;
+// Adaptive Replacement Cache. Shards are bounded by bytes rather than entries,
+// so the target size `c` used to bound the ghost lists and the adaptation
+// parameter is the number of resident entries at the time of eviction.
 class ARC: public Eviction{
 
   public:
-    ARC(int64_t cache_size, Cache* c_ref){
-      cache_ref = c_ref;
-      arc_c = cache_size;
+    ARC(){
+      arc_p = 0;
+      last_put_b2 = false;
     }
     ~ARC();
     
     int cache_get_hit(uint64_t* pos) override;
     int cache_get_miss(uint64_t pos) override;
     int cache_put_miss(uint64_t pos) override;
-    uint64_t get_evicted() override;
+    int cache_remove(uint64_t pos) override;
+    int get_evicted(uint64_t* pos) override;
 
   private:
     double get_delta_1();
     double get_delta_2();
-    int replace(uint64_t pos);
+    size_t arc_c();
+    void trim_ghosts();
     std::unordered_map<uint64_t, std::list<uint64_t>::iterator> t1_hash_map;
     std::unordered_map<uint64_t, std::list<uint64_t>::iterator> b1_hash_map;
     std::unordered_map<uint64_t, std::list<uint64_t>::iterator> t2_hash_map;
@@ -32,8 +36,7 @@ class ARC: public Eviction{
     std::list<uint64_t> b1_eviction_list;
     std::list<uint64_t> t2_eviction_list;
     std::list<uint64_t> b2_eviction_list;
-    size_t arc_c;
     double arc_p;
-    Cache* cache_ref;
+    bool last_put_b2;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include<atomic>
+#include<memory>
+#include<vector>
+#include"zlog/eviction.h"
+#include"zlog/eviction/flat_index.h"
+
+namespace zlog{
+// CLOCK (second chance) over flat arrays. A hit only sets the entry's
+// reference bit, so hits are recorded under a shared lock without touching
+// any other state. Storage grows geometrically as entries are added, and
+// freed slots are reused, so steady state operation doesn't allocate.
+class CLOCK: public Eviction{
+
+  public:
+    CLOCK() : capacity(0), hand(0){}
+    ~CLOCK();
+
+    int cache_get_hit(uint64_t* pos) override;
+    int cache_get_miss(uint64_t pos) override;
+    int cache_put_miss(uint64_t pos) override;
+    int cache_remove(uint64_t pos) override;
+    int get_evicted(uint64_t* pos) override;
+
+    bool concurrent_hits() const override{
+      return true;
+    }
+
+  private:
+    void grow();
+
+    FlatIndex index;
+    std::unique_ptr<uint64_t[]> positions;
+    std::unique_ptr<std::atomic<uint8_t>[]> referenced;
+    std::vector<uint32_t> free_slots;
+    size_t capacity;
+    size_t hand;
+};
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include<cassert>
+#include<cstdint>
+#include<memory>
+
+namespace zlog{
+// Open addressing map from log position to a 32-bit slot number, used by the
+// array based eviction policies. Lookups never write to the table, so they can
+// run concurrently with each other while the owner holds a shared lock.
+// Deletion uses backward shifting, so there are no tombstones and probe
+// sequences stay short without periodic rehashing.
+class FlatIndex{
+  public:
+    static const uint64_t kEmpty = ~0ULL;
+
+    FlatIndex(){
+      resize(16);
+    }
+
+    size_t size() const{
+      return count;
+    }
+
+    bool find(uint64_t key, uint32_t* value) const{
+      assert(key != kEmpty);
+      for(size_t i = home(key); ; i = (i + 1) & mask){
+        if(keys[i] == key){
+          *value = values[i];
+          return true;
+        }
+        if(keys[i] == kEmpty){
+          return false;
+        }
+      }
+    }
+
+    void insert(uint64_t key, uint32_t value){
+      assert(key != kEmpty);
+      if(2 * (count + 1) > mask + 1){
+        resize(2 * (mask + 1));
+      }
+      size_t i = home(key);
+      while(keys[i] != kEmpty && keys[i] != key){
+        i = (i + 1) & mask;
+      }
+      if(keys[i] == kEmpty){
+        count++;
+      }
+      keys[i] = key;
+      values[i] = value;
+    }
+
+    bool erase(uint64_t key){
+      size_t i = home(key);
+      while(keys[i] != key){
+        if(keys[i] == kEmpty){
+          return false;
+        }
+        i = (i + 1) & mask;
+      }
+
+      // shift back later entries in the cluster that may move into the hole
+      size_t hole = i;
+      for(size_t j = (i + 1) & mask; keys[j] != kEmpty; j = (j + 1) & mask){
+        const size_t h = home(keys[j]);
+        // entry at j can fill the hole if its home is not in (hole, j]
+        const bool movable = hole <= j ?
+          (h <= hole || h > j) : (h <= hole && h > j);
+        if(movable){
+          keys[hole] = keys[j];
+          values[hole] = values[j];
+          hole = j;
+        }
+      }
+      keys[hole] = kEmpty;
+      count--;
+      return true;
+    }
+
+  private:
+    size_t home(uint64_t key) const{
+      return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    }
+
+    void resize(size_t capacity){
+      std::unique_ptr<uint64_t[]> old_keys(std::move(keys));
+      std::unique_ptr<uint32_t[]> old_values(std::move(values));
+      const size_t old_capacity = old_keys ? mask + 1 : 0;
+
+      keys.reset(new uint64_t[capacity]);
+      values.reset(new uint32_t[capacity]);
+      mask = capacity - 1;
+      count = 0;
+      for(size_t i = 0; i < capacity; i++){
+        keys[i] = kEmpty;
+      }
+
+      for(size_t i = 0; i < old_capacity; i++){
+        if(old_keys[i] != kEmpty){
+          insert(old_keys[i], old_values[i]);
+        }
+      }
+    }
+
+    std::unique_ptr<uint64_t[]> keys;
+    std::unique_ptr<uint32_t[]> values;
+    size_t mask = 0;
+    size_t count = 0;
+};
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include<atomic>
+#include<cassert>
+#include<memory>
+#include<vector>
+#include"zlog/eviction.h"
+#include"zlog/eviction/flat_index.h"
+
+namespace zlog{
+// S3-FIFO (Yang et al., SOSP '23). New entries go through a small FIFO that
+// holds roughly 10% of the entries. Entries that are hit while in the small
+// FIFO are promoted to the main FIFO, and the rest are evicted quickly and
+// remembered in a ghost FIFO, so that one-time accesses such as scans don't
+// displace the working set. The main FIFO is managed like CLOCK with a two
+// bit access counter.
+//
+// All queues are ring buffers of slot numbers over flat arrays, and a hit only
+// bumps the entry's counter, so hits are recorded under a shared lock.
+class S3FIFO: public Eviction{
+
+  public:
+    S3FIFO() : capacity(0), small_count(0), main_count(0){}
+    ~S3FIFO();
+
+    int cache_get_hit(uint64_t* pos) override;
+    int cache_get_miss(uint64_t pos) override;
+    int cache_put_miss(uint64_t pos) override;
+    int cache_remove(uint64_t pos) override;
+    int get_evicted(uint64_t* pos) override;
+
+    bool concurrent_hits() const override{
+      return true;
+    }
+
+    // number of allocated entry slots
+    size_t num_slots() const{
+      return capacity;
+    }
+
+  private:
+    template<typename T>
+    class Ring{
+      public:
+        Ring() : head(0), count(0), cap(0){}
+
+        size_t size() const{
+          return count;
+        }
+
+        void push_back(T value){
+          assert(count < cap);
+          items[(head + count) % cap] = value;
+          count++;
+        }
+
+        T pop_front(){
+          assert(count > 0);
+          T value = items[head];
+          head = (head + 1) % cap;
+          count--;
+          return value;
+        }
+
+        void reserve(size_t new_cap){
+          std::unique_ptr<T[]> new_items(new T[new_cap]);
+          for(size_t i = 0; i < count; i++){
+            new_items[i] = items[(head + i) % cap];
+          }
+          items = std::move(new_items);
+          head = 0;
+          cap = new_cap;
+        }
+
+      private:
+        std::unique_ptr<T[]> items;
+        size_t head;
+        size_t count;
+        size_t cap;
+    };
+
+    void grow();
+    void reclaim(Ring<uint32_t>& fifo);
+    void free_slot(uint32_t slot);
+    void remember(uint64_t pos);
+
+    FlatIndex index;
+    std::unique_ptr<uint64_t[]> positions;
+    std::unique_ptr<std::atomic<uint8_t>[]> freq;
+    std::unique_ptr<bool[]> in_main;
+    std::vector<uint32_t> free_slots;
+    size_t capacity;
+
+    Ring<uint32_t> small_fifo;
+    Ring<uint32_t> main_fifo;
+    size_t small_count;
+    size_t main_count;
+
+    // recently evicted positions. ghost_index maps a position to its ring
+    // sequence number, so that stale entries can be told apart when the ring
+    // wraps around.
+    Ring<uint64_t> ghost_fifo;
+    FlatIndex ghost_index;
+    uint32_t ghost_seq = 0;
+    Ring<uint32_t> ghost_seqs;
+};
+}
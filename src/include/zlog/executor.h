@@ -0,0 +1,36 @@
+#pragma once
+#include <memory>
+
+namespace zlog {
+
+class ExecutorImpl;
+
+// A pool of threads that runs the operations and background work of logs. An
+// executor can be shared by many logs through Options::executor, rather than
+// each log starting its own threads.
+//
+// Logs with queued work take turns: a thread picks the log at the front of the
+// line, runs at most Options::executor_quantum of its tasks, and the log goes
+// to the back of the line if it still has work. A busy log can use every
+// thread of an otherwise idle executor, but can't starve the other logs.
+//
+// The executor must outlive the logs that use it, which is the case when it is
+// only referenced through their options.
+class Executor {
+ public:
+  explicit Executor(int threads);
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  // for use by the logs that run on this executor
+  ExecutorImpl *impl() const {
+    return impl_.get();
+  }
+
+ private:
+  std::unique_ptr<ExecutorImpl> impl_;
+};
+
+}
@@ -4,6 +4,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 #include "options.h"
 
 namespace zlog {
@@ -21,6 +22,20 @@ class Log {
   virtual int CheckTail(uint64_t *pposition) = 0;
   virtual int tailAsync(std::function<void(int, uint64_t)> cb) = 0;
 
+  /**
+   * Return the position following the maximum position written.
+   *
+   * Unlike CheckTail this never seals the log or installs a sequencer, so it is
+   * suitable for read-only clients that poll the tail. The result is a lower
+   * bound on the tail: positions that have been reserved by a writer but not
+   * yet written aren't reflected. A result computed at most @max_staleness_us
+   * microseconds ago may be returned without contacting storage. When
+   * @max_staleness_us is 0 storage is always queried.
+   */
+  virtual int PeekTail(uint64_t max_staleness_us, uint64_t *pposition) = 0;
+  virtual int peekTailAsync(uint64_t max_staleness_us,
+      std::function<void(int, uint64_t)> cb) = 0;
+
   /**
    *
    */
@@ -28,6 +43,20 @@ class Log {
   virtual int appendAsync(const std::string& data,
       std::function<void(int, uint64_t)> cb) = 0;
 
+  /**
+   * Append a batch of entries.
+   *
+   * A contiguous range of positions is reserved for the batch, and the
+   * position of each entry is returned in @positions, in the same order as
+   * @data. Positions are contiguous in the common case, but an entry whose
+   * reserved position was concurrently filled is appended at a new position.
+   * On error, some of the entries may have been appended.
+   */
+  virtual int AppendBatch(const std::vector<std::string>& data,
+      std::vector<uint64_t> *positions) = 0;
+  virtual int appendBatchAsync(const std::vector<std::string>& data,
+      std::function<void(int, std::vector<uint64_t>&)> cb) = 0;
+
   /**
    *
    */
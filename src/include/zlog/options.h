@@ -11,6 +11,7 @@ namespace zlog {
 
 class Statistics;
 class Backend;
+class Executor;
 
 struct Options {
   // The storage backend. When set, this option will take priority over other
@@ -35,23 +36,80 @@ struct Options {
   uint32_t stripe_width = 10;
   uint32_t stripe_slots = 5;
 
+  // number of stripes that are kept mapped and initialized ahead of the
+  // positions being accessed. the view is expanded in the background once
+  // fewer than this many stripes follow an accessed position.
+  uint32_t stripe_lookahead = 1;
+
   uint32_t max_inflight_ops = 1024;
 
+  // maximum number of concurrent backend requests issued while sealing stripes
+  // during a sequencer takeover, or initializing new stripes.
+  uint32_t max_inflight_seals = 64;
+
+  // when taking over as the sequencer, record in the view a limit on the
+  // positions that may be written, this many stripes past the tail. the limit
+  // is raised by the same amount as writes reach it. a new sequencer then only
+  // looks for the tail below the limit, rather than in every stripe that has
+  // been mapped ahead of the tail. each raise proposes a new view. zero
+  // disables the limit.
+  uint32_t seq_limit_stripes = 0;
+
   ///////////////////////////////////////////////////////////////////
 
-  // number of I/O threads
+  // runs the log's operations and background work. logs that share an
+  // executor share its threads. when not set, the log creates its own
+  // executor with finisher_threads threads.
+  std::shared_ptr<Executor> executor = nullptr;
+
+  // number of I/O threads, when the log creates its own executor
   int finisher_threads = 10;
 
+  // number of tasks of this log that an executor thread runs before moving on
+  // to the next log with queued work. a log with a larger quantum gets a
+  // larger share of a busy shared executor.
+  uint32_t executor_quantum = 16;
+
   // maximum views to read at once when updating current view
   // advanced
   int max_refresh_views_read = 20;
 
+  // a full view is written every view_checkpoint_interval epochs, and the
+  // views in between only record their changes. catching up to the newest
+  // view reads at most this many views.
+  uint32_t view_checkpoint_interval = 32;
+
+  // remove the views before a full view once it has been written
+  bool trim_views = true;
+
   Statistics* statistics = nullptr;
   std::vector<std::string> http;
+
+  // address (host:port) of the sequencer service run by this instance. when
+  // set, the views that make this instance the sequencer name the address,
+  // and other clients request positions from the service instead of taking
+  // over as the sequencer. this is set by zlog-seqr.
+  std::string seqr_address;
+
+  // a client that can't reach the sequencer service named by the view, or
+  // that waits longer than this for a reply, takes over as the sequencer.
+  uint32_t seqr_timeout_ms = 5000;
+
+  // when taking over as the sequencer, keep the sequencer's counter in a
+  // shared memory segment. other processes on the same host that use the log
+  // then share the sequencer instead of taking over in turn, whether or not
+  // they set this option. processes on other hosts take over as usual.
+  bool shm_sequencer = false;
   
   //cache options
   zlog::Eviction::Eviction_Policy eviction = zlog::Eviction::Eviction_Policy::LRU;
+
+  // cache capacity in bytes, split evenly across the shards
   size_t cache_size = 1024 * 1024 * 1;
+
+  // number of cache shards (rounded up to a power of two). small caches use
+  // fewer shards so that each shard has a useful share of cache_size.
+  uint32_t cache_num_shards = 16;
 };
 
 }
@@ -12,13 +12,30 @@ enum Tickers : uint32_t {
   CACHE_REQS,
   CACHE_MISSES,
 
+  // a position wasn't mapped by the current view, and the view was expanded
+  // in the I/O path
+  STRIPER_SYNC_EXPAND,
+  // an object wasn't initialized, and was initialized in the I/O path
+  STRIPER_SYNC_INIT,
+
+  // views proposed to expand the object map, requests that waited for a
+  // proposal already in flight, and proposals that lost to a newer view
+  STRIPER_EXPAND_PROPOSED,
+  STRIPER_EXPAND_JOINED,
+  STRIPER_EXPAND_LOST,
+
   TICKER_ENUM_MAX
 };
 
 const std::vector<std::pair<Tickers, std::string>> TickersNameMap = {
 
   {CACHE_REQS, "zlog_cache_reqs"},
-  {CACHE_MISSES, "zlog_cache_misses"}
+  {CACHE_MISSES, "zlog_cache_misses"},
+  {STRIPER_SYNC_EXPAND, "zlog_striper_sync_expand"},
+  {STRIPER_SYNC_INIT, "zlog_striper_sync_init"},
+  {STRIPER_EXPAND_PROPOSED, "zlog_striper_expand_proposed"},
+  {STRIPER_EXPAND_JOINED, "zlog_striper_expand_joined"},
+  {STRIPER_EXPAND_LOST, "zlog_striper_expand_lost"}
 };
 
 enum Histograms : uint32_t {
@@ -1,83 +1,813 @@
-#include <set>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
 #include "libseqr.h"
 #include "proto/zlog.pb.h"
 
 namespace zlog {
 
-void SeqrClient::Connect() {
+// errors from the system are returned as is, and anything else (e.g. the
+// service closing the connection) is an i/o error.
+static int to_errno(const boost::system::error_code& ec)
+{
+  if (ec.category() == boost::system::system_category() && ec.value() > 0) {
+    return -ec.value();
+  }
+  return -EIO;
+}
+
+// the service reads each request into a fixed size buffer
+static const size_t max_msg_size = 1024;
+
+struct SeqrClient::Request {
+  zlog_proto::MSeqRequest msg;
+
+  // callers that have joined the request, and their counts
+  std::vector<std::pair<uint32_t, Callback>> waiters;
+
+  // when the request was sent
+  std::chrono::steady_clock::time_point sent;
+
+  void complete(int ret, uint64_t position) {
+    for (auto& waiter : waiters) {
+      waiter.second(ret, position);
+      if (!ret && msg.next()) {
+        position += waiter.first;
+      }
+    }
+  }
+};
+
+struct SeqrClient::channel {
+  explicit channel(boost::asio::io_service& io_service) :
+    socket_(io_service),
+    writing_(false)
+  {}
+
+  boost::asio::ip::tcp::socket socket_;
+
+  // requests waiting for room in the pipeline, and requests that have been
+  // sent and are waiting for a reply, in the order that they were sent.
+  std::deque<std::shared_ptr<Request>> queued_;
+  std::deque<std::shared_ptr<Request>> inflight_;
+
+  // a write has been scheduled or is in progress
+  bool writing_;
+  std::string out_;
+
+  uint32_t in_hdr_;
+  std::vector<char> in_;
+};
+
+SeqrClient::SeqrClient(const std::string& host, const std::string& port,
+    int channels, int pipeline_depth, uint32_t timeout_ms) :
+  host_(host),
+  port_(port),
+  pipeline_depth_(std::max(pipeline_depth, 1)),
+  timeout_(timeout_ms),
+  work_(new boost::asio::io_service::work(io_service_)),
+  error_(-ENOTCONN),
+  connecting_(false),
+  resolver_(io_service_),
+  next_channel_(0),
+  next_timer_(0),
+  timeout_timer_(io_service_)
+{
+  for (int i = 0; i < std::max(channels, 1); i++) {
+    channels_.push_back(new channel(io_service_));
+  }
+}
+
+SeqrClient::~SeqrClient()
+{
+  work_.reset();
+  io_service_.stop();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+
+  std::vector<std::shared_ptr<Request>> failed;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (!error_) {
+      fail_(-ESHUTDOWN, &failed);
+    }
+  }
+  for (auto& req : failed) {
+    req->complete(-ESHUTDOWN, 0);
+  }
+
+  // the thread has stopped, so the remaining timers will never fire
+  decltype(timers_) timers;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    timers.swap(timers_);
+  }
+  for (auto& timer : timers) {
+    timer.second.second();
+  }
+
   for (channel *chan : channels_) {
-    boost::asio::ip::tcp::resolver resolver(chan->io_service_);
-    boost::asio::ip::tcp::resolver::query query(
-        boost::asio::ip::tcp::v4(), host_.c_str(), port_);
-    boost::asio::ip::tcp::resolver::iterator iterator = resolver.resolve(query);
-    chan->socket_.connect(*iterator);
-  }
-}
-
-int SeqrClient::CheckTail(uint64_t epoch,
-    const std::map<std::string, std::string>& meta,
-    const std::string& name, uint64_t *position, bool next) {
-  // fill in msg
-  zlog_proto::MSeqRequest req;
-  req.set_epoch(epoch);
-  req.set_name(name);
-  req.set_next(next);
-  for (auto e : meta) {
-    auto sp = req.add_meta();
-    sp->set_key(e.first);
-    sp->set_val(e.second);
-  }
-  req.set_count(1);
-
-  channel *chan = channels_[next_channel_++ % num_channels_];
-  std::lock_guard<std::mutex> l(chan->lock_);
-
-  // serialize header and protobuf message
-  uint32_t msg_size = req.ByteSize();
-  uint32_t be_msg_size = htonl(msg_size);
-  uint32_t total_msg_size = msg_size + sizeof(be_msg_size);
-  assert(total_msg_size <= sizeof(chan->buffer));
-
-  // add header
-  memcpy(chan->buffer, &be_msg_size, sizeof(be_msg_size));
-
-  // add protobuf msg
-  assert(req.IsInitialized());
-  if (!req.SerializeToArray(chan->buffer + sizeof(be_msg_size), msg_size)) {
-    return -EIO;
-  }
-
-  // send
-  boost::asio::write(chan->socket_, boost::asio::buffer(chan->buffer, total_msg_size));
-
-  // get reply
-  boost::asio::read(chan->socket_, boost::asio::buffer(&be_msg_size, sizeof(be_msg_size)));
-  msg_size = ntohl(be_msg_size);
-  assert(msg_size < sizeof(chan->buffer));
-  boost::asio::read(chan->socket_, boost::asio::buffer(chan->buffer, msg_size));
-
-  // deserialize
-  zlog_proto::MSeqReply reply;
-  if (!reply.ParseFromArray(chan->buffer, msg_size)) {
-    return -EIO;
-  }
-  assert(reply.IsInitialized());
-
-  if (reply.status() == zlog_proto::MSeqReply::INIT_LOG)
-    return -EAGAIN;
-  else if (reply.status() == zlog_proto::MSeqReply::STALE_EPOCH)
-    return -ERANGE;
-  else {
-    assert(reply.status() == zlog_proto::MSeqReply::OK);
-    assert(reply.position_size() == 1);
-    *position = reply.position(0);
-  }
-
-  return 0;
+    delete chan;
+  }
+}
+
+int SeqrClient::Connect()
+{
+  struct {
+    int ret;
+    bool done = false;
+    std::mutex lock;
+    std::condition_variable cond;
+  } ctx;
+
+  ConnectAsync([&](int ret) {
+    std::lock_guard<std::mutex> lk(ctx.lock);
+    ctx.ret = ret;
+    ctx.done = true;
+    ctx.cond.notify_one();
+  });
+
+  std::unique_lock<std::mutex> lk(ctx.lock);
+  ctx.cond.wait(lk, [&] { return ctx.done; });
+  return ctx.ret;
+}
+
+void SeqrClient::ConnectAsync(std::function<void(int)> cb)
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    assert(error_ == -ENOTCONN && !connecting_);
+    error_ = 0;
+    connecting_ = true;
+    connect_start_ = std::chrono::steady_clock::now();
+    if (timeout_.count()) {
+      watch_timeout_();
+    }
+  }
+
+  thread_ = std::thread([this] { io_service_.run(); });
+
+  boost::asio::ip::tcp::resolver::query query(
+      boost::asio::ip::tcp::v4(), host_, port_);
+  resolver_.async_resolve(query, [this, cb](
+        const boost::system::error_code& ec,
+        boost::asio::ip::tcp::resolver::iterator iterator) {
+    if (ec) {
+      handle_connect_(-EINVAL, cb);
+      return;
+    }
+    connect_(0, iterator, cb);
+  });
+}
+
+// connect the channels one after the other
+void SeqrClient::connect_(size_t i,
+    boost::asio::ip::tcp::resolver::iterator iterator,
+    std::function<void(int)> cb)
+{
+  if (i == channels_.size()) {
+    handle_connect_(0, cb);
+    return;
+  }
+
+  channel *chan = channels_[i];
+  boost::asio::async_connect(chan->socket_, iterator,
+      [this, i, iterator, cb, chan](const boost::system::error_code& ec,
+        boost::asio::ip::tcp::resolver::iterator) {
+    if (ec) {
+      handle_connect_(to_errno(ec), cb);
+      return;
+    }
+    boost::system::error_code opt_ec;
+    chan->socket_.set_option(boost::asio::ip::tcp::no_delay(true), opt_ec);
+    connect_(i + 1, iterator, cb);
+  });
+}
+
+void SeqrClient::handle_connect_(int ret, std::function<void(int)> cb)
+{
+  std::vector<std::shared_ptr<Request>> failed;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    connecting_ = false;
+    if (!error_) {
+      if (ret) {
+        fail_(ret, &failed);
+      } else {
+        for (channel *chan : channels_) {
+          read_hdr_(chan);
+          if (!chan->queued_.empty()) {
+            chan->writing_ = true;
+            write_(chan);
+          }
+        }
+      }
+    }
+  }
+
+  for (auto& req : failed) {
+    req->complete(ret, 0);
+  }
+
+  if (cb) {
+    cb(ret);
+  }
+}
+
+bool SeqrClient::failed()
+{
+  std::lock_guard<std::mutex> lk(lock_);
+  return error_ != 0;
+}
+
+void SeqrClient::RunAfter(std::chrono::milliseconds delay,
+    std::function<void()> fn)
+{
+  std::lock_guard<std::mutex> lk(lock_);
+  const auto id = next_timer_++;
+  auto& timer = timers_[id];
+  timer.first.reset(new boost::asio::steady_timer(io_service_, delay));
+  timer.second = std::move(fn);
+  timer.first->async_wait([this, id](const boost::system::error_code& ec) {
+    std::function<void()> fn;
+    {
+      std::lock_guard<std::mutex> lk(lock_);
+      auto it = timers_.find(id);
+      if (it == timers_.end()) {
+        return;
+      }
+      fn = std::move(it->second.second);
+      timers_.erase(it);
+    }
+    fn();
+  });
+}
+
+int SeqrClient::CheckTail(uint64_t epoch, const std::string& name,
+    uint64_t *position, bool next, uint32_t count)
+{
+  struct {
+    int ret;
+    bool done = false;
+    uint64_t position;
+    std::mutex lock;
+    std::condition_variable cond;
+  } ctx;
+
+  CheckTailAsync(epoch, name, next, count,
+      [&](int ret, uint64_t position) {
+    std::lock_guard<std::mutex> lk(ctx.lock);
+    ctx.ret = ret;
+    ctx.position = position;
+    ctx.done = true;
+    ctx.cond.notify_one();
+  });
+
+  std::unique_lock<std::mutex> lk(ctx.lock);
+  ctx.cond.wait(lk, [&] { return ctx.done; });
+  if (!ctx.ret) {
+    *position = ctx.position;
+  }
+  return ctx.ret;
+}
+
+void SeqrClient::CheckTailAsync(uint64_t epoch, const std::string& name,
+    bool next, uint32_t count, Callback cb)
+{
+  assert(count > 0);
+  assert(next || count == 1);
+
+  std::unique_lock<std::mutex> lk(lock_);
+
+  if (error_) {
+    const int ret = error_;
+    lk.unlock();
+    cb(ret, 0);
+    return;
+  }
+
+  // join a request that hasn't been sent yet. tail reads share the result,
+  // and reservations are added to the count unless it would overflow.
+  const auto key = std::make_tuple(name, epoch, next);
+  auto it = open_.find(key);
+  if (it != open_.end()) {
+    auto& req = it->second;
+    if (!next) {
+      req->waiters.emplace_back(count, std::move(cb));
+      return;
+    }
+    if (req->msg.count() <= std::numeric_limits<uint32_t>::max() - count) {
+      req->msg.set_count(req->msg.count() + count);
+      req->waiters.emplace_back(count, std::move(cb));
+      return;
+    }
+  }
+
+  auto req = std::make_shared<Request>();
+  req->msg.set_epoch(epoch);
+  req->msg.set_name(name);
+  req->msg.set_next(next);
+
+  // the size of the largest count that the request may grow to
+  req->msg.set_count(std::numeric_limits<uint32_t>::max());
+  if (req->msg.ByteSizeLong() + sizeof(uint32_t) > max_msg_size) {
+    lk.unlock();
+    cb(-EINVAL, 0);
+    return;
+  }
+  req->msg.set_count(count);
+  req->waiters.emplace_back(count, std::move(cb));
+
+  open_[key] = req;
+
+  // requests made while connecting are sent once the connections are up
+  channel *chan = channels_[next_channel_++ % channels_.size()];
+  chan->queued_.push_back(req);
+  if (!chan->writing_ && !connecting_) {
+    chan->writing_ = true;
+    io_service_.post([this, chan] {
+      std::lock_guard<std::mutex> lk(lock_);
+      if (!error_) {
+        write_(chan);
+      }
+    });
+  }
+}
+
+// send queued requests while there is room in the pipeline. requires lock_,
+// and that the channel is marked as writing, which is cleared if there is
+// nothing to send.
+void SeqrClient::write_(channel *chan)
+{
+  assert(chan->writing_);
+
+  chan->out_.clear();
+  while (!chan->queued_.empty() &&
+      (int)chan->inflight_.size() < pipeline_depth_) {
+    auto req = chan->queued_.front();
+    chan->queued_.pop_front();
+
+    // the request can no longer be joined
+    const auto& msg = req->msg;
+    auto it = open_.find(std::make_tuple(msg.name(), msg.epoch(), msg.next()));
+    if (it != open_.end() && it->second == req) {
+      open_.erase(it);
+    }
+
+    assert(msg.IsInitialized());
+    const uint32_t be_msg_size = htonl(msg.ByteSizeLong());
+    chan->out_.append((const char*)&be_msg_size, sizeof(be_msg_size));
+    msg.AppendToString(&chan->out_);
+
+    req->sent = std::chrono::steady_clock::now();
+    chan->inflight_.push_back(req);
+  }
+
+  if (chan->out_.empty()) {
+    chan->writing_ = false;
+    return;
+  }
+
+  boost::asio::async_write(chan->socket_, boost::asio::buffer(chan->out_),
+      [this, chan](const boost::system::error_code& ec, size_t size) {
+    handle_write_(chan, ec);
+  });
+}
+
+void SeqrClient::handle_write_(channel *chan,
+    const boost::system::error_code& ec)
+{
+  std::vector<std::shared_ptr<Request>> failed;
+  int ret;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (error_) {
+      return;
+    }
+    if (!ec) {
+      write_(chan);
+      return;
+    }
+    ret = to_errno(ec);
+    fail_(ret, &failed);
+  }
+
+  for (auto& req : failed) {
+    req->complete(ret, 0);
+  }
+}
+
+// requires lock_
+void SeqrClient::read_hdr_(channel *chan)
+{
+  boost::asio::async_read(chan->socket_,
+      boost::asio::buffer(&chan->in_hdr_, sizeof(chan->in_hdr_)),
+      [this, chan](const boost::system::error_code& ec, size_t size) {
+    handle_hdr_(chan, ec);
+  });
+}
+
+void SeqrClient::handle_hdr_(channel *chan,
+    const boost::system::error_code& ec)
+{
+  std::vector<std::shared_ptr<Request>> failed;
+  int ret;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (error_) {
+      return;
+    }
+    const uint32_t msg_size = ntohl(chan->in_hdr_);
+    if (!ec && msg_size <= max_msg_size) {
+      chan->in_.resize(msg_size);
+      boost::asio::async_read(chan->socket_,
+          boost::asio::buffer(chan->in_),
+          [this, chan](const boost::system::error_code& ec, size_t size) {
+        handle_reply_(chan, ec);
+      });
+      return;
+    }
+    ret = ec ? to_errno(ec) : -EIO;
+    fail_(ret, &failed);
+  }
+
+  for (auto& req : failed) {
+    req->complete(ret, 0);
+  }
+}
+
+void SeqrClient::handle_reply_(channel *chan,
+    const boost::system::error_code& ec)
+{
+  std::shared_ptr<Request> req;
+  std::vector<std::shared_ptr<Request>> failed;
+  int ret = -EIO;
+  uint64_t position = 0;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (error_) {
+      return;
+    }
+
+    zlog_proto::MSeqReply reply;
+    if (ec) {
+      ret = to_errno(ec);
+    } else if (!chan->inflight_.empty() &&
+        reply.ParseFromArray(chan->in_.data(), chan->in_.size())) {
+      switch (reply.status()) {
+        case zlog_proto::MSeqReply::OK:
+          if (reply.has_position()) {
+            ret = 0;
+            position = reply.position();
+          }
+          break;
+        case zlog_proto::MSeqReply::INIT_LOG:
+          ret = -EAGAIN;
+          break;
+        case zlog_proto::MSeqReply::STALE_EPOCH:
+          ret = -ERANGE;
+          break;
+      }
+    }
+
+    if (ret && ret != -EAGAIN && ret != -ERANGE) {
+      fail_(ret, &failed);
+    } else {
+      req = chan->inflight_.front();
+      chan->inflight_.pop_front();
+      if (!chan->writing_ && !chan->queued_.empty()) {
+        chan->writing_ = true;
+        write_(chan);
+      }
+      read_hdr_(chan);
+    }
+  }
+
+  if (req) {
+    req->complete(ret, position);
+  }
+  for (auto& r : failed) {
+    r->complete(ret, 0);
+  }
+}
+
+// requires lock_
+void SeqrClient::watch_timeout_()
+{
+  timeout_timer_.expires_from_now(timeout_ / 2);
+  timeout_timer_.async_wait([this](const boost::system::error_code& ec) {
+    std::vector<std::shared_ptr<Request>> failed;
+    {
+      std::lock_guard<std::mutex> lk(lock_);
+      if (ec || error_) {
+        return;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      bool expired = connecting_ && now - connect_start_ >= timeout_;
+      for (channel *chan : channels_) {
+        if (!chan->inflight_.empty() &&
+            now - chan->inflight_.front()->sent >= timeout_) {
+          expired = true;
+        }
+      }
+      if (expired) {
+        fail_(-ETIMEDOUT, &failed);
+      } else {
+        watch_timeout_();
+      }
+    }
+
+    for (auto& req : failed) {
+      req->complete(-ETIMEDOUT, 0);
+    }
+  });
+}
+
+void SeqrClient::fail_(int ret, std::vector<std::shared_ptr<Request>> *failed)
+{
+  assert(ret);
+  error_ = ret;
+  open_.clear();
+  for (channel *chan : channels_) {
+    failed->insert(failed->end(), chan->inflight_.begin(),
+        chan->inflight_.end());
+    failed->insert(failed->end(), chan->queued_.begin(),
+        chan->queued_.end());
+    chan->inflight_.clear();
+    chan->queued_.clear();
+    boost::system::error_code ec;
+    chan->socket_.close(ec);
+  }
+}
+
+struct SeqrServer::context {
+  context() :
+    io_service_(1),
+    num_requests_(0)
+  {}
+
+  boost::asio::io_service io_service_;
+  std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+  std::thread thread_;
+
+  // only updated by this context's thread
+  std::atomic<uint64_t> num_requests_;
+};
+
+class SeqrServer::Session :
+  public std::enable_shared_from_this<SeqrServer::Session> {
+ public:
+  Session(context *ctx, const HandlerFactory& factory) :
+    ctx_(ctx),
+    socket_(ctx->io_service_),
+    factory_(factory)
+  {}
+
+  boost::asio::ip::tcp::socket& socket() {
+    return socket_;
+  }
+
+  void start() {
+    handler_ = factory_();
+    boost::system::error_code ec;
+    socket_.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    read_hdr();
+  }
+
+ private:
+  void read_hdr() {
+    boost::asio::async_read(socket_,
+        boost::asio::buffer(buffer_, sizeof(uint32_t)),
+        boost::bind(&Session::handle_hdr, shared_from_this(),
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_hdr(const boost::system::error_code& err, size_t size) {
+    if (err) {
+      return;
+    }
+
+    uint32_t tmp;
+    memcpy(&tmp, (void*)buffer_, sizeof(tmp));
+    uint32_t msg_size = ntohl(tmp);
+
+    if (msg_size > sizeof(buffer_)) {
+      std::cerr << "message is too large" << std::endl;
+      return;
+    }
+
+    boost::asio::async_read(socket_,
+        boost::asio::buffer(buffer_, msg_size),
+        boost::bind(&Session::handle_msg, shared_from_this(),
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_msg(const boost::system::error_code& err, size_t size) {
+    if (err) {
+      return;
+    }
+
+    req_.Clear();
+
+    if (!req_.ParseFromArray(buffer_, size)) {
+      std::cerr << "failed to parse message" << std::endl;
+      return;
+    }
+
+    if (req_.count() == 0 || (!req_.next() && req_.count() != 1)) {
+      std::cerr << "invalid request" << std::endl;
+      return;
+    }
+
+    uint64_t position;
+    int ret = handler_(req_.name(), req_.epoch(), req_.next(), req_.count(),
+        &position);
+    ctx_->num_requests_.store(ctx_->num_requests_.load(
+          std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    reply_.Clear();
+    if (ret == -EAGAIN) {
+      reply_.set_status(zlog_proto::MSeqReply::INIT_LOG);
+    } else if (ret == -ERANGE) {
+      reply_.set_status(zlog_proto::MSeqReply::STALE_EPOCH);
+    } else {
+      assert(!ret);
+      reply_.set_status(zlog_proto::MSeqReply::OK);
+      reply_.set_position(position);
+    }
+
+    uint32_t msg_size = reply_.ByteSizeLong();
+    assert(msg_size < sizeof(buffer_));
+    if (!reply_.SerializeToArray(buffer_, msg_size)) {
+      std::cerr << "failed to serialize message" << std::endl;
+      return;
+    }
+
+    // scatter/gather buffers
+    std::vector<boost::asio::const_buffer> out;
+    be_msg_size_ = htonl(msg_size);
+    out.push_back(boost::asio::buffer(&be_msg_size_, sizeof(be_msg_size_)));
+    out.push_back(boost::asio::buffer(buffer_, msg_size));
+
+    boost::asio::async_write(socket_, out,
+        boost::bind(&Session::handle_reply, shared_from_this(),
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_reply(const boost::system::error_code& err, size_t size) {
+    if (err) {
+      return;
+    }
+
+    read_hdr();
+  }
+
+  context *ctx_;
+  boost::asio::ip::tcp::socket socket_;
+  const HandlerFactory& factory_;
+  Handler handler_;
+
+  char buffer_[1024];
+  uint32_t be_msg_size_;
+
+  zlog_proto::MSeqRequest req_;
+  zlog_proto::MSeqReply reply_;
+};
+
+static std::unique_ptr<boost::asio::ip::tcp::acceptor> listen(
+    boost::asio::io_service& io_service,
+    const boost::asio::ip::tcp::endpoint& endpoint)
+{
+  std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor(
+      new boost::asio::ip::tcp::acceptor(io_service));
+  acceptor->open(endpoint.protocol());
+  acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+  acceptor->set_option(boost::asio::detail::socket_option::boolean<
+      SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+  acceptor->bind(endpoint);
+  acceptor->listen();
+  return acceptor;
+}
+
+SeqrServer::SeqrServer(const std::string& host, int port, int threads,
+    HandlerFactory factory) :
+  factory_(factory),
+  next_context_(0)
+{
+  for (int i = 0; i < std::max(threads, 1); i++) {
+    contexts_.push_back(new context);
+  }
+
+  boost::asio::ip::tcp::endpoint endpoint(
+      boost::asio::ip::address::from_string(host), port);
+
+  try {
+    contexts_[0]->acceptor_ = listen(contexts_[0]->io_service_, endpoint);
+#ifdef SO_REUSEPORT
+    // the other sockets join the port that the first one was bound to
+    endpoint.port(contexts_[0]->acceptor_->local_endpoint().port());
+    for (size_t i = 1; i < contexts_.size(); i++) {
+      contexts_[i]->acceptor_ = listen(contexts_[i]->io_service_, endpoint);
+    }
+#endif
+  } catch (...) {
+    for (auto ctx : contexts_) {
+      delete ctx;
+    }
+    throw;
+  }
+
+  for (auto ctx : contexts_) {
+    if (ctx->acceptor_) {
+      start_accept(ctx);
+    }
+  }
+}
+
+SeqrServer::~SeqrServer()
+{
+  stop();
+  for (auto ctx : contexts_) {
+    delete ctx;
+  }
+}
+
+int SeqrServer::port() const
+{
+  return contexts_[0]->acceptor_->local_endpoint().port();
+}
+
+uint64_t SeqrServer::num_requests() const
+{
+  uint64_t count = 0;
+  for (auto ctx : contexts_) {
+    count += ctx->num_requests_.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+void SeqrServer::start()
+{
+  for (auto ctx : contexts_) {
+    assert(!ctx->thread_.joinable());
+    ctx->thread_ = std::thread([ctx] { ctx->io_service_.run(); });
+  }
+}
+
+void SeqrServer::wait()
+{
+  for (auto ctx : contexts_) {
+    if (ctx->thread_.joinable()) {
+      ctx->thread_.join();
+    }
+  }
+}
+
+void SeqrServer::stop()
+{
+  for (auto ctx : contexts_) {
+    ctx->io_service_.stop();
+  }
+  wait();
+}
+
+// without SO_REUSEPORT the first context accepts every connection, and hands
+// them out to the contexts in turn.
+void SeqrServer::start_accept(context *ctx)
+{
+  context *target = ctx;
+  if (contexts_.size() > 1 && ctx == contexts_[0] &&
+      !contexts_[1]->acceptor_) {
+    target = contexts_[next_context_++ % contexts_.size()];
+  }
+
+  auto session = std::make_shared<Session>(target, factory_);
+  ctx->acceptor_->async_accept(session->socket(),
+      [this, ctx, target, session](const boost::system::error_code& err) {
+    if (!err) {
+      target->io_service_.post([session] {
+        session->start();
+      });
+    }
+    if (err != boost::asio::error::operation_aborted) {
+      start_accept(ctx);
+    }
+  });
 }
 
 }
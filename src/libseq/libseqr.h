@@ -1,65 +1,179 @@
 #pragma once
-#include <iostream>
-#include <set>
-#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <atomic>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 #include <boost/asio.hpp>
 
 namespace zlog {
 
+// Client of a sequencer service (zlog-seqr).
+//
+// Requests are framed as a 4-byte big-endian length followed by a serialized
+// MSeqRequest, and replies the same way with an MSeqReply. The service answers
+// the requests on a connection in order, so several requests are kept in
+// flight on each connection and replies are matched to requests in the order
+// that they were sent.
+//
+// Concurrent requests for the same log and epoch are coalesced: while a
+// request waits for room in the pipeline, later requests join it, and a single
+// request for the sum of their counts is sent. The reserved range is then
+// split between the callers in the order that they joined.
+//
 // it's important to delete any seqr clients that are created because when the
 // channels are created in the constructor there are file descriptors created
-// at that point (at least on OSX). When the derived class is the fake
-// sequencer, we were just letting memory leak in tests... but it turns out that
-// OSX will quickly reach an open file descriptor limit..
+// at that point (at least on OSX).
 class SeqrClient {
  public:
-  SeqrClient(const char *host, const char *port, uint64_t epoch) :
-    host_(host), port_(port), epoch_(epoch)
-  {
-    num_channels_ = 5;
-    next_channel_ = 0;
-    for (int i = 0; i < num_channels_; i++) {
-      channels_.push_back(new channel);
-    }
-  }
-
-  virtual ~SeqrClient() {
-    for (channel *chan : channels_) {
-      chan->io_service_.stop();
-      chan->socket_.close();
-      delete chan;
-    }
-  }
-
-  virtual void Connect();
-
-  virtual int CheckTail(uint64_t epoch,
-      const std::map<std::string, std::string>& meta,
-      const std::string& name, uint64_t *position, bool next);
-
-  uint64_t Epoch() const {
-    return epoch_;
-  }
+  typedef std::function<void(int ret, uint64_t position)> Callback;
+
+  // requests are spread over `channels` connections, each with at most
+  // `pipeline_depth` requests in flight. when timeout_ms is non-zero, a
+  // connect or a request that takes that long fails the client with
+  // -ETIMEDOUT.
+  SeqrClient(const std::string& host, const std::string& port,
+      int channels = 2, int pipeline_depth = 4, uint32_t timeout_ms = 0);
+
+  ~SeqrClient();
+
+  SeqrClient(const SeqrClient&) = delete;
+  SeqrClient& operator=(const SeqrClient&) = delete;
+
+  int Connect();
+
+  // start connecting, and call cb with the result if it is set. requests made
+  // while connecting are sent once the connections are up, or fail with the
+  // connect error.
+  void ConnectAsync(std::function<void(int)> cb = nullptr);
+
+  // read the tail of the log, or when next is true reserve `count` new
+  // consecutive positions and return the first. epoch is the epoch of the
+  // sequencer that the caller expects to be serving the log. -ERANGE is
+  // returned if the service has since become the sequencer in a newer epoch,
+  // and -EAGAIN if the service is not yet ready to serve the log. other errors
+  // mean that a connection to the service failed, after which every request
+  // fails and a new client is needed to reconnect.
+  int CheckTail(uint64_t epoch, const std::string& name, uint64_t *position,
+      bool next, uint32_t count = 1);
+
+  // asynchronous CheckTail. the callback runs on the client's thread, and
+  // should not block.
+  void CheckTailAsync(uint64_t epoch, const std::string& name, bool next,
+      uint32_t count, Callback cb);
+
+  // true once a connection has failed
+  bool failed();
+
+  // run fn on the client's thread after the delay, or when the client is
+  // destroyed if that comes first. this lets callers back off without a
+  // thread of their own. fn should not block.
+  void RunAfter(std::chrono::milliseconds delay, std::function<void()> fn);
 
  private:
-  struct channel {
-    channel() : socket_(io_service_) {}
-    boost::asio::io_service io_service_;
-    boost::asio::ip::tcp::socket socket_;
-    char buffer[1024];
-    std::mutex lock_;
-  };
+  struct Request;
+  struct channel;
+
+  void write_(channel *chan);
+  void handle_write_(channel *chan, const boost::system::error_code& ec);
+  void read_hdr_(channel *chan);
+  void handle_hdr_(channel *chan, const boost::system::error_code& ec);
+  void handle_reply_(channel *chan, const boost::system::error_code& ec);
+
+  void connect_(size_t i, boost::asio::ip::tcp::resolver::iterator iterator,
+      std::function<void(int)> cb);
+  void handle_connect_(int ret, std::function<void(int)> cb);
+
+  // fail every request, and close the connections. requires lock_.
+  void fail_(int ret, std::vector<std::shared_ptr<Request>> *failed);
+
+  // periodically fail the client if connecting, or the oldest request in
+  // flight on a channel, has taken longer than the timeout.
+  void watch_timeout_();
+
+  const std::string host_;
+  const std::string port_;
+  const int pipeline_depth_;
+  const std::chrono::milliseconds timeout_;
+
+  boost::asio::io_service io_service_;
+  std::unique_ptr<boost::asio::io_service::work> work_;
+  std::thread thread_;
 
+  std::mutex lock_;
+  int error_;
+  bool connecting_;
+  std::chrono::steady_clock::time_point connect_start_;
+  boost::asio::ip::tcp::resolver resolver_;
   std::vector<channel*> channels_;
+  int next_channel_;
+
+  // requests that new callers can still join, by (name, epoch, next)
+  std::map<std::tuple<std::string, uint64_t, bool>,
+    std::shared_ptr<Request>> open_;
+
+  // pending RunAfter calls
+  uint64_t next_timer_;
+  std::map<uint64_t, std::pair<std::unique_ptr<boost::asio::steady_timer>,
+    std::function<void()>>> timers_;
+
+  boost::asio::steady_timer timeout_timer_;
+};
+
+// Sequencer service network front-end. Requests are decoded and passed to the
+// handler, which sets the position and returns 0, -ERANGE for a request with a
+// stale epoch, or -EAGAIN if the log isn't being served yet.
+//
+// The server runs one io_service per thread. Where SO_REUSEPORT is available
+// each io_service has its own listening socket on the same port and the kernel
+// spreads connections between them, and otherwise connections accepted on a
+// single socket are handed out in turn. A connection stays on the io_service
+// that accepted it, and each connection gets its own handler from the factory,
+// so a handler only ever runs on one thread and can keep per-connection state
+// without locking. Handlers should not block.
+class SeqrServer {
+ public:
+  typedef std::function<int(const std::string& name, uint64_t epoch,
+      bool next, uint32_t count, uint64_t *position)> Handler;
+  typedef std::function<Handler()> HandlerFactory;
+
+  // a port of zero binds to any free port
+  SeqrServer(const std::string& host, int port, int threads,
+      HandlerFactory factory);
+
+  ~SeqrServer();
+
+  SeqrServer(const SeqrServer&) = delete;
+  SeqrServer& operator=(const SeqrServer&) = delete;
+
+  // the port that the server is listening on
+  int port() const;
+
+  // number of requests handled
+  uint64_t num_requests() const;
+
+  // start serving on the server's threads
+  void start();
+
+  // wait for the server's threads to exit, which happens after stop
+  void wait();
+
+  void stop();
+
+ private:
+  class Session;
+  struct context;
 
-  std::string host_;
-  std::string port_;
-  uint64_t epoch_;
+  void start_accept(context *ctx);
 
-  int num_channels_;
-  std::atomic<int> next_channel_;
+  const HandlerFactory factory_;
+  std::vector<context*> contexts_;
+  size_t next_context_;
 };
 
 }
@@ -1,3 +1,4 @@
+#include<cassert>
 #include<iostream>
 #include<string>
 #include<unordered_map>
@@ -5,49 +6,147 @@
 #include<iterator>
 #include"include/zlog/eviction.h"
 #include"include/zlog/cache.h"
+#include"util/mutexlock.h"
 
 namespace zlog{
 
+constexpr size_t Cache::kMinShardCapacity;
+
+Cache::Cache(const zlog::Options& ops) :
+  statistics(ops.statistics)
+{
+  size_t num_shards = 1;
+  while(num_shards < ops.cache_num_shards && num_shards < (1u << 16)){
+    num_shards <<= 1;
+  }
+
+  // a shard only holds entries that fit in its share of the capacity, so a
+  // small cache uses fewer shards rather than rejecting most entries.
+  while(num_shards > 1 && ops.cache_size / num_shards < kMinShardCapacity){
+    num_shards >>= 1;
+  }
+  shard_mask = num_shards - 1;
+
+  // the remainder is spread over the first shards so that the shard
+  // capacities add up to exactly cache_size.
+  const size_t share = ops.cache_size / num_shards;
+  const size_t remainder = ops.cache_size % num_shards;
+  for(size_t i = 0; i < num_shards; i++){
+    std::unique_ptr<Shard> s(new Shard);
+    s->eviction.reset(new_eviction(ops.eviction));
+    s->capacity = share + (i < remainder ? 1 : 0);
+    shards.push_back(std::move(s));
+  }
+}
+
 Cache::~Cache(){}
 
+zlog::Eviction* Cache::new_eviction(zlog::Eviction::Eviction_Policy policy){
+  switch(policy){
+    case zlog::Eviction::Eviction_Policy::LRU:
+      return new LRU();
+    case zlog::Eviction::Eviction_Policy::ARC:
+      return new ARC();
+    case zlog::Eviction::Eviction_Policy::CLOCK:
+      return new CLOCK();
+    case zlog::Eviction::Eviction_Policy::S3FIFO:
+      return new S3FIFO();
+    default:
+      std::cout << "Eviction policy not implemented. Using default: LRU" << std::endl;   
+      return new LRU();
+  }
+}
+
 int Cache::put(uint64_t pos, const std::string& data){
-  int ret = 0;
-  mut.lock();
-  if(options.cache_size > 0 && data.size() < options.cache_size && cache_map.find(pos) == cache_map.end()){ 
-    eviction->cache_put_miss(pos);
-    zlog_mempool::cache::string pool_data(data.data(), data.size());
-    cache_map[pos] = zlog_mempool::cache::string(pool_data);
-  }else{
-    ret = -1;
+  auto& s = shard(pos);
+  const auto size = charge(data.size());
+
+  WriteLock lk(&s.mut);
+
+  if(size > s.capacity || s.cache_map.find(pos) != s.cache_map.end()){
+    return -1;
   }
-  mut.unlock();
-  return ret;
+
+  s.cache_map.emplace(pos, zlog_mempool::cache::string(data.data(), data.size()));
+  s.eviction->cache_put_miss(pos);
+  s.bytes += size;
+  s.inserts.fetch_add(1, std::memory_order_relaxed);
+
+  while(s.bytes > s.capacity){
+    uint64_t victim;
+    int ret = s.eviction->get_evicted(&victim);
+    assert(ret == 0);
+    (void)ret;
+    auto it = s.cache_map.find(victim);
+    assert(it != s.cache_map.end());
+    s.bytes -= charge(it->second.size());
+    s.cache_map.erase(it);
+    s.evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return 0;
 }
 
 int Cache::get(uint64_t* pos, std::string* data){
   #ifdef WITH_STATS
-  RecordTick(options.statistics, CACHE_REQS);
+  RecordTick(statistics, CACHE_REQS);
   #endif
-  auto map_it = cache_map.find(*pos);
-  int ret = 0;       
-  mut.lock(); 
-  if(map_it != cache_map.end()){
+  auto& s = shard(*pos);
+  int ret = 0;
+  const bool shared = s.eviction->concurrent_hits();
+  if(shared){
+    s.mut.ReadLock();
+  }else{
+    s.mut.WriteLock();
+  }
+  auto map_it = s.cache_map.find(*pos);
+  if(map_it != s.cache_map.end()){
     data->assign((map_it->second).data(), (map_it->second).size());
-    eviction->cache_get_hit(pos);
+    s.eviction->cache_get_hit(pos);
+    s.hits.fetch_add(1, std::memory_order_relaxed);
   }else{
     #ifdef WITH_STATS
-    RecordTick(options.statistics, CACHE_MISSES);
+    RecordTick(statistics, CACHE_MISSES);
     #endif
+    s.eviction->cache_get_miss(*pos);
+    s.misses.fetch_add(1, std::memory_order_relaxed);
     ret = 1;
   }
-  mut.unlock();
+  if(shared){
+    s.mut.ReadUnlock();
+  }else{
+    s.mut.WriteUnlock();
+  }
   return ret;
 }
 
 int Cache::remove(uint64_t* pos){
-  if(cache_map.erase(*pos) > 0){
+  auto& s = shard(*pos);
+  WriteLock lk(&s.mut);
+  auto it = s.cache_map.find(*pos);
+  if(it != s.cache_map.end()){
+    s.bytes -= charge(it->second.size());
+    s.cache_map.erase(it);
+    s.eviction->cache_remove(*pos);
     return 0;    
   }
   return 1;
 }
+
+std::vector<Cache::ShardStats> Cache::shard_stats(){
+  std::vector<ShardStats> stats;
+  for(auto& s : shards){
+    ReadLock lk(&s->mut);
+    ShardStats st;
+    st.entries = s->cache_map.size();
+    st.bytes = s->bytes;
+    st.capacity = s->capacity;
+    st.hits = s->hits.load(std::memory_order_relaxed);
+    st.misses = s->misses.load(std::memory_order_relaxed);
+    st.inserts = s->inserts.load(std::memory_order_relaxed);
+    st.evictions = s->evictions.load(std::memory_order_relaxed);
+    stats.push_back(st);
+  }
+  return stats;
+}
 }
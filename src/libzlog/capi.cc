@@ -55,6 +55,13 @@ extern "C" int zlog_checktail(zlog_log_t log, uint64_t *pposition)
   return ctx->log->CheckTail(pposition);
 }
 
+extern "C" int zlog_peektail(zlog_log_t log, uint64_t max_staleness_us,
+    uint64_t *pposition)
+{
+  zlog_log_ctx *ctx = (zlog_log_ctx*)log;
+  return ctx->log->PeekTail(max_staleness_us, pposition);
+}
+
 extern "C" int zlog_append(zlog_log_t log, const void *data, size_t len,
     uint64_t *pposition)
 {
@@ -0,0 +1,202 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace zlog {
+
+Executor::Executor(int threads) :
+  impl_(new ExecutorImpl(threads))
+{}
+
+Executor::~Executor()
+{}
+
+ExecutorImpl::ExecutorImpl(int threads) :
+  shutdown_(false)
+{
+  for (int i = 0; i < std::max(threads, 1); i++) {
+    threads_.push_back(std::thread(&ExecutorImpl::entry_, this));
+  }
+}
+
+ExecutorImpl::~ExecutorImpl()
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    // the logs close their queues before releasing the executor
+    assert(ready_.empty());
+    shutdown_ = true;
+  }
+
+  ready_cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ExecutorImpl::schedule_(WorkQueue *queue)
+{
+  if (!queue->ready_) {
+    queue->ready_ = true;
+    ready_.push_back(queue);
+    ready_cond_.notify_one();
+  }
+}
+
+void ExecutorImpl::entry_()
+{
+  std::unique_lock<std::mutex> lk(lock_);
+  while (true) {
+    ready_cond_.wait(lk, [&] {
+      return !ready_.empty() || shutdown_;
+    });
+
+    if (ready_.empty()) {
+      assert(shutdown_);
+      break;
+    }
+
+    const auto queue = ready_.front();
+    ready_.pop_front();
+    queue->ready_ = false;
+
+    // claim up to a quantum of the queue's work. if there is more, the queue
+    // goes to the back of the line, where another thread may pick it up while
+    // this one runs the claimed work.
+    uint64_t pending = queue->pending_.load();
+    uint64_t claimed;
+    do {
+      claimed = std::min<uint64_t>(pending, queue->quantum_);
+    } while (claimed &&
+        !queue->pending_.compare_exchange_weak(pending, pending - claimed));
+
+    if (pending > claimed) {
+      schedule_(queue);
+    }
+
+    queue->active_++;
+    lk.unlock();
+
+    for (uint64_t i = 0; i < claimed; i++) {
+      queue->run_one();
+    }
+
+    lk.lock();
+    queue->active_--;
+    if (queue->closed_) {
+      drain_cond_.notify_all();
+    }
+  }
+}
+
+WorkQueue::WorkQueue(ExecutorImpl *executor, uint32_t quantum) :
+  executor_(executor),
+  quantum_(std::max(quantum, 1U)),
+  pending_(0),
+  ready_(false),
+  active_(0),
+  closed_(false)
+{}
+
+WorkQueue::~WorkQueue()
+{
+  std::lock_guard<std::mutex> lk(executor_->lock_);
+  assert(!ready_);
+  assert(active_ == 0);
+  assert(pending_.load() == 0);
+}
+
+void WorkQueue::notify()
+{
+  // when there is already pending work the queue is either in line, or a
+  // thread that is claiming work will see the new unit and put it in line.
+  if (pending_.fetch_add(1) == 0) {
+    std::lock_guard<std::mutex> lk(executor_->lock_);
+    assert(!closed_);
+    executor_->schedule_(this);
+  }
+}
+
+void WorkQueue::close()
+{
+  std::unique_lock<std::mutex> lk(executor_->lock_);
+  closed_ = true;
+  executor_->drain_cond_.wait(lk, [&] {
+    return !ready_ && active_ == 0 && pending_.load() == 0;
+  });
+}
+
+void TaskQueue::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    tasks_.push_back(std::move(task));
+  }
+  notify();
+}
+
+void TaskQueue::run_one()
+{
+  // every unit is announced after its task is queued
+  std::function<void()> task;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    assert(!tasks_.empty());
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+  }
+  task();
+}
+
+void SerialTask::kick()
+{
+  std::lock_guard<std::mutex> lk(lock_);
+  if (closed_) {
+    return;
+  }
+  if (running_) {
+    again_ = true;
+    return;
+  }
+  if (!queued_) {
+    queued_ = true;
+    queue_->submit([this] { run_(); });
+  }
+}
+
+void SerialTask::close()
+{
+  std::unique_lock<std::mutex> lk(lock_);
+  closed_ = true;
+  cond_.wait(lk, [&] {
+    return !queued_ && !running_;
+  });
+}
+
+void SerialTask::run_()
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    assert(queued_);
+    queued_ = false;
+    if (closed_) {
+      cond_.notify_all();
+      return;
+    }
+    running_ = true;
+  }
+
+  fn_();
+
+  std::lock_guard<std::mutex> lk(lock_);
+  running_ = false;
+  if (again_ && !closed_) {
+    queued_ = true;
+    queue_->submit([this] { run_(); });
+  }
+  again_ = false;
+  cond_.notify_all();
+}
+
+}
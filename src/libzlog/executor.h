@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "include/zlog/executor.h"
+
+namespace zlog {
+
+class WorkQueue;
+
+class ExecutorImpl {
+ public:
+  explicit ExecutorImpl(int threads);
+  ~ExecutorImpl();
+
+ private:
+  friend class WorkQueue;
+
+  void entry_();
+
+  // put a queue with pending work at the back of the line. requires lock_.
+  void schedule_(WorkQueue *queue);
+
+  std::mutex lock_;
+  bool shutdown_;
+  std::list<WorkQueue*> ready_;
+  std::condition_variable ready_cond_;
+  // signaled when a queue is no longer being run by any thread
+  std::condition_variable drain_cond_;
+  std::vector<std::thread> threads_;
+};
+
+// The work of one log on an executor. Each call to notify announces a unit of
+// work, and run_one is invoked once for each announced unit on one of the
+// executor's threads. Units may run concurrently on different threads.
+//
+// notify doesn't take a lock unless the queue was idle, so the owner can keep
+// its own lock-free queue of work and only use notify to hand out threads.
+class WorkQueue {
+ public:
+  WorkQueue(ExecutorImpl *executor, uint32_t quantum);
+
+  virtual ~WorkQueue();
+
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+
+  void notify();
+
+  // wait until all announced work has run, and no thread is running work from
+  // this queue. no work may be announced after the queue is closed.
+  void close();
+
+ protected:
+  virtual void run_one() = 0;
+
+ private:
+  friend class ExecutorImpl;
+
+  ExecutorImpl * const executor_;
+  const uint32_t quantum_;
+
+  // announced units that haven't been claimed by a thread
+  std::atomic<uint64_t> pending_;
+
+  // protected by the executor lock
+  bool ready_;
+  uint32_t active_;
+  bool closed_;
+};
+
+// A work queue of tasks
+class TaskQueue : public WorkQueue {
+ public:
+  TaskQueue(ExecutorImpl *executor, uint32_t quantum) :
+    WorkQueue(executor, quantum)
+  {}
+
+  void submit(std::function<void()> task);
+
+ protected:
+  void run_one() override;
+
+ private:
+  std::mutex lock_;
+  std::deque<std::function<void()>> tasks_;
+};
+
+// Runs a function as a task whenever it is kicked. At most one instance of
+// the function runs at a time. Kicks that arrive while the function is queued
+// are merged, and a kick that arrives while the function is running, including
+// from the function itself, runs it again after it returns.
+class SerialTask {
+ public:
+  SerialTask(TaskQueue *queue, std::function<void()> fn) :
+    queue_(queue),
+    fn_(fn),
+    queued_(false),
+    running_(false),
+    again_(false),
+    closed_(false)
+  {}
+
+  void kick();
+
+  // wait for a queued or running instance to finish. later kicks are ignored.
+  void close();
+
+ private:
+  void run_();
+
+  TaskQueue * const queue_;
+  const std::function<void()> fn_;
+
+  std::mutex lock_;
+  bool queued_;
+  bool running_;
+  bool again_;
+  bool closed_;
+  std::condition_variable cond_;
+};
+
+}
@@ -1,8 +1,10 @@
 #include "log_impl.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <condition_variable>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <string>
@@ -15,6 +17,7 @@
 #include "include/zlog/log.h"
 #include "include/zlog/backend.h"
 #include "include/zlog/cache.h"
+#include "monitoring/statistics.h"
 
 #include "striper.h"
 
@@ -26,6 +29,10 @@ LogImpl::LogImpl(std::shared_ptr<Backend> backend,
     const std::string& prefix,
     const std::string& secret,
     const Options& opts) :
+  executor(opts.executor ? opts.executor :
+      std::make_shared<Executor>(opts.finisher_threads)),
+  ops_queue_(this, executor->impl(), opts.executor_quantum),
+  pending_ops_(std::max(opts.max_inflight_ops, 1U)),
   shutdown(false),
   backend(backend),
   name(name),
@@ -33,39 +40,49 @@ LogImpl::LogImpl(std::shared_ptr<Backend> backend,
   prefix(prefix),
   striper(this, secret),
   num_inflight_ops_(0),
+  num_queue_op_waiters_(0),
+  peek_tail_valid_(false),
   options(opts)
+#ifdef WITH_CACHE
+  , cache(new Cache(options))
+#endif
 {
   assert(!name.empty());
   assert(!hoid.empty());
   assert(!prefix.empty());
 
-  for (int i = 0; i < options.finisher_threads; i++) {
-    finishers_.push_back(std::thread(&LogImpl::finisher_entry_, this));
-  }
+  striper.start();
 }
 
 LogImpl::~LogImpl()
-{ 
+{
+  // ops waiting on the backend will be requeued, so the executor keeps running
+  // this log's ops until all admitted ops have completed.
   {
-    std::lock_guard<std::mutex> l(lock);
+    std::unique_lock<std::mutex> lk(shutdown_lock_);
     shutdown = true;
-  }
-  
-  finishers_cond_.notify_all();
-  for (auto& finisher : finishers_) {
-    finisher.join();
+    shutdown_cond_.wait(lk, [&] {
+      return num_inflight_ops_.load() == 0;
+    });
   }
 
+  ops_queue_.close();
   striper.shutdown();
 }
 
 int TailOp::run()
 {
   while (true) {
-    const auto view = log_->striper.view();
+    auto view = log_->striper.read_view();
     if (view->seq) {
       position_ = view->seq->check_tail(increment_);
       return 0;
+    } else if (view->remote_seq()) {
+      int ret = seqr_next(&view, increment_, 1, &position_);
+      if (ret == -EAGAIN) {
+        continue;
+      }
+      return ret;
     } else {
       int ret = log_->striper.propose_sequencer();
       if (ret) {
@@ -120,48 +137,243 @@ int LogImpl::CheckTail(uint64_t *position_out)
   return ctx.ret;
 }
 
-int ReadOp::run()
+bool LogImpl::cached_peek_tail(uint64_t max_staleness_us, uint64_t *position)
 {
-  while (true) {
-    const auto view = log_->striper.view();
-    const auto oid = log_->striper.map(view, position_);
-    if (!oid) {
-      int ret = log_->striper.try_expand_view(position_);
-      if (ret) {
-        return ret;
-      }
-      continue;
-    }
+  if (max_staleness_us == 0) {
+    return false;
+  }
 
-    int ret = log_->backend->Read(*oid, view->epoch(), position_, &data_);
+  std::lock_guard<std::mutex> lk(peek_tail_lock_);
+  if (!peek_tail_valid_) {
+    return false;
+  }
 
-    if (ret == -ESPIPE) {
-      log_->striper.update_current_view(view->epoch());
-      continue;
-    }
+  const auto age = std::chrono::steady_clock::now() - peek_tail_time_;
+  if (age > std::chrono::microseconds(max_staleness_us)) {
+    return false;
+  }
+
+  *position = peek_tail_;
+  return true;
+}
 
-    if (ret == -ERANGE) {
-      return -ENOENT;
+void LogImpl::update_peek_tail(std::chrono::steady_clock::time_point start,
+    uint64_t position)
+{
+  std::lock_guard<std::mutex> lk(peek_tail_lock_);
+  if (!peek_tail_valid_ || position >= peek_tail_) {
+    peek_tail_ = position;
+    peek_tail_time_ = std::max(peek_tail_time_, start);
+    peek_tail_valid_ = true;
+  }
+}
+
+bool PeekTailOp::submit_peek_()
+{
+  oids_ = view_->object_map.stripe(stripe_).oids();
+  max_pos_.assign(oids_.size(), MaxPos());
+  return submit_many(oids_.size(), &rets_,
+      [&](size_t i, std::function<void(int)> cb) {
+    return log_->backend->PeekMaxPosAsync(oids_[i], &max_pos_[i].pos,
+        &max_pos_[i].empty, cb);
+  });
+}
+
+int PeekTailOp::run()
+{
+  while (true) {
+    switch (state_) {
+      case State::Start:
+        if (log_->cached_peek_tail(max_staleness_us_, &position_)) {
+          return 0;
+        }
+        // stripes may have been added by other instances, and a new instance
+        // may not have read any view yet, so the newest view is read first.
+        start_ = std::chrono::steady_clock::now();
+        state_ = State::Refresh;
+        log_->striper.refresh_view_async([this] {
+          log_->requeue_op(this);
+        });
+        return -EINPROGRESS;
+
+      case State::Refresh:
+        view_ = log_->striper.read_view();
+        if (view_->object_map.num_stripes() == 0) {
+          position_ = 0;
+          log_->update_peek_tail(start_, position_);
+          return 0;
+        }
+        stripe_ = view_->object_map.num_stripes() - 1;
+        state_ = State::Peek;
+        if (!submit_peek_()) {
+          return -EINPROGRESS;
+        }
+        break;
+
+      case State::Peek:
+        {
+          bool empty = true;
+          uint64_t max_pos = 0;
+          for (size_t i = 0; i < rets_.size(); i++) {
+            // objects are initialized lazily, and an object that doesn't
+            // exist hasn't been written.
+            if (rets_[i] == -ENOENT) {
+              continue;
+            } else if (rets_[i] < 0) {
+              return rets_[i];
+            }
+            if (!max_pos_[i].empty) {
+              empty = false;
+              max_pos = std::max(max_pos, max_pos_[i].pos);
+            }
+          }
+
+          // the maximum position written is in the first non-empty stripe
+          // scanning in reverse.
+          if (!empty || stripe_-- == 0) {
+            position_ = empty ? 0 : (max_pos + 1);
+            log_->update_peek_tail(start_, position_);
+            return 0;
+          }
+        }
+        if (!submit_peek_()) {
+          return -EINPROGRESS;
+        }
+        break;
     }
+  }
+}
 
-    // the position is mapped, but the target object doesn't exist / hasn't been
-    // initialized. in this case we _could_ choose to not initialize it and
-    // report that the position hasn't been written. initializing here means we
-    // can avoid explaining how the behavior is correct, and unifies handling
-    // with the other operations which will make future restructing of the async
-    // handling easier. in the end, this is unlikely to be an optimization that
-    // matters at all since newly created stripes are initialized in the
-    // background (future work).
-    if (ret == -ENOENT) {
-      int ret = log_->backend->Seal(*oid, view->epoch());
-      if (ret && ret != -ESPIPE) {
-        return ret;
+int LogImpl::PeekTail(uint64_t max_staleness_us, uint64_t *position_out)
+{
+  if (cached_peek_tail(max_staleness_us, position_out)) {
+    return 0;
+  }
+
+  struct {
+    int ret;
+    bool done = false;
+    uint64_t position;
+    std::mutex lock;
+    std::condition_variable cond;
+  } ctx;
+
+  int ret = peekTailAsync(max_staleness_us, [&](int ret, uint64_t position) {
+    {
+      std::lock_guard<std::mutex> lk(ctx.lock);
+      ctx.ret = ret;
+      ctx.done = true;
+      if (!ctx.ret) {
+        ctx.position = position;
       }
-      continue;
+      ctx.cond.notify_one();
     }
+  });
 
+  if (ret) {
     return ret;
   }
+
+  std::unique_lock<std::mutex> lk(ctx.lock);
+  ctx.cond.wait(lk, [&] { return ctx.done; });
+
+  if (!ctx.ret) {
+    *position_out = ctx.position;
+  }
+
+  return ctx.ret;
+}
+
+int LogImpl::peekTailAsync(uint64_t max_staleness_us,
+    std::function<void(int, uint64_t)> cb)
+{
+  auto op = std::unique_ptr<LogOp>(new PeekTailOp(this, max_staleness_us, cb));
+  queue_op(std::move(op));
+  return 0;
+}
+
+int ReadOp::run()
+{
+  while (true) {
+    switch (state_) {
+      case State::Cache:
+#ifdef WITH_CACHE
+        if (!log_->cache->get(&position_, &data_)) {
+          return 0;
+        }
+#endif
+        state_ = State::Map;
+        break;
+
+      case State::Map:
+        {
+          view_ = log_->striper.read_view();
+          const auto oid = log_->striper.map(*view_, position_);
+          if (!oid) {
+            int ret = expand_view(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          view_->object_map.oid(*oid, &oid_);
+        }
+        state_ = State::Read;
+        if (!submit([this](std::function<void(int)> cb) {
+          return log_->backend->ReadAsync(oid_, view_->epoch(), position_,
+              &data_, cb);
+        })) {
+          return -EINPROGRESS;
+        }
+        break;
+
+      case State::Read:
+        if (backend_ret_ == -ESPIPE) {
+          state_ = State::Map;
+          if (!wait_for_view(&view_)) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
+
+        if (backend_ret_ == -ERANGE) {
+          return -ENOENT;
+        }
+
+        // the position is mapped, but the target object doesn't exist / hasn't
+        // been initialized. in this case we _could_ choose to not initialize it
+        // and report that the position hasn't been written. initializing here
+        // means we can avoid explaining how the behavior is correct, and unifies
+        // handling with the other operations. in the end, this is unlikely to be
+        // an optimization that matters at all since newly created stripes are
+        // initialized in the background.
+        if (backend_ret_ == -ENOENT) {
+          RecordTick(log_->options.statistics, STRIPER_SYNC_INIT);
+          state_ = State::Init;
+          if (!submit([this](std::function<void(int)> cb) {
+            return log_->backend->InitObjectAsync(oid_, view_->epoch(), cb);
+          })) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
+
+#ifdef WITH_CACHE
+        if (!backend_ret_) {
+          log_->cache->put(position_, data_);
+        }
+#endif
+
+        return backend_ret_;
+
+      case State::Init:
+        if (backend_ret_) {
+          return backend_ret_;
+        }
+        state_ = State::Map;
+        break;
+    }
+  }
 }
 
 int LogImpl::Read(const uint64_t position, std::string *data_out)
@@ -208,80 +420,125 @@ int LogImpl::readAsync(uint64_t position,
   return 0;
 }
 
+bool AppendOp::submit_write_()
+{
+  state_ = State::Write;
+  return submit([this](std::function<void(int)> cb) {
+    return log_->backend->WriteAsync(oid_, data_, view_->epoch(), position_,
+        cb);
+  });
+}
+
 int AppendOp::run()
 {
   while (true) {
-    const auto view = log_->striper.view();
-
-    if (view->seq) {
-      // avoid obtaining a new append position when the view has been updated
-      // (e.g. because the mapping was extended), but the sequencer did not
-      // change. this is generally a minor optimization. but for completeness,
-      // it also handles the edge case in which stripes are configured to hold
-      // exactly one log entry. in this case a loop will be created by which the
-      // new position doesn't map, the map is extended, and then a new unmapped
-      // position is obtained.
-      if (!position_epoch_ || (*position_epoch_ != view->seq->epoch())) {
-        position_ = view->seq->check_tail(true);
-        position_epoch_ = view->seq->epoch();
-      }
-      assert(position_epoch_);
-      assert(*position_epoch_ > 0);
-      assert(*position_epoch_ == view->seq->epoch());
-    } else {
-      int ret = log_->striper.propose_sequencer();
-      if (ret) {
-        return ret;
-      }
-      continue;
-    }
+    switch (state_) {
+      case State::Map:
+        view_ = log_->striper.read_view();
+
+        if (view_->seq) {
+          // avoid obtaining a new append position when the view has been
+          // updated (e.g. because the mapping was extended), but the sequencer
+          // did not change. this is generally a minor optimization. but for
+          // completeness, it also handles the edge case in which stripes are
+          // configured to hold exactly one log entry. in this case a loop will
+          // be created by which the new position doesn't map, the map is
+          // extended, and then a new unmapped position is obtained.
+          if (!position_epoch_ || (*position_epoch_ != view_->seq->epoch())) {
+            position_ = view_->seq->check_tail(true);
+            position_epoch_ = view_->seq->epoch();
+          }
+          assert(position_epoch_);
+          assert(*position_epoch_ > 0);
+          assert(*position_epoch_ == view_->seq->epoch());
+        } else if (view_->remote_seq()) {
+          const auto seq_epoch = view_->seq_config->epoch;
+          if (!position_epoch_ || (*position_epoch_ != seq_epoch)) {
+            int ret = seqr_next(&view_, true, 1, &position_);
+            if (ret == -EAGAIN) {
+              continue;
+            } else if (ret) {
+              return ret;
+            }
+            position_epoch_ = seq_epoch;
+          }
+        } else {
+          int ret = log_->striper.propose_sequencer();
+          if (ret) {
+            return ret;
+          }
+          continue;
+        }
 
-    const auto oid = log_->striper.map(view, position_);
-    if (!oid) {
-      int ret = log_->striper.try_expand_view(position_);
-      if (ret) {
-        return ret;
-      }
-      continue;
-    }
+        {
+          const auto oid = log_->striper.map(*view_, position_);
+          if (!oid) {
+            int ret = expand_view(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          if (!view_->seq_limit_covers(position_)) {
+            int ret = raise_seq_limit(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          view_->object_map.oid(*oid, &oid_);
+        }
 
-    while (true) {
-      int ret = log_->backend->Write(*oid, data_, view->epoch(), position_);
-      if (!ret) {
-        return ret;
-      } else if (ret == -ENOENT) {
-        // this can happen if a new stripe has been created but not initialized,
-        // either because we are racing with initialization, or due to a fault in
-        // the process performing the initialization.
-        int ret = log_->backend->Seal(*oid, view->epoch());
-        if (!ret) {
-          // try the append again. the view and the position are still
-          // consistent, and there is no reason to think they are out-of-date.
-          continue;
-        } else if (ret != -ESPIPE) {
-          return ret;
-        }
-        assert(ret == -ESPIPE);
-        // unlike other backend interfaces, seal will return -ESPIPE if the
-        // epoch is less than _or equal_ to the stored epoch. if the write
-        // returned -ENOENT at epoch 100 because it was racing with
-        // initialization (also at epoch 100), then seal at epoch 100 will
-        // return -ESPIPE. the point is that when -ESPIPE is returned from seal
-        // we shouldn't refresh the striper and wait on a newer epoch. if there
-        // actually is a newer view, then that will be caught by the write
-        // interface. XXX: this would be a fantastic scenario to test for in a
-        // model, by incorrectly refreshing here causing a deadlock, or perhaps
-        // changing the epoch <= test in the backend.
-        break;
-      } else if (ret == -ESPIPE) {
-        log_->striper.update_current_view(view->epoch());
+        if (!submit_write_()) {
+          return -EINPROGRESS;
+        }
         break;
-      } else if (ret == -EROFS) {
-        position_epoch_.reset(); // make sure to get a new position
+
+      case State::Write:
+        if (!backend_ret_) {
+#ifdef WITH_CACHE
+          log_->cache->put(position_, data_);
+#endif
+          return 0;
+        } else if (backend_ret_ == -ENOENT) {
+          // this can happen if a new stripe has been created but not
+          // initialized, either because we are racing with initialization, or
+          // due to a fault in the process performing the initialization.
+          RecordTick(log_->options.statistics, STRIPER_SYNC_INIT);
+          state_ = State::Init;
+          if (!submit([this](std::function<void(int)> cb) {
+            return log_->backend->InitObjectAsync(oid_, view_->epoch(), cb);
+          })) {
+            return -EINPROGRESS;
+          }
+          break;
+        } else if (backend_ret_ == -ESPIPE) {
+          state_ = State::Map;
+          if (!wait_for_view(&view_)) {
+            return -EINPROGRESS;
+          }
+          break;
+        } else if (backend_ret_ == -EROFS) {
+          position_epoch_.reset(); // make sure to get a new position
+          state_ = State::Map;
+          break;
+        } else {
+          return backend_ret_;
+        }
+
+      case State::Init:
+        if (backend_ret_) {
+          return backend_ret_;
+        }
+        // try the append again. the view and the position are still
+        // consistent, and there is no reason to think they are out-of-date.
+        // initialization doesn't change the epoch of an object that was
+        // created concurrently, so if there actually is a newer view, then
+        // that will be caught by the write interface.
+        if (!submit_write_()) {
+          return -EINPROGRESS;
+        }
         break;
-      } else {
-        return ret;
-      }
     }
   }
 }
@@ -330,36 +587,315 @@ int LogImpl::appendAsync(const std::string& data,
   return 0;
 }
 
-int FillOp::run()
+// assign positions to entries that need one, and map each pending entry to
+// its target object. returns 0 when every entry in todo_ has been mapped,
+// -EINPROGRESS if the op is waiting on the sequencer service, and otherwise the
+// op should be restarted after the view has been updated.
+int AppendBatchOp::map_()
 {
-  while (true) {
-    const auto view = log_->striper.view();
-    const auto oid = log_->striper.map(view, position_);
-    if (!oid) {
-      int ret = log_->striper.try_expand_view(position_);
+  const auto& seq = view_->seq;
+  assert(seq || view_->remote_seq());
+  const auto seq_epoch = seq ? seq->epoch() : view_->seq_config->epoch;
+
+  // reserve a contiguous range for entries without a valid position. this is
+  // the whole batch on the first pass, and afterwards only entries that lost
+  // their position to a fill or a sequencer change.
+  uint64_t count = 0;
+  for (auto i : todo_) {
+    if (!position_epochs_[i] || *position_epochs_[i] != seq_epoch) {
+      count++;
+    }
+  }
+
+  if (count) {
+    uint64_t next;
+    if (seq) {
+      next = seq->reserve(count);
+    } else {
+      int ret = seqr_next(&view_, true, count, &next);
       if (ret) {
         return ret;
       }
-      continue;
     }
+    for (auto i : todo_) {
+      if (!position_epochs_[i] || *position_epochs_[i] != seq_epoch) {
+        positions_[i] = next++;
+        position_epochs_[i] = seq_epoch;
+      }
+    }
+  }
 
-    int ret = log_->backend->Fill(*oid, view->epoch(), position_);
+  // group the entries by target object, so that each object receives a
+  // single multi-entry write.
+  std::map<ObjectId, size_t> group_index;
+  groups_.clear();
+  for (auto i : todo_) {
+    const auto oid = log_->striper.map(*view_, positions_[i]);
+    if (!oid) {
+      int ret = expand_view(&view_, positions_[i]);
+      return ret ? ret : -EAGAIN;
+    }
+    if (!view_->seq_limit_covers(positions_[i])) {
+      uint64_t max_position = 0;
+      for (auto j : todo_) {
+        max_position = std::max(max_position, positions_[j]);
+      }
+      int ret = raise_seq_limit(&view_, max_position);
+      return ret ? ret : -EAGAIN;
+    }
+    auto it = group_index.emplace(*oid, groups_.size());
+    if (it.second) {
+      groups_.emplace_back();
+      groups_.back().oid = view_->object_map.oid(*oid);
+    }
+    auto& group = groups_[it.first->second];
+    group.entries.push_back(i);
+    group.batch.emplace_back(positions_[i], data_[i]);
+  }
 
-    if (ret == -ESPIPE) {
-      log_->striper.update_current_view(view->epoch());
-      continue;
+  return 0;
+}
+
+int AppendBatchOp::run()
+{
+  while (true) {
+    switch (state_) {
+      case State::Map:
+        if (todo_.empty()) {
+          return 0;
+        }
+
+        view_ = log_->striper.read_view();
+        if (!view_->seq && !view_->remote_seq()) {
+          int ret = log_->striper.propose_sequencer();
+          if (ret) {
+            return ret;
+          }
+          continue;
+        }
+
+        {
+          int ret = map_();
+          if (ret == -EAGAIN) {
+            continue;
+          } else if (ret) {
+            return ret;
+          }
+        }
+
+        state_ = State::Write;
+        if (!submit_many(groups_.size(), &rets_,
+              [this](size_t i, std::function<void(int)> cb) {
+          auto& group = groups_[i];
+          return log_->backend->WriteManyAsync(group.oid, view_->epoch(),
+              group.batch, &group.results, cb);
+        })) {
+          return -EINPROGRESS;
+        }
+        break;
+
+      case State::Write:
+        {
+          bool refresh = false;
+          todo_.clear();
+          init_oids_.clear();
+          for (size_t i = 0; i < groups_.size(); i++) {
+            const auto& group = groups_[i];
+            const auto ret = rets_[i];
+            if (ret == -ENOENT) {
+              init_oids_.push_back(group.oid);
+            } else if (ret == -ESPIPE) {
+              refresh = true;
+            } else if (ret) {
+              return ret;
+            }
+
+            if (ret) {
+              todo_.insert(todo_.end(), group.entries.begin(),
+                  group.entries.end());
+              continue;
+            }
+
+            assert(group.results.size() == group.entries.size());
+            for (size_t j = 0; j < group.entries.size(); j++) {
+              const auto entry = group.entries[j];
+              const auto ret = group.results[j];
+              if (!ret) {
+#ifdef WITH_CACHE
+                log_->cache->put(positions_[entry], data_[entry]);
+#endif
+                continue;
+              } else if (ret == -EROFS) {
+                // make sure to get a new position
+                position_epochs_[entry].reset();
+              } else if (ret == -ESPIPE) {
+                refresh = true;
+              } else if (ret == -ENOENT) {
+                if (init_oids_.empty() || init_oids_.back() != group.oid) {
+                  init_oids_.push_back(group.oid);
+                }
+              } else {
+                return ret;
+              }
+              todo_.push_back(entry);
+            }
+          }
+
+          refresh_view_ = refresh;
+
+          if (!init_oids_.empty()) {
+            RecordTick(log_->options.statistics, STRIPER_SYNC_INIT,
+                init_oids_.size());
+            state_ = State::Init;
+            if (!submit_many(init_oids_.size(), &rets_,
+                  [this](size_t i, std::function<void(int)> cb) {
+              return log_->backend->InitObjectAsync(init_oids_[i],
+                  view_->epoch(), cb);
+            })) {
+              return -EINPROGRESS;
+            }
+            break;
+          }
+
+          std::sort(todo_.begin(), todo_.end());
+          state_ = State::Map;
+          if (refresh_view_ && !wait_for_view(&view_)) {
+            return -EINPROGRESS;
+          }
+        }
+        break;
+
+      case State::Init:
+        for (auto ret : rets_) {
+          if (ret) {
+            return ret;
+          }
+        }
+        std::sort(todo_.begin(), todo_.end());
+        state_ = State::Map;
+        if (refresh_view_ && !wait_for_view(&view_)) {
+          return -EINPROGRESS;
+        }
+        break;
     }
+  }
+}
 
-    if (ret == -ENOENT) {
-      int ret = log_->backend->Seal(*oid, view->epoch());
-      if (ret && ret != -ESPIPE) {
-        return ret;
+int LogImpl::AppendBatch(const std::vector<std::string>& data,
+    std::vector<uint64_t> *positions)
+{
+  struct {
+    int ret;
+    bool done = false;
+    std::vector<uint64_t> positions;
+    std::mutex lock;
+    std::condition_variable cond;
+  } ctx;
+
+  int ret = appendBatchAsync(data, [&](int ret,
+        std::vector<uint64_t>& positions) {
+    {
+      std::lock_guard<std::mutex> lk(ctx.lock);
+      ctx.ret = ret;
+      ctx.done = true;
+      if (!ctx.ret) {
+        ctx.positions.swap(positions);
       }
-      continue;
+      ctx.cond.notify_one();
     }
+  });
 
+  if (ret) {
     return ret;
   }
+
+  std::unique_lock<std::mutex> lk(ctx.lock);
+  ctx.cond.wait(lk, [&] { return ctx.done; });
+
+  if (!ctx.ret && positions) {
+    positions->swap(ctx.positions);
+  }
+
+  return ctx.ret;
+}
+
+int LogImpl::appendBatchAsync(const std::vector<std::string>& data,
+    std::function<void(int, std::vector<uint64_t>&)> cb)
+{
+  auto op = std::unique_ptr<LogOp>(new AppendBatchOp(this, data, cb));
+  queue_op(std::move(op));
+  return 0;
+}
+
+int FillOp::run()
+{
+  while (true) {
+    switch (state_) {
+      case State::Map:
+        {
+          view_ = log_->striper.read_view();
+          const auto oid = log_->striper.map(*view_, position_);
+          if (!oid) {
+            int ret = expand_view(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          if (!view_->seq_limit_covers(position_)) {
+            int ret = raise_seq_limit(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          view_->object_map.oid(*oid, &oid_);
+        }
+        state_ = State::Fill;
+        if (!submit([this](std::function<void(int)> cb) {
+          return log_->backend->FillAsync(oid_, view_->epoch(), position_, cb);
+        })) {
+          return -EINPROGRESS;
+        }
+        break;
+
+      case State::Fill:
+        if (backend_ret_ == -ESPIPE) {
+          state_ = State::Map;
+          if (!wait_for_view(&view_)) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
+
+        if (backend_ret_ == -ENOENT) {
+          RecordTick(log_->options.statistics, STRIPER_SYNC_INIT);
+          state_ = State::Init;
+          if (!submit([this](std::function<void(int)> cb) {
+            return log_->backend->InitObjectAsync(oid_, view_->epoch(), cb);
+          })) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
+
+#ifdef WITH_CACHE
+        // a fill may succeed on a trimmed position
+        if (!backend_ret_) {
+          log_->cache->remove(&position_);
+        }
+#endif
+
+        return backend_ret_;
+
+      case State::Init:
+        if (backend_ret_) {
+          return backend_ret_;
+        }
+        state_ = State::Map;
+        break;
+    }
+  }
 }
 
 int LogImpl::Fill(const uint64_t position)
@@ -400,32 +936,70 @@ int LogImpl::fillAsync(uint64_t position, std::function<void(int)> cb)
 int TrimOp::run()
 {
   while (true) {
-    const auto view = log_->striper.view();
-    const auto oid = log_->striper.map(view, position_);
-    if (!oid) {
-      int ret = log_->striper.try_expand_view(position_);
-      if (ret) {
-        return ret;
-      }
-      continue;
-    }
+    switch (state_) {
+      case State::Map:
+        {
+          view_ = log_->striper.read_view();
+          const auto oid = log_->striper.map(*view_, position_);
+          if (!oid) {
+            int ret = expand_view(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          if (!view_->seq_limit_covers(position_)) {
+            int ret = raise_seq_limit(&view_, position_);
+            if (ret) {
+              return ret;
+            }
+            continue;
+          }
+          view_->object_map.oid(*oid, &oid_);
+        }
+        state_ = State::Trim;
+        if (!submit([this](std::function<void(int)> cb) {
+          return log_->backend->TrimAsync(oid_, view_->epoch(), position_, cb);
+        })) {
+          return -EINPROGRESS;
+        }
+        break;
 
-    int ret = log_->backend->Trim(*oid, view->epoch(), position_);
+      case State::Trim:
+        if (backend_ret_ == -ESPIPE) {
+          state_ = State::Map;
+          if (!wait_for_view(&view_)) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
 
-    if (ret == -ESPIPE) {
-      log_->striper.update_current_view(view->epoch());
-      continue;
-    }
+        if (backend_ret_ == -ENOENT) {
+          RecordTick(log_->options.statistics, STRIPER_SYNC_INIT);
+          state_ = State::Init;
+          if (!submit([this](std::function<void(int)> cb) {
+            return log_->backend->InitObjectAsync(oid_, view_->epoch(), cb);
+          })) {
+            return -EINPROGRESS;
+          }
+          break;
+        }
 
-    if (ret == -ENOENT) {
-      int ret = log_->backend->Seal(*oid, view->epoch());
-      if (ret && ret != -ESPIPE) {
-        return ret;
-      }
-      continue;
-    }
+#ifdef WITH_CACHE
+        if (!backend_ret_) {
+          log_->cache->remove(&position_);
+        }
+#endif
 
-    return ret;
+        return backend_ret_;
+
+      case State::Init:
+        if (backend_ret_) {
+          return backend_ret_;
+        }
+        state_ = State::Map;
+        break;
+    }
   }
 }
 
@@ -464,65 +1038,273 @@ int LogImpl::trimAsync(uint64_t position, std::function<void(int)> cb)
   return 0;
 }
 
-void LogImpl::queue_op(std::unique_ptr<LogOp> op)
+bool LogImpl::try_reserve_inflight_op_()
+{
+  auto inflight = num_inflight_ops_.load();
+  while (inflight < options.max_inflight_ops) {
+    if (num_inflight_ops_.compare_exchange_weak(inflight, inflight + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int LogImpl::seqr_check_tail(const View& view, bool increment,
+    uint64_t count, uint64_t *position, std::function<void(int)> cb)
+{
+  assert(view.remote_seq());
+  const auto& address = view.seq_config->address;
+
+  // a replaced client is destroyed after the lock is released
+  std::shared_ptr<SeqrClient> old_client;
+  std::shared_ptr<SeqrClient> client;
+  {
+    std::lock_guard<std::mutex> lk(seqr_lock_);
+    // a client that has failed is replaced to reconnect
+    if (!seqr_client_ || seqr_client_address_ != address ||
+        seqr_client_->failed()) {
+      const auto sep = address.rfind(':');
+      if (sep == std::string::npos) {
+        return -EINVAL;
+      }
+      // the connection is made in the background, so that a slow or dead
+      // service doesn't block the executor. requests wait for the connection,
+      // or fail with the connect error.
+      auto c = std::make_shared<SeqrClient>(address.substr(0, sep),
+          address.substr(sep + 1), 2, 4, options.seqr_timeout_ms);
+      c->ConnectAsync();
+      old_client.swap(seqr_client_);
+      seqr_client_ = c;
+      seqr_client_address_ = address;
+    }
+    client = seqr_client_;
+  }
+
+  client->CheckTailAsync(view.seq_config->epoch, name, increment, count,
+      [position, cb](int ret, uint64_t pos) {
+    if (!ret) {
+      *position = pos;
+    }
+    cb(ret);
+  });
+
+  return 0;
+}
+
+void LogImpl::seqr_run_after(uint32_t delay_ms, std::function<void()> fn)
 {
-  std::unique_lock<std::mutex> lk(lock);
+  std::shared_ptr<SeqrClient> client;
+  {
+    std::lock_guard<std::mutex> lk(seqr_lock_);
+    client = seqr_client_;
+  }
+
+  if (!client) {
+    fn();
+    return;
+  }
+
+  client->RunAfter(std::chrono::milliseconds(delay_ms), std::move(fn));
+}
+
+void LogImpl::release_inflight_op_()
+{
+  // the decrement must be ordered before reading the waiter count. a waiter
+  // registers itself before re-checking the inflight count, so either it sees
+  // the free slot, or we see the waiter and wake it up.
+  const auto inflight = num_inflight_ops_.fetch_sub(1);
+  assert(inflight > 0);
+
+  // the last op to complete after shutdown releases the destructor
+  if (inflight == 1 && shutdown) {
+    std::lock_guard<std::mutex> lk(shutdown_lock_);
+    shutdown_cond_.notify_all();
+  }
 
-  if (num_inflight_ops_ >= options.max_inflight_ops) {
+  if (num_queue_op_waiters_.load() > 0) {
+    std::lock_guard<std::mutex> lk(lock);
+    if (!queue_op_waiters_.empty()) {
+      queue_op_waiters_.back().first = true;
+      queue_op_waiters_.back().second->notify_one();
+    }
+  }
+}
+
+void LogImpl::queue_op(std::unique_ptr<LogOp> op)
+{
+  // slow path: max_inflight_ops has been reached. waiters are queued in fifo
+  // order, and woken one at a time as ops complete. a woken waiter may still
+  // lose the race for the free slot to a new fast path caller, in which case
+  // it simply waits again.
+  while (!try_reserve_inflight_op_()) {
+    std::unique_lock<std::mutex> lk(lock);
+    num_queue_op_waiters_++;
     std::condition_variable cond;
     queue_op_waiters_.emplace_front(false, &cond);
     auto it = queue_op_waiters_.begin();
     cond.wait(lk, [&] {
       assert(it->second == &cond);
-      return it->first;
+      return it->first ||
+        num_inflight_ops_.load() < options.max_inflight_ops;
     });
     queue_op_waiters_.erase(it);
+    num_queue_op_waiters_--;
   }
 
-  num_inflight_ops_++;
+  requeue_op(op.release());
+}
 
-  pending_ops_.emplace_back(std::move(op));
-  finishers_cond_.notify_all();
+bool LogOp::wait_for_view(ViewRef *view)
+{
+  const auto epoch = (*view)->epoch();
+  view->reset();
+  return log_->striper.update_current_view_async(epoch, [this] {
+    log_->requeue_op(this);
+  });
 }
 
-void LogImpl::finisher_entry_()
+int LogOp::expand_view(ViewRef *view, uint64_t position)
 {
-  while (true) {
-    bool do_shutdown = false;
-    std::unique_ptr<LogOp> op;
-    {
-      std::unique_lock<std::mutex> lk(lock);
-      finishers_cond_.wait(lk, [&] {
-        return !pending_ops_.empty() || shutdown;
-      });
+  view->reset();
+  if (view_update_ret_) {
+    const int ret = view_update_ret_;
+    view_update_ret_ = 0;
+    return ret;
+  }
+  if (log_->striper.try_expand_view_async(position, [this](int ret) {
+    view_update_ret_ = ret;
+    log_->requeue_op(this);
+  })) {
+    return 0;
+  }
+  return -EINPROGRESS;
+}
 
-      if (shutdown) {
-        if (pending_ops_.empty()) {
-          break;
-        }
-        do_shutdown = true;
-      }
+int LogOp::raise_seq_limit(ViewRef *view, uint64_t position)
+{
+  // the op may run again as soon as it is parked, so the view is moved out of
+  // the op first.
+  const ViewRef v(std::move(*view));
+  if (view_update_ret_) {
+    const int ret = view_update_ret_;
+    view_update_ret_ = 0;
+    return ret;
+  }
+  if (log_->striper.raise_seq_limit_async(*v, position, [this](int ret) {
+    view_update_ret_ = ret;
+    log_->requeue_op(this);
+  })) {
+    return 0;
+  }
+  return -EINPROGRESS;
+}
 
-      assert(!pending_ops_.empty());
-      op = std::move(pending_ops_.front());
-      pending_ops_.pop_front();
-    }
+// the longest delay between retries of a request that the sequencer service
+// wasn't ready for
+static const uint32_t max_seqr_backoff_ms = 64;
 
-    if (do_shutdown) {
-      op->callback(-ESHUTDOWN);
-    } else {
-      int ret = op->run();
-      op->callback(ret);
+int LogOp::seqr_next(ViewRef *view, bool increment, uint64_t count,
+    uint64_t *position)
+{
+  // issue the request, unless the op is running again with the reply. a reply
+  // to a request made for a different sequencer, which happens when the view
+  // changed while waiting, is dropped, and any positions that it reserved
+  // become holes.
+  const auto seq_epoch = (*view)->seq_config->epoch;
+  if (!seqr_issued_ || seqr_epoch_ != seq_epoch ||
+      seqr_increment_ != increment || seqr_count_ != count) {
+    seqr_issued_ = true;
+    seqr_epoch_ = seq_epoch;
+    seqr_increment_ = increment;
+    seqr_count_ = count;
+    if (!submit([&](std::function<void(int)> cb) {
+      return log_->seqr_check_tail(**view, increment, count, &seqr_position_,
+          cb);
+    })) {
+      return -EINPROGRESS;
     }
+  }
+  seqr_issued_ = false;
+
+  int ret = backend_ret_;
+  if (ret == -ERANGE) {
+    // the service has become the sequencer in a newer view
+    return wait_for_view(view) ? -EAGAIN : -EINPROGRESS;
+  } else if (ret == -EAGAIN) {
+    // the service is still taking over as the sequencer. a newer view isn't
+    // guaranteed to follow, so the request is retried, but after a delay so
+    // that waiting ops don't keep the executor and the service busy.
+    view->reset();
+    seqr_backoff_ms_ = std::min(std::max(2 * seqr_backoff_ms_, 1U),
+        max_seqr_backoff_ms);
+    log_->seqr_run_after(seqr_backoff_ms_, [this] {
+      log_->requeue_op(this);
+    });
+    return -EINPROGRESS;
+  } else if (ret) {
+    // the service can't be reached, or stopped answering. taking over is safe
+    // because the old stripes are sealed, and it keeps the log available while
+    // the service is down. the caller starts over with the new view.
+    view->reset();
+    seqr_backoff_ms_ = 0;
+    ret = log_->striper.propose_sequencer();
+    return ret ? ret : -EAGAIN;
+  }
 
-    std::lock_guard<std::mutex> lk(lock);
-    assert(num_inflight_ops_ > 0);
-    num_inflight_ops_--;
-    if (!queue_op_waiters_.empty()) {
-      queue_op_waiters_.back().first = true;
-      queue_op_waiters_.back().second->notify_one();
+  seqr_backoff_ms_ = 0;
+  *position = seqr_position_;
+  return 0;
+}
+
+void LogOp::complete_(int *result, int ret)
+{
+  *result = ret;
+  if (pending_.fetch_sub(1) == 1) {
+    log_->requeue_op(this);
+  }
+}
+
+void LogImpl::requeue_op(LogOp *op)
+{
+  // admission control bounds the number of queued ops by the queue capacity.
+  // an admitted op is in the queue at most once, including when it is
+  // requeued after an asynchronous backend call completes.
+  bool queued = pending_ops_.try_push(op);
+  assert(queued);
+  (void)queued;
+
+  ops_queue_.notify();
+}
+
+void LogImpl::run_op_()
+{
+  // an op is announced after it is pushed, but a pop can briefly miss it while
+  // a concurrent push to an earlier slot is finishing.
+  LogOp *next_op = nullptr;
+  while (!pending_ops_.try_pop(&next_op)) {
+    std::this_thread::yield();
+  }
+
+  std::unique_ptr<LogOp> op(next_op);
+
+  // ops that haven't started are cancelled on shutdown. ops that have
+  // started are run to completion.
+  int ret;
+  if (shutdown && !op->started_) {
+    ret = -ESHUTDOWN;
+  } else {
+    op->started_ = true;
+    ret = op->run();
+    if (ret == -EINPROGRESS) {
+      op.release();
+      return;
     }
   }
+
+  op->callback(ret);
+  op.reset();
+
+  release_inflight_op_();
 }
 
 }
@@ -1,14 +1,21 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <list>
 #include <mutex>
+#include <numeric>
 #include <thread>
+#include <vector>
 
 #include "include/zlog/log.h"
 #include "include/zlog/statistics.h"
 #include "libseq/libseqr.h"
 #include "include/zlog/backend.h"
+#include "include/zlog/cache.h"
+#include "executor.h"
 #include "striper.h"
+#include "util/mpmc_queue.h"
 
 #define DEFAULT_STRIPE_SIZE 100
 
@@ -17,10 +24,21 @@ namespace zlog {
 typedef Backend *(*backend_allocate_t)(void);
 typedef void (*backend_release_t)(Backend*);
 
+// Operations are state machines driven by the executor threads. Each call to
+// run() advances the op until it either completes, in which case the result is
+// returned, or it is waiting on an asynchronous backend call, in which case
+// -EINPROGRESS is returned. A waiting op is owned by the pending backend call
+// and is requeued when the call completes, at which point run() is invoked
+// again to pick up where it left off. Requeued ops were already admitted, so
+// they bypass admission control in queue_op.
 class LogOp {
  public:
   LogOp(LogImpl *log) :
-    log_(log)
+    log_(log),
+    seqr_issued_(false),
+    seqr_backoff_ms_(0),
+    view_update_ret_(0),
+    started_(false)
   {}
 
   virtual ~LogOp() {}
@@ -28,7 +46,101 @@ class LogOp {
   virtual void callback(int ret) = 0;
 
  protected:
+  // issue an asynchronous backend call. `issue` is passed the completion
+  // callback and returns the backend submission result. true is returned if
+  // the result is already available in backend_ret_, either because submission
+  // failed or because the backend completed the call before returning, and the
+  // caller should continue running the op. otherwise the op will be requeued on
+  // completion, and the caller must return -EINPROGRESS without touching the
+  // op again.
+  template<typename F>
+  bool submit(F issue) {
+    // the issuer and the completion each drop a reference. whoever drops the
+    // last one continues the op.
+    pending_ = 2;
+    int ret = issue(std::function<void(int)>([this](int ret) {
+      complete_(&backend_ret_, ret);
+    }));
+    if (ret) {
+      backend_ret_ = ret;
+      return true;
+    }
+    return pending_.fetch_sub(1) == 1;
+  }
+
+  // issue `count` asynchronous backend calls as a single wave. call i is
+  // issued by issue(i, cb) and its result is stored in (*rets)[i]. the return
+  // value has the same meaning as submit, and applies to the whole wave.
+  template<typename F>
+  bool submit_many(size_t count, std::vector<int> *rets, F issue) {
+    rets->assign(count, 0);
+    pending_ = count + 1;
+    for (size_t i = 0; i < count; i++) {
+      int *result = &(*rets)[i];
+      int ret = issue(i, std::function<void(int)>([this, result](int ret) {
+        complete_(result, ret);
+      }));
+      if (ret) {
+        *result = ret;
+        pending_--;
+      }
+    }
+    return pending_.fetch_sub(1) == 1;
+  }
+
+  // wait for a view newer than `view`, which is released, without blocking
+  // the executor thread. true is returned if a newer view is already active,
+  // and the caller should continue running the op. otherwise the op is parked
+  // and requeued once a newer view is active, and the caller must return
+  // -EINPROGRESS without touching the op again.
+  bool wait_for_view(ViewRef *view);
+
+  // expand the view to map the position, or raise the limit of the view's
+  // sequencer above the position, without blocking the executor thread. the
+  // view is released. 0 is returned if the caller should continue with the
+  // current view, and -EINPROGRESS if the op is parked until the update has
+  // finished, in which case the caller must return -EINPROGRESS without
+  // touching the op again. the op then runs again and starts over with the
+  // new view, and the error of a failed update is returned by the next call.
+  int expand_view(ViewRef *view, uint64_t position);
+  int raise_seq_limit(ViewRef *view, uint64_t position);
+
+  // request positions from the sequencer service named by the view, with the
+  // same meaning as SeqrClient::CheckTail. if the service can't be reached
+  // this instance takes over as the sequencer. -EAGAIN is returned if a newer
+  // view is active and the caller should start over with the new view, and
+  // -EINPROGRESS if the op is waiting for the reply, or has been parked or
+  // requeued until it can try again, in which case the caller must return
+  // -EINPROGRESS without touching the op again. once the reply arrives the op
+  // runs again, and the next call with the same arguments returns it.
+  int seqr_next(ViewRef *view, bool increment, uint64_t count,
+      uint64_t *position);
+
   LogImpl *log_;
+  int backend_ret_;
+
+  // the request issued by seqr_next, whose reply is held in backend_ret_ and
+  // seqr_position_ until the op runs again.
+  bool seqr_issued_;
+  uint64_t seqr_epoch_;
+  bool seqr_increment_;
+  uint64_t seqr_count_;
+  uint64_t seqr_position_;
+
+  // delay before retrying a request that the service wasn't ready for. it
+  // doubles on each retry, up to a limit, until the service replies.
+  uint32_t seqr_backoff_ms_;
+
+  // result of the view update that a parked op waited for
+  int view_update_ret_;
+
+ private:
+  friend class LogImpl;
+
+  void complete_(int *result, int ret);
+
+  bool started_;
+  std::atomic<int> pending_;
 };
 
 class TailOp : public LogOp {
@@ -53,12 +165,60 @@ class TailOp : public LogOp {
   std::function<void(int, uint64_t)> cb_;
 };
 
+// read-only tail query. the max position of each object in the last non-empty
+// stripe is read in parallel, without sealing.
+class PeekTailOp : public LogOp {
+ public:
+  PeekTailOp(LogImpl *log, uint64_t max_staleness_us,
+      std::function<void(int, uint64_t)> cb) :
+    LogOp(log),
+    max_staleness_us_(max_staleness_us),
+    cb_(cb),
+    state_(State::Start)
+  {}
+
+  int run() override;
+
+  void callback(int ret) override {
+    if (cb_) {
+      cb_(ret, position_);
+    }
+  }
+
+ private:
+  enum class State { Start, Refresh, Peek };
+
+  bool submit_peek_();
+
+  uint64_t max_staleness_us_;
+  uint64_t position_;
+  std::function<void(int, uint64_t)> cb_;
+
+  State state_;
+  ViewRef view_;
+  std::chrono::steady_clock::time_point start_;
+
+  // the index of the stripe being queried, scanning in reverse from the last
+  // stripe, and its objects.
+  size_t stripe_;
+  std::vector<std::string> oids_;
+
+  struct MaxPos {
+    uint64_t pos;
+    bool empty;
+  };
+
+  std::vector<MaxPos> max_pos_;
+  std::vector<int> rets_;
+};
+
 class TrimOp : public LogOp {
  public:
   TrimOp(LogImpl *log, uint64_t position, std::function<void(int)> cb) :
     LogOp(log),
     position_(position),
-    cb_(cb)
+    cb_(cb),
+    state_(State::Map)
   {}
 
   int run() override;
@@ -70,8 +230,14 @@ class TrimOp : public LogOp {
   }
 
  private:
+  enum class State { Map, Trim, Init };
+
   uint64_t position_;
   std::function<void(int)> cb_;
+
+  State state_;
+  ViewRef view_;
+  std::string oid_;
 };
 
 class FillOp : public LogOp {
@@ -79,7 +245,8 @@ class FillOp : public LogOp {
   FillOp(LogImpl *log, uint64_t position, std::function<void(int)> cb) :
     LogOp(log),
     position_(position),
-    cb_(cb)
+    cb_(cb),
+    state_(State::Map)
   {}
 
   int run() override;
@@ -91,8 +258,14 @@ class FillOp : public LogOp {
   }
 
  private:
+  enum class State { Map, Fill, Init };
+
   uint64_t position_;
   std::function<void(int)> cb_;
+
+  State state_;
+  ViewRef view_;
+  std::string oid_;
 };
 
 class ReadOp : public LogOp {
@@ -101,7 +274,8 @@ class ReadOp : public LogOp {
       std::function<void(int, std::string&)> cb) :
     LogOp(log),
     position_(position),
-    cb_(cb)
+    cb_(cb),
+    state_(State::Cache)
   {}
 
   int run() override;
@@ -113,9 +287,15 @@ class ReadOp : public LogOp {
   }
 
  private:
+  enum class State { Cache, Map, Read, Init };
+
   uint64_t position_;
   std::string data_;
   std::function<void(int, std::string&)> cb_;
+
+  State state_;
+  ViewRef view_;
+  std::string oid_;
 };
 
 // TODO: move or copy or reference for the data
@@ -126,7 +306,8 @@ class AppendOp : public LogOp {
     LogOp(log),
     data_(data.data(), data.size()),
     position_epoch_(boost::none),
-    cb_(cb)
+    cb_(cb),
+    state_(State::Map)
   {}
 
   int run() override;
@@ -138,10 +319,74 @@ class AppendOp : public LogOp {
   }
 
  private:
+  enum class State { Map, Write, Init };
+
+  bool submit_write_();
+
   std::string data_;
   uint64_t position_;
   boost::optional<uint64_t> position_epoch_;
   std::function<void(int, uint64_t)> cb_;
+
+  State state_;
+  ViewRef view_;
+  std::string oid_;
+};
+
+class AppendBatchOp : public LogOp {
+ public:
+  AppendBatchOp(LogImpl *log, const std::vector<std::string>& data,
+      std::function<void(int, std::vector<uint64_t>&)> cb) :
+    LogOp(log),
+    data_(data),
+    positions_(data.size()),
+    position_epochs_(data.size()),
+    cb_(cb),
+    state_(State::Map),
+    refresh_view_(false)
+  {
+    todo_.resize(data_.size());
+    std::iota(todo_.begin(), todo_.end(), 0);
+  }
+
+  int run() override;
+
+  void callback(int ret) override {
+    if (cb_) {
+      cb_(ret, positions_);
+    }
+  }
+
+ private:
+  enum class State { Map, Write, Init };
+
+  int map_();
+
+  std::vector<std::string> data_;
+  std::vector<uint64_t> positions_;
+  std::vector<boost::optional<uint64_t>> position_epochs_;
+  std::function<void(int, std::vector<uint64_t>&)> cb_;
+
+  State state_;
+  ViewRef view_;
+
+  // entries that haven't been written
+  std::vector<size_t> todo_;
+
+  // entries in the current wave that map to the same object, written with a
+  // single multi-entry backend call.
+  struct Group {
+    std::string oid;
+    std::vector<size_t> entries;
+    std::vector<std::pair<uint64_t, std::string>> batch;
+    std::vector<int> results;
+  };
+
+  std::vector<Group> groups_;
+  std::vector<std::string> init_oids_;
+  // a write in the last wave failed with a stale epoch
+  bool refresh_view_;
+  std::vector<int> rets_;
 };
 
 class LogImpl : public Log {
@@ -163,26 +408,64 @@ class LogImpl : public Log {
  public:
   int CheckTail(uint64_t *pposition) override;
   int CheckTail(uint64_t *pposition, bool increment);
+  int PeekTail(uint64_t max_staleness_us, uint64_t *pposition) override;
 
  public:
   int Read(uint64_t position, std::string *data) override;
   int Append(const std::string& data, uint64_t *pposition) override;
+  int AppendBatch(const std::vector<std::string>& data,
+      std::vector<uint64_t> *positions) override;
   int Fill(uint64_t position) override;
   int Trim(uint64_t position) override;
 
  public:
-  void finisher_entry_();
-  std::vector<std::thread> finishers_;
-  std::condition_variable finishers_cond_;
-  std::list<std::unique_ptr<LogOp>> pending_ops_;
+  // ops run on the executor, which runs one op from pending_ops_ for each
+  // unit of work announced on ops_queue_.
+  class OpQueue : public WorkQueue {
+   public:
+    OpQueue(LogImpl *log, ExecutorImpl *executor, uint32_t quantum) :
+      WorkQueue(executor, quantum),
+      log_(log)
+    {}
+
+   protected:
+    void run_one() override {
+      log_->run_op_();
+    }
+
+   private:
+    LogImpl * const log_;
+  };
+
+  void run_op_();
+
+  const std::shared_ptr<Executor> executor;
+  OpQueue ops_queue_;
+
+  // the destructor waits on shutdown_cond_ until admitted ops have completed
+  std::mutex shutdown_lock_;
+  std::condition_variable shutdown_cond_;
+
+  // pending ops. the queue holds owning raw pointers, and is sized to hold
+  // max_inflight_ops entries, which the admission control in queue_op
+  // guarantees is never exceeded.
+  MPMCQueue<LogOp*> pending_ops_;
   void queue_op(std::unique_ptr<LogOp> op);
+  void requeue_op(LogOp *op);
+
+  bool try_reserve_inflight_op_();
+  void release_inflight_op_();
 
   int tailAsync(bool increment, std::function<void(int, uint64_t)> cb);
   int tailAsync(std::function<void(int, uint64_t)> cb) override {
     return tailAsync(false, cb);
   }
+  int peekTailAsync(uint64_t max_staleness_us,
+      std::function<void(int, uint64_t)> cb) override;
   int appendAsync(const std::string& data,
       std::function<void(int, uint64_t position)> cb) override;
+  int appendBatchAsync(const std::vector<std::string>& data,
+      std::function<void(int, std::vector<uint64_t>&)> cb) override;
   int readAsync(uint64_t position,
       std::function<void(int, std::string&)> cb) override;
   int fillAsync(uint64_t position, std::function<void(int)> cb) override;
@@ -196,7 +479,7 @@ class LogImpl : public Log {
   }
 
  public:
-  bool shutdown;
+  std::atomic<bool> shutdown;
   std::mutex lock;
 
   // thread-safe
@@ -212,11 +495,48 @@ class LogImpl : public Log {
   uint64_t exclusive_position;
   bool exclusive_empty;
 
-  uint32_t num_inflight_ops_;
+  // number of admitted ops that haven't completed. queue_op reserves a slot
+  // with a compare-and-swap, and only falls back to taking `lock` and waiting
+  // in queue_op_waiters_ when max_inflight_ops is reached.
+  std::atomic<uint32_t> num_inflight_ops_;
+  std::atomic<uint32_t> num_queue_op_waiters_;
   std::list<std::pair<bool,
     std::condition_variable*>> queue_op_waiters_;
 
+  // request positions from the sequencer service named by the view. see
+  // SeqrClient::CheckTail. the result is passed to cb, and position is set
+  // before cb is called on success. an error is returned if the service can't
+  // be reached. the connection to the service is kept until it fails, or the
+  // view names a different service.
+  int seqr_check_tail(const View& view, bool increment, uint64_t count,
+      uint64_t *position, std::function<void(int)> cb);
+
+  // run fn after the delay on the thread of the current sequencer service
+  // client, or right away if there is no client.
+  void seqr_run_after(uint32_t delay_ms, std::function<void()> fn);
+
+  std::mutex seqr_lock_;
+  std::string seqr_client_address_;
+  std::shared_ptr<SeqrClient> seqr_client_;
+
+  // the most recent PeekTail result, and when the query that produced it was
+  // started. the cached tail only moves forward.
+  bool cached_peek_tail(uint64_t max_staleness_us, uint64_t *position);
+  void update_peek_tail(std::chrono::steady_clock::time_point start,
+      uint64_t position);
+
+  std::mutex peek_tail_lock_;
+  bool peek_tail_valid_;
+  uint64_t peek_tail_;
+  std::chrono::steady_clock::time_point peek_tail_time_;
+
   const Options options;
+
+#ifdef WITH_CACHE
+  // entries read or appended through this instance. trim and fill invalidate
+  // cached positions.
+  std::unique_ptr<Cache> cache;
+#endif
 };
 
 }
@@ -0,0 +1,191 @@
+#include "seqr_service.h"
+
+#include <cassert>
+#include <cerrno>
+#include <iostream>
+
+#include "include/zlog/log.h"
+#include "log_impl.h"
+
+namespace zlog {
+
+SeqrService::SeqrService(const Options& options) :
+  options_(options),
+  shutdown_(false)
+{
+  assert(!options_.seqr_address.empty());
+  take_over_thread_ = std::thread(&SeqrService::take_over_entry_, this);
+}
+
+SeqrService::~SeqrService()
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    shutdown_ = true;
+  }
+  pending_cond_.notify_one();
+  take_over_thread_.join();
+}
+
+int SeqrService::Serve(const std::string& name)
+{
+  return take_over_(name, 0);
+}
+
+SeqrServer::Handler SeqrService::NewSession()
+{
+  // a session's handler only runs on the session's thread
+  struct Cache {
+    std::string name;
+    LogImpl *log = nullptr;
+    std::shared_ptr<Sequencer> seq;
+  };
+  auto cache = std::make_shared<Cache>();
+
+  return [this, cache](const std::string& name, uint64_t epoch, bool next,
+      uint32_t count, uint64_t *position) {
+    // the cached sequencer is only used while it is still the log's current
+    // sequencer. once this instance is deposed, lookup_ rejects the stale
+    // epoch rather than handing out positions that writes can't use.
+    if (!cache->seq || cache->seq->epoch() != epoch || cache->name != name ||
+        cache->log->striper.read_view()->seq != cache->seq) {
+      int ret = lookup_(name, epoch, &cache->log, &cache->seq);
+      if (ret) {
+        cache->seq.reset();
+        return ret;
+      }
+      cache->name = name;
+    }
+
+    if (next) {
+      *position = cache->seq->reserve(count);
+    } else {
+      *position = cache->seq->check_tail(false);
+    }
+
+    return 0;
+  };
+}
+
+int SeqrService::lookup_(const std::string& name, uint64_t epoch,
+    LogImpl **log_out, std::shared_ptr<Sequencer> *seq_out)
+{
+  LogImpl *log;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    auto it = logs_.find(name);
+    if (it == logs_.end()) {
+      queue_take_over_(name, epoch);
+      return -EAGAIN;
+    }
+    log = it->second.get();
+  }
+
+  // logs are never closed while the service is running
+  const auto view = log->striper.read_view();
+  const auto& seq = view->seq;
+
+  // another instance has taken over, or the client has seen a sequencer that
+  // this instance doesn't know about yet.
+  if (!seq || epoch > seq->epoch()) {
+    std::lock_guard<std::mutex> lk(lock_);
+    queue_take_over_(name, epoch);
+    return -EAGAIN;
+  }
+
+  if (epoch < seq->epoch()) {
+    return -ERANGE;
+  }
+
+  *log_out = log;
+  *seq_out = seq;
+
+  return 0;
+}
+
+void SeqrService::queue_take_over_(const std::string& name, uint64_t epoch)
+{
+  auto it = pending_.emplace(name, epoch);
+  if (!it.second) {
+    it.first->second = std::max(it.first->second, epoch);
+  }
+  pending_cond_.notify_one();
+}
+
+int SeqrService::take_over_(const std::string& name, uint64_t epoch)
+{
+  LogImpl *log = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    auto it = logs_.find(name);
+    if (it != logs_.end()) {
+      log = it->second.get();
+    }
+  }
+
+  if (!log) {
+    Log *l;
+    int ret = Log::Open(options_, name, &l);
+    if (ret) {
+      return ret;
+    }
+
+    std::lock_guard<std::mutex> lk(lock_);
+    auto it = logs_.emplace(name, std::unique_ptr<LogImpl>(
+          static_cast<LogImpl*>(l)));
+    log = it.first->second.get();
+    if (!it.second) {
+      // raced with another caller opening the log
+      delete l;
+    }
+  }
+
+  while (true) {
+    const auto view = log->striper.read_view();
+    if (view->seq) {
+      if (view->seq->epoch() >= epoch) {
+        return 0;
+      }
+      // a client has seen a newer sequencer, which may have been proposed by
+      // another instance.
+      const auto view_epoch = view->epoch();
+      log->striper.update_current_view(view_epoch);
+      epoch = 0;
+      continue;
+    }
+
+    int ret = log->striper.propose_sequencer();
+    if (ret) {
+      return ret;
+    }
+  }
+}
+
+void SeqrService::take_over_entry_()
+{
+  std::unique_lock<std::mutex> lk(lock_);
+  while (true) {
+    pending_cond_.wait(lk, [&] {
+      return !pending_.empty() || shutdown_;
+    });
+
+    if (shutdown_) {
+      break;
+    }
+
+    const auto name = pending_.begin()->first;
+    const auto epoch = pending_.begin()->second;
+    pending_.erase(pending_.begin());
+    lk.unlock();
+
+    int ret = take_over_(name, epoch);
+    if (ret) {
+      std::cerr << "failed to serve log " << name << " ret " << ret
+        << std::endl;
+    }
+
+    lk.lock();
+  }
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "include/zlog/options.h"
+#include "libseq/libseqr.h"
+
+namespace zlog {
+
+class LogImpl;
+class Sequencer;
+
+// The sequencer behind zlog-seqr. A log is served by opening it and taking
+// over as its sequencer with a view that names the service address, after
+// which the other clients of the log request positions from the service
+// instead of taking over themselves.
+//
+// A request for a log that isn't being served, or for which this instance is
+// no longer the sequencer, queues the log to be taken over in the background
+// and is answered with -EAGAIN.
+//
+// Each connection caches the sequencer of the log and epoch that it last
+// asked for. A connection normally carries requests for a single log, so after
+// its first request the log is served with an atomic increment on the cached
+// sequencer, without any shared lookups or locks.
+class SeqrService {
+ public:
+  // logs are opened with the given options, and options.seqr_address must be
+  // set to the address that clients use to reach the service.
+  explicit SeqrService(const Options& options);
+
+  ~SeqrService();
+
+  SeqrService(const SeqrService&) = delete;
+  SeqrService& operator=(const SeqrService&) = delete;
+
+  // serve the log, and wait until this instance is its sequencer
+  int Serve(const std::string& name);
+
+  // SeqrServer handler factory, called for each new connection
+  SeqrServer::Handler NewSession();
+
+ private:
+  // open the log if it isn't open, and take over as its sequencer. epoch is
+  // the sequencer epoch of a client request, and if it is newer than the
+  // sequencer epoch of the current view, the view is refreshed first.
+  int take_over_(const std::string& name, uint64_t epoch);
+
+  // find the log and sequencer for a request. returns 0 when this instance is
+  // the sequencer of the log in the given epoch, and otherwise -EAGAIN or
+  // -ERANGE as described by SeqrServer.
+  int lookup_(const std::string& name, uint64_t epoch, LogImpl **log,
+      std::shared_ptr<Sequencer> *seq);
+
+  // queue the log to be taken over. requires lock_.
+  void queue_take_over_(const std::string& name, uint64_t epoch);
+
+  void take_over_entry_();
+
+  const Options options_;
+
+  std::mutex lock_;
+  bool shutdown_;
+  std::map<std::string, std::unique_ptr<LogImpl>> logs_;
+
+  // logs waiting to be taken over, and the largest epoch requested by clients
+  std::map<std::string, uint64_t> pending_;
+  std::condition_variable pending_cond_;
+  std::thread take_over_thread_;
+};
+
+}
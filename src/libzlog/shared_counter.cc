@@ -0,0 +1,150 @@
+#include "shared_counter.h"
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zlog {
+
+// the counter is shared between processes, so it must not be implemented with
+// a lock that lives in the process.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "shared counter requires lock-free 64-bit atomics");
+
+static const uint64_t segment_magic = 0x7a6c6f6773657131ULL;
+
+// the secret is stored after the header. magic is set last, once the rest of
+// the segment has been initialized.
+struct SharedCounter::Segment {
+  std::atomic<uint64_t> magic;
+  uint64_t epoch;
+  uint64_t secret_size;
+  alignas(64) std::atomic<uint64_t> position;
+
+  char *secret() {
+    return reinterpret_cast<char*>(this + 1);
+  }
+};
+
+SharedCounter::SharedCounter(Segment *segment, size_t size) :
+  segment_(segment),
+  size_(size)
+{}
+
+SharedCounter::~SharedCounter()
+{
+  munmap(segment_, size_);
+}
+
+std::string SharedCounter::name(const std::string& secret, uint64_t epoch)
+{
+  std::stringstream name;
+  name << "/zlog.seq." << std::hex << std::setw(16) << std::setfill('0')
+    << std::hash<std::string>()(secret) << std::dec << "." << epoch;
+  return name.str();
+}
+
+int SharedCounter::create(const std::string& name, uint64_t epoch,
+    const std::string& secret, uint64_t position)
+{
+  // the name is derived from the secret of the log instance, so an existing
+  // segment can only have been left behind by an instance with the same
+  // secret, such as one that used a previous incarnation of an in-memory
+  // backend.
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  }
+  if (fd < 0) {
+    return -errno;
+  }
+
+  const size_t size = sizeof(Segment) + secret.size();
+  if (ftruncate(fd, size) < 0) {
+    int ret = -errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    return ret;
+  }
+
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    int ret = -errno;
+    shm_unlink(name.c_str());
+    return ret;
+  }
+
+  // the segment is zero filled, and the magic isn't valid until it is stored
+  auto segment = static_cast<Segment*>(addr);
+  segment->epoch = epoch;
+  segment->secret_size = secret.size();
+  memcpy(segment->secret(), secret.data(), secret.size());
+  new (&segment->position) std::atomic<uint64_t>(position);
+  segment->magic.store(segment_magic, std::memory_order_release);
+
+  munmap(addr, size);
+
+  return 0;
+}
+
+int SharedCounter::open(const std::string& name, uint64_t epoch,
+    const std::string& secret, std::unique_ptr<SharedCounter> *counter)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+
+  const size_t size = sizeof(Segment) + secret.size();
+  if ((size_t)st.st_size != size) {
+    close(fd);
+    return -EINVAL;
+  }
+
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return -errno;
+  }
+
+  auto segment = static_cast<Segment*>(addr);
+  if (segment->magic.load(std::memory_order_acquire) != segment_magic ||
+      segment->epoch != epoch ||
+      segment->secret_size != secret.size() ||
+      memcmp(segment->secret(), secret.data(), secret.size())) {
+    munmap(addr, size);
+    return -EINVAL;
+  }
+
+  counter->reset(new SharedCounter(segment, size));
+
+  return 0;
+}
+
+void SharedCounter::remove(const std::string& name)
+{
+  shm_unlink(name.c_str());
+}
+
+std::atomic<uint64_t> *SharedCounter::position()
+{
+  return &segment_->position;
+}
+
+}
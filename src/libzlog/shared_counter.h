@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace zlog {
+
+// A sequencer counter in a named POSIX shared memory segment, which lets the
+// processes on a host that use the same log share a sequencer rather than
+// each taking over in turn. The segment records the epoch and secret of the
+// sequencer configuration that names it, and mapping it fails unless both
+// match, so a segment left behind by an old sequencer is never used. The
+// segment is created with owner-only permissions, so the processes must run as
+// the same user.
+class SharedCounter {
+ public:
+  ~SharedCounter();
+
+  SharedCounter(const SharedCounter&) = delete;
+  SharedCounter& operator=(const SharedCounter&) = delete;
+
+  // the segment name for a sequencer proposed in the given epoch by the log
+  // instance with the given secret.
+  static std::string name(const std::string& secret, uint64_t epoch);
+
+  // create the segment, with the counter set to position. an existing
+  // segment with the same name is replaced.
+  static int create(const std::string& name, uint64_t epoch,
+      const std::string& secret, uint64_t position);
+
+  // map an existing segment. returns -ENOENT if it doesn't exist, and -EINVAL
+  // if it doesn't belong to the given sequencer.
+  static int open(const std::string& name, uint64_t epoch,
+      const std::string& secret, std::unique_ptr<SharedCounter> *counter);
+
+  // remove the segment. processes that have mapped it can continue to use it
+  // until they unmap it.
+  static void remove(const std::string& name);
+
+  std::atomic<uint64_t> *position();
+
+ private:
+  struct Segment;
+
+  SharedCounter(Segment *segment, size_t size);
+
+  Segment *segment_;
+  const size_t size_;
+};
+
+}
@@ -1,6 +1,10 @@
 #include "striper.h"
 #include "proto/zlog.pb.h"
 #include "log_impl.h"
+#include "monitoring/statistics.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
 #include <iterator>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
@@ -35,9 +39,9 @@ static auto console = spdlog::stdout_color_mt("console");
 // view and then becoming active. It will seal the log during this process to
 // box out other sequencers, and to find the maximum log position.
 //
-//   NOTE: we can seal all stripes, or optimize by tracking the maximum position
-//   and then only sealing those which could be affected. This is an
-//   optimization step we can add a GH issue for.
+//   Only the stripes that could contain the maximum position are sealed
+//   before the new view is proposed. The older stripes are sealed in the
+//   background.
 //
 // A sequencer will add a unique value to the view so that clients can detect
 // frauds.
@@ -74,49 +78,153 @@ static auto console = spdlog::stdout_color_mt("console");
 
 namespace zlog {
 
-std::vector<std::string> Stripe::make_oids(
-    const std::string& prefix, uint64_t id, uint32_t width)
+// objects are named <prefix>.<stripe id>.<index>
+static void format_oid(const std::string& prefix, uint64_t stripe_id,
+    uint32_t index, std::string *oid)
 {
-  std::vector<std::string> oids;
-  oids.reserve(width);
+  char suffix[48];
+  const int len = snprintf(suffix, sizeof(suffix), ".%" PRIu64 ".%" PRIu32,
+      stripe_id, index);
+  assert(len > 0 && (size_t)len < sizeof(suffix));
+  oid->assign(prefix);
+  oid->append(suffix, len);
+}
 
-  for (uint32_t i = 0; i < width; i++) {
-    std::stringstream oid;
-    oid << prefix << "." << id << "." << i;
-    oids.emplace_back(oid.str());
-  }
+std::string Stripe::oid(uint32_t index) const
+{
+  assert(index < width_);
+  std::string oid;
+  format_oid(prefix_, id_, index, &oid);
+  return oid;
+}
 
+std::vector<std::string> Stripe::oids() const
+{
+  std::vector<std::string> oids(width_);
+  for (uint32_t i = 0; i < width_; i++) {
+    format_oid(prefix_, id_, i, &oids[i]);
+  }
   return oids;
 }
 
-// TODO: refactor this with ObjectMap::map
-boost::optional<Stripe> ObjectMap::map_stripe(uint64_t position) const
+std::pair<boost::optional<ObjectId>, uint64_t>
+ObjectMap::map(const uint64_t position) const
 {
-  if (!stripes_.empty()) {
-    auto it = stripes_.upper_bound(position);
+  const auto& runs = *runs_;
+  auto it = std::upper_bound(runs.cbegin(), runs.cend(), position,
+      [](uint64_t position, const StripeRun& run) {
+    return position < run.min_position;
+  });
+  if (it != runs.cbegin()) {
     it = std::prev(it);
-    assert(it->first <= position);
-    if (position <= it->second.max_position()) {
-      return it->second;
+    assert(it->min_position <= position);
+    const auto stripe = (position - it->min_position) / it->entries;
+    if (stripe < it->count) {
+      const ObjectId id{it->first_id + stripe,
+        (uint32_t)(position % it->width)};
+      const auto& last = runs.back();
+      const uint64_t stripes_after = (last.first_index + last.count) -
+        (it->first_index + stripe) - 1;
+      return std::make_pair(id, stripes_after);
     }
   }
+  return std::make_pair(boost::none, uint64_t(0));
+}
+
+void ObjectMap::oid(const ObjectId& id, std::string *oid) const
+{
+  format_oid(prefix_, id.stripe_id, id.index, oid);
+}
+
+const std::string& ObjectMap::oid(const ObjectId& id) const
+{
+  static thread_local std::string buf;
+  format_oid(prefix_, id.stripe_id, id.index, &buf);
+  return buf;
+}
+
+boost::optional<Stripe> ObjectMap::map_stripe(uint64_t position) const
+{
+  const auto mapping = map(position);
+  if (!mapping.first) {
+    return boost::none;
+  }
+
+  // stripe ids are consecutive within a run, so the id locates the stripe
+  const auto stripe_id = mapping.first->stripe_id;
+  for (const auto& run : *runs_) {
+    if (run.first_id <= stripe_id && stripe_id < run.first_id + run.count) {
+      return stripe(run.first_index + stripe_id - run.first_id);
+    }
+  }
+
+  assert(0);
   return boost::none;
 }
 
-std::pair<boost::optional<std::string>, bool>
-ObjectMap::map(const uint64_t position) const
+uint64_t ObjectMap::stripe_entries(const uint64_t position) const
 {
-  if (!stripes_.empty()) {
-    auto it = stripes_.upper_bound(position);
+  const auto& runs = *runs_;
+  auto it = std::upper_bound(runs.cbegin(), runs.cend(), position,
+      [](uint64_t position, const StripeRun& run) {
+    return position < run.min_position;
+  });
+  if (it != runs.cbegin()) {
     it = std::prev(it);
-    assert(it->first <= position);
-    if (position <= it->second.max_position()) {
-      auto oid = it->second.map(position);
-      auto last_stripe = std::next(it) == stripes_.end();
-      return std::make_pair(oid, last_stripe);
+    if (position <= it->max_position()) {
+      return it->entries;
     }
   }
-  return std::make_pair(boost::none, false);
+  return 0;
+}
+
+Stripe ObjectMap::stripe(size_t i) const
+{
+  assert(i < num_stripes());
+  const auto& runs = *runs_;
+  auto it = std::upper_bound(runs.cbegin(), runs.cend(), i,
+      [](size_t i, const StripeRun& run) {
+    return i < run.first_index;
+  });
+  it = std::prev(it);
+  const auto offset = i - it->first_index;
+  const auto min_position = it->min_position + offset * it->entries;
+  return Stripe(prefix_, it->first_id + offset, it->width, min_position,
+      min_position + it->entries - 1);
+}
+
+void ObjectMap::add_stripes(uint64_t first_id, uint32_t width,
+    uint64_t min_position, uint64_t entries, uint64_t count)
+{
+  assert(width > 0);
+  assert(entries > 0);
+  assert(count > 0);
+  assert(runs_->empty() || runs_->back().max_position() < min_position);
+
+  const auto first_index = num_stripes();
+
+  // the runs may be shared with other maps, including published views, so
+  // they are never modified in place. there are only a few runs, one for each
+  // change in stripe geometry, so the copy is cheap.
+  auto runs = std::make_shared<std::vector<StripeRun>>(*runs_);
+
+  bool extended = false;
+  if (!runs->empty()) {
+    auto& run = runs->back();
+    if (run.width == width && run.entries == entries &&
+        run.max_position() + 1 == min_position &&
+        run.first_id + run.count == first_id) {
+      run.count += count;
+      extended = true;
+    }
+  }
+
+  if (!extended) {
+    runs->push_back(StripeRun{min_position, first_id, first_index, count,
+        entries, width});
+  }
+
+  runs_ = std::move(runs);
 }
 
 bool ObjectMap::expand_mapping(const std::string& prefix,
@@ -126,39 +234,122 @@ bool ObjectMap::expand_mapping(const std::string& prefix,
     return false;
   }
 
+  // the zero state object map isn't created from a view
+  if (prefix_.empty()) {
+    prefix_ = prefix;
+  }
+  assert(prefix_ == prefix);
+
   const uint64_t num_stripe_entries = (uint64_t)stripe_width * stripe_slots;
   assert(num_stripe_entries > 0);
 
-  do {
-    const auto it = stripes_.crbegin();
-    const auto empty = it == stripes_.crend();
-    const auto min_position = empty ? 0 : (it->second.max_position() + 1);
-    const auto max_position = min_position + num_stripe_entries - 1;
-    const auto stripe_id = next_stripe_id_++;
-    stripes_.emplace(min_position,
-        Stripe{prefix, stripe_id, stripe_width, max_position});
-  } while (!map(position).first);
+  // the stripes that are needed to reach the position are added at once
+  const auto min_position = runs_->empty() ? 0 : (max_position() + 1);
+  assert(position >= min_position);
+  const auto count = (position - min_position) / num_stripe_entries + 1;
+  add_stripes(next_stripe_id_, stripe_width, min_position,
+      num_stripe_entries, count);
+  next_stripe_id_ += count;
+  assert(map(position).first);
 
   return true;
 }
 
 uint64_t ObjectMap::max_position() const
 {
-  auto stripe = stripes_.crbegin();
-  assert(stripe != stripes_.crend());
-  return stripe->second.max_position();
+  assert(!runs_->empty());
+  return runs_->back().max_position();
+}
+
+void ObjectMap::encode(zlog_proto::View *view) const
+{
+  for (const auto& run : *runs_) {
+    auto pb_run = view->add_runs();
+    pb_run->set_min_position(run.min_position);
+    pb_run->set_first_id(run.first_id);
+    pb_run->set_count(run.count);
+    pb_run->set_entries(run.entries);
+    pb_run->set_width(run.width);
+  }
+  view->set_next_stripe_id(next_stripe_id_);
+}
+
+void ObjectMap::encode_delta(const ObjectMap& base,
+    zlog_proto::View *view) const
+{
+  const auto base_stripes = base.num_stripes();
+  assert(base_stripes <= num_stripes());
+
+  for (const auto& run : *runs_) {
+    // skip the stripes that are in the base
+    if (run.first_index + run.count <= base_stripes) {
+      continue;
+    }
+    const auto skip = base_stripes > run.first_index ?
+      (base_stripes - run.first_index) : 0;
+    auto pb_run = view->add_runs();
+    pb_run->set_min_position(run.min_position + skip * run.entries);
+    pb_run->set_first_id(run.first_id + skip);
+    pb_run->set_count(run.count - skip);
+    pb_run->set_entries(run.entries);
+    pb_run->set_width(run.width);
+  }
+  view->set_next_stripe_id(next_stripe_id_);
+}
+
+void ObjectMap::decode(const zlog_proto::View& view)
+{
+  assert(next_stripe_id_ <= view.next_stripe_id());
+  next_stripe_id_ = view.next_stripe_id();
+  if (!view.delta()) {
+    runs_ = std::make_shared<const std::vector<StripeRun>>();
+  }
+
+  // views written before stripes were grouped into runs list every stripe
+  std::vector<const zlog_proto::Stripe*> stripes;
+  stripes.reserve(view.stripes_size());
+  for (const auto& stripe : view.stripes()) {
+    stripes.push_back(&stripe);
+  }
+  std::sort(stripes.begin(), stripes.end(),
+      [](const zlog_proto::Stripe *a, const zlog_proto::Stripe *b) {
+    return a->min_position() < b->min_position();
+  });
+
+  for (auto stripe : stripes) {
+    assert(stripe->min_position() <= stripe->max_position());
+    assert(stripe->id() < next_stripe_id_);
+    add_stripe(stripe->id(), stripe->width(), stripe->min_position(),
+        stripe->max_position());
+  }
+
+  for (const auto& run : view.runs()) {
+    assert(run.count() > 0);
+    assert(run.first_id() + run.count() <= next_stripe_id_);
+    add_stripes(run.first_id(), run.width(), run.min_position(),
+        run.entries(), run.count());
+  }
 }
 
 Striper::Striper(LogImpl *log, const std::string& secret) :
   shutdown_(false),
   log_(log),
   secret_(secret),
+  // background tasks take turns with the other logs one at a time
+  tasks_(log->executor->impl(), 1),
   view_(std::make_shared<const View>()),
-  expand_pos_(boost::none)
+  current_view_(view_.get()),
+  refresh_passes_(0),
+  refresh_pending_(false),
+  refresher_(&tasks_, [this] { refresh_entry_(); }),
+  expand_request_(0),
+  expand_pos_(boost::none),
+  expander_(&tasks_, [this] { expander_entry_(); }),
+  seq_limit_raiser_(&tasks_, [this] { seq_limit_entry_(); }),
+  stripe_initializer_(&tasks_, [this] { stripe_init_entry_(); }),
+  seal_job_(boost::none),
+  sealer_(&tasks_, [this] { sealer_entry_(); })
 {
-  refresh_thread_ = std::thread(&Striper::refresh_entry_, this);
-  expander_thread_ = std::thread(&Striper::expander_entry_, this);
-  stripe_init_thread_ = std::thread(&Striper::stripe_init_entry_, this);
 }
 
 Striper::~Striper()
@@ -167,10 +358,8 @@ Striper::~Striper()
     std::lock_guard<std::mutex> lk(lock_);
     assert(shutdown_);
     assert(refresh_waiters_.empty());
+    assert(srcu_.idle());
   }
-  assert(!refresh_thread_.joinable());
-  assert(!expander_thread_.joinable());
-  assert(!stripe_init_thread_.joinable());
 }
 
 std::shared_ptr<const View> Striper::view() const
@@ -180,60 +369,157 @@ std::shared_ptr<const View> Striper::view() const
   return view_;
 }
 
+void Striper::publish_view_(std::shared_ptr<const View> view)
+{
+  assert(view);
+  current_view_.store(view.get(), std::memory_order_release);
+  retired_views_.emplace_back(srcu_.retire_seq(), std::move(view_));
+  view_ = std::move(view);
+
+  // views are retired in order, so the reclaimable views are at the front
+  srcu_.try_advance();
+  while (!retired_views_.empty() &&
+         srcu_.reclaimable(retired_views_.front().first)) {
+    retired_views_.pop_front();
+  }
+}
+
+void Striper::start()
+{
+  // new views are installed as soon as the backend reports them, rather than
+  // after an I/O fails with a stale epoch. without watch support new views are
+  // only found by refreshing on demand.
+  uint64_t handle;
+  int ret = log_->backend->WatchViews(log_->hoid,
+      [this](uint64_t epoch) { view_notify_(epoch); }, &handle);
+  if (!ret) {
+    view_watch_ = handle;
+  } else if (ret != -EOPNOTSUPP) {
+    std::cerr << "watch views error " << ret << std::endl;
+  }
+}
+
 void Striper::shutdown()
 {
+  // this must not hold lock_, which is taken by the watch callback
+  if (view_watch_) {
+    log_->backend->UnwatchViews(*view_watch_);
+    view_watch_ = boost::none;
+  }
+
   {
     std::lock_guard<std::mutex> lk(lock_);
     shutdown_ = true;
   }
-  refresh_cond_.notify_one();
-  expander_cond_.notify_one();
-  stripe_init_cond_.notify_one();
-  refresh_thread_.join();
-  expander_thread_.join();
-  stripe_init_thread_.join();
+  refresher_.close();
+  expander_.close();
+  seq_limit_raiser_.close();
+  stripe_initializer_.close();
+  sealer_.close();
+  tasks_.close();
 }
 
-boost::optional<std::string> Striper::map(
-    const std::shared_ptr<const View>& view,
+boost::optional<ObjectId> Striper::map(const View& view,
     uint64_t position)
 {
-  const auto mapping = view->object_map.map(position);
+  const auto mapping = view.object_map.map(position);
   const auto oid = mapping.first;
-  const auto last_stripe = mapping.second;
+  const auto stripes_after = mapping.second;
+  const uint64_t lookahead = std::max(log_->options.stripe_lookahead, 1U);
 
-  // oid, false -> return oid (fast return case)
-  if (oid && !last_stripe) {
+  // oid, >= lookahead stripes after -> return oid (fast return case)
+  if (oid && stripes_after >= lookahead) {
     return oid;
   }
 
-  // oid, true -> expand(max view pos + 1)
-  if (oid && last_stripe) {
-    // asynchronsouly expand the view to map the next stripe
-    async_expand_view(view->object_map.max_position() + 1);
+  // oid, < lookahead stripes after -> expand(enough stripes to catch up)
+  if (oid) {
+    // asynchronsouly expand the view to map the missing stripes. the distance
+    // is measured in stripes of the run that maps the position, which may have
+    // a different geometry than the current options.
+    const auto stripe_entries = view.object_map.stripe_entries(position);
+    assert(stripe_entries > 0);
+    const auto missing = lookahead - stripes_after;
+    async_expand_view(view.object_map.max_position() +
+        missing * stripe_entries);
     return oid;
   }
 
-  // none, true   -> not a valid combination
-  // none, false  -> expand(position)
-  assert(!oid);
-  assert(!last_stripe);
-
   // the position mapped past the view's maximum position. the caller can't make
-  // progress, so we can immediately try to create a new view. since the
-  // position will by definition map into a new stripe that is also the last
-  // stripe in the new view, go ahead and create the target stripe and the
-  // following stripe. XXX: this is a future enhancement. returning boost::none
-  // here will cause the caller to expand the view to map the position, but
-  // won't add an extra stripe until the next I/O occurs.
+  // progress, and will synchronously expand the view to map the position. the
+  // lookahead stripes following the position are created in the background
+  // with the geometry from the options.
+  const uint64_t stripe_entries =
+    (uint64_t)log_->options.stripe_width * log_->options.stripe_slots;
+  async_expand_view(position + lookahead * stripe_entries);
   return boost::none;
 }
 
 int Striper::try_expand_view(const uint64_t position)
+{
+  return expand_or_join_(position, true);
+}
+
+int Striper::expand_or_join_(const uint64_t position, const bool sync)
+{
+  std::unique_lock<std::mutex> lk(lock_);
+
+  bool counted = false;
+  while (true) {
+    if (view_->object_map.map(position).first) {
+      return 0;
+    }
+
+    // the position may have been mapped by another thread after the caller
+    // read its view, so only count callers that end up waiting on a proposal.
+    if (sync && !counted) {
+      RecordTick(log_->options.statistics, STRIPER_SYNC_EXPAND);
+      counted = true;
+    }
+
+    if (!expansion_) {
+      break;
+    }
+
+    // join the proposal in flight if it will map the position. otherwise ask
+    // for the position to be included in the next proposal, and wait for the
+    // current proposal to finish before trying again.
+    const auto expansion = expansion_;
+    if (expansion->position >= position) {
+      RecordTick(log_->options.statistics, STRIPER_EXPAND_JOINED);
+      expansion->cond.wait(lk, [&] { return expansion->done; });
+      return expansion->ret;
+    }
+
+    expand_request_ = std::max(expand_request_, position);
+    expansion->cond.wait(lk, [&] { return expansion->done; });
+  }
+
+  // this thread makes the next proposal, sized to cover every position that
+  // was requested while waiting.
+  const auto expansion = std::make_shared<Expansion>(
+      std::max(position, expand_request_));
+  expand_request_ = 0;
+  expansion_ = expansion;
+  lk.unlock();
+
+  const int ret = expand_view_(expansion->position);
+
+  lk.lock();
+  expansion->done = true;
+  expansion->ret = ret;
+  expansion_.reset();
+  expansion->cond.notify_all();
+
+  return ret;
+}
+
+int Striper::expand_view_(const uint64_t position)
 {
   // read: the view into a mutable copy
-  auto v = *view();
-  const auto next_epoch = v.epoch() + 1;
+  const auto current = view();
+  auto v = *current;
+  const auto first_new_stripe = v.object_map.num_stripes();
 
   // modify: the object map to contain the position
   auto changed = v.object_map.expand_mapping(log_->prefix, position,
@@ -242,15 +528,12 @@ int Striper::try_expand_view(const uint64_t position)
     return 0;
   }
 
-  // TODO: it would be good track information that let us identify scenarios
-  // when lots of threads or async ops are producing a thundering herd to
-  // propose a new view. if this is occuring then we can optimize by
-  // deduplicating the requests. this shouldn't be an issue when double
-  // buffering view creation is working well.
-
   // write: the serialized view as a new epoch view
-  auto data = v.serialize();
-  int ret = log_->backend->ProposeView(log_->hoid, next_epoch, data);
+  RecordTick(log_->options.statistics, STRIPER_EXPAND_PROPOSED);
+  int ret = propose_view_(*current, v);
+  if (ret == -ESPIPE) {
+    RecordTick(log_->options.statistics, STRIPER_EXPAND_LOST);
+  }
   if (!ret || ret == -ESPIPE) {
     update_current_view(v.epoch());
     if (!ret) {
@@ -264,8 +547,21 @@ int Striper::try_expand_view(const uint64_t position)
       // for correctness: client I/O path will do its own synchronous
       // initialization to make progress. the optimization is future work if
       // necessary: keeping stats on these scenarios would be useful.
+      //
+      // the position may be far past the previous maximum position, so only
+      // the stripe mapping it and the lookahead stripes before it are
+      // initialized. the stripes in between are initialized on first use.
       if (log_->options.init_stripe_on_create) {
-        async_init_stripe(position);
+        const uint64_t lookahead =
+          std::max(log_->options.stripe_lookahead, 1U);
+        const auto num_stripes = v.object_map.num_stripes();
+        const auto first_init = std::max<uint64_t>(first_new_stripe,
+            num_stripes > lookahead + 1 ? num_stripes - lookahead - 1 : 0);
+        std::vector<uint64_t> positions;
+        for (auto i = first_init; i < num_stripes; i++) {
+          positions.push_back(v.object_map.stripe(i).min_position());
+        }
+        async_init_stripes(positions);
       }
     }
     return 0;
@@ -278,47 +574,123 @@ int Striper::try_expand_view(const uint64_t position)
   return ret;
 }
 
-int Striper::seal_stripe(const Stripe& stripe, uint64_t epoch,
-    uint64_t *pposition, bool *pempty) const
+int Striper::propose_view_(const View& current, const View& v)
 {
-  auto& oids = stripe.oids();
-  assert(!oids.empty());
+  const auto next_epoch = current.epoch() + 1;
 
-  for (auto& oid : oids) {
-    int ret = log_->backend->Seal(oid, epoch);
-    if (ret < 0) {
-      return ret;
+  bool full;
+  const auto data = v.serialize(current,
+      log_->options.view_checkpoint_interval, &full);
+  int ret = log_->backend->ProposeView(log_->hoid, next_epoch, data);
+  if (ret) {
+    return ret;
+  }
+
+  // views before a full view aren't needed to build the newest view. trimming
+  // is best effort: views that are left behind are trimmed by the next full
+  // view.
+  if (full && next_epoch > 1 && log_->options.trim_views) {
+    log_->backend->TrimViews(log_->hoid, next_epoch);
+  }
+
+  return 0;
+}
+
+// issue `count` asynchronous backend calls with at most `window` of them in
+// flight, and wait for all of them to complete. call i is issued by issue(i,
+// cb), and its result is stored in (*rets)[i].
+template<typename F>
+static void fan_out(size_t count, size_t window, std::vector<int> *rets,
+    F issue)
+{
+  std::mutex lock;
+  std::condition_variable cond;
+  size_t inflight = 0;
+
+  rets->assign(count, 0);
+  window = std::max(window, (size_t)1);
+
+  for (size_t i = 0; i < count; i++) {
+    {
+      std::unique_lock<std::mutex> lk(lock);
+      cond.wait(lk, [&] { return inflight < window; });
+      inflight++;
+    }
+
+    int *result = &(*rets)[i];
+    int ret = issue(i, std::function<void(int)>([&, result](int ret) {
+      // notify with the lock held: the waiter may return and destroy the
+      // condition variable as soon as the lock is released.
+      std::lock_guard<std::mutex> lk(lock);
+      *result = ret;
+      inflight--;
+      cond.notify_one();
+    }));
+
+    if (ret) {
+      std::lock_guard<std::mutex> lk(lock);
+      *result = ret;
+      inflight--;
+    }
+  }
+
+  std::unique_lock<std::mutex> lk(lock);
+  cond.wait(lk, [&] { return inflight == 0; });
+}
+
+int Striper::seal_stripes(const std::vector<Stripe>& stripes,
+    uint64_t epoch, std::vector<StripeMaxPos> *max_pos) const
+{
+  std::vector<std::string> oids;
+  for (auto& stripe : stripes) {
+    for (uint32_t i = 0; i < stripe.width(); i++) {
+      oids.push_back(stripe.oid(i));
     }
   }
 
-  bool stripe_empty = true;
-  // max pos only defined for non-empty stripe
-  uint64_t stripe_max_pos = 0;
+  const size_t window = log_->options.max_inflight_seals;
+
+  std::vector<int> rets;
+  fan_out(oids.size(), window, &rets,
+      [&](size_t i, std::function<void(int)> cb) {
+    return log_->backend->SealAsync(oids[i], epoch, cb);
+  });
 
-  for (auto& oid : oids) {
-    bool empty;
-    uint64_t max_pos;
-    int ret = log_->backend->MaxPos(oid, epoch, &max_pos, &empty);
+  for (auto ret : rets) {
     if (ret < 0) {
       return ret;
     }
+  }
 
-    if (empty) {
-      continue;
-    }
+  std::vector<StripeMaxPos> oid_max_pos(oids.size());
+  fan_out(oids.size(), window, &rets,
+      [&](size_t i, std::function<void(int)> cb) {
+    return log_->backend->MaxPosAsync(oids[i], epoch,
+        &oid_max_pos[i].position, &oid_max_pos[i].empty, cb);
+  });
 
-    stripe_empty = false;
-    stripe_max_pos = std::max(stripe_max_pos, max_pos);
+  for (auto ret : rets) {
+    if (ret < 0) {
+      return ret;
+    }
   }
 
-  if (pempty) {
-    *pempty = stripe_empty;
-  }
+  max_pos->clear();
+  size_t i = 0;
+  for (auto& stripe : stripes) {
+    bool stripe_empty = true;
+    // max pos only defined for non-empty stripe
+    uint64_t stripe_max_pos = 0;
 
-  if (pposition) {
-    if (!stripe_empty) {
-      *pposition = stripe_max_pos;
+    for (uint32_t n = 0; n < stripe.width(); n++, i++) {
+      if (oid_max_pos[i].empty) {
+        continue;
+      }
+      stripe_empty = false;
+      stripe_max_pos = std::max(stripe_max_pos, oid_max_pos[i].position);
     }
+
+    max_pos->push_back(StripeMaxPos{stripe_empty, stripe_max_pos});
   }
 
   return 0;
@@ -327,7 +699,8 @@ int Striper::seal_stripe(const Stripe& stripe, uint64_t epoch,
 int Striper::propose_sequencer()
 {
   // read: a mutable copy of the current view
-  auto v = *view();
+  const auto current = view();
+  auto v = *current;
   const auto next_epoch = v.epoch() + 1;
 
   bool empty = true;
@@ -337,11 +710,34 @@ int Striper::propose_sequencer()
   // find the maximum position written. the maximum position written is
   // contained in the first non-empty stripe scanning in reverse, beginning with
   // the stripe that maps the maximum possible position for the current view.
-  const auto stripes = v.object_map.stripes();
-  auto it = stripes.crbegin();
-  for (; it != stripes.crend(); it++) {
-    auto& stripe = it->second;
-    int ret = seal_stripe(stripe, next_epoch, &max_pos, &empty);
+  // stripes are sealed and queried in groups of roughly max_inflight_seals
+  // objects, so that the common case of the maximum position being in one of
+  // the last few stripes completes in a single round.
+  const auto& object_map = current->object_map;
+  // stripes [0, next) have not been examined. stripes that only map positions
+  // at or above the limit of the current sequencer haven't been written by its
+  // clients, nor by the clients of earlier sequencers, whose limits were lower.
+  // they are sealed in the background along with the stripes below the
+  // maximum position.
+  auto next = object_map.num_stripes();
+  const auto limit = current->seq_config ? current->seq_config->limit : 0;
+  if (limit) {
+    while (next > 0 && object_map.stripe(next - 1).min_position() >= limit) {
+      next--;
+    }
+  }
+  const auto scanned_end = next;
+  while (empty && next > 0) {
+    std::vector<Stripe> group;
+    size_t num_oids = 0;
+    for (; next > 0 &&
+        (group.empty() || num_oids < log_->options.max_inflight_seals); next--) {
+      group.push_back(object_map.stripe(next - 1));
+      num_oids += group.back().width();
+    }
+
+    std::vector<StripeMaxPos> group_max_pos;
+    int ret = seal_stripes(group, next_epoch, &group_max_pos);
     if (ret < 0) {
       if (ret == -ESPIPE) {
         update_current_view(v.epoch());
@@ -350,35 +746,30 @@ int Striper::propose_sequencer()
       return ret;
     }
 
-    if (empty) {
-      continue;
+    for (auto& stripe_max_pos : group_max_pos) {
+      if (!stripe_max_pos.empty) {
+        empty = false;
+        max_pos = stripe_max_pos.position;
+        break;
+      }
     }
-
-    it++;
-    break;
   }
 
-  assert(!empty || it == stripes.crend());
+  assert(!empty || next == 0);
 
-  // seal all other stripes. this is not to guarantee that the max is valid, but
+  // the remaining stripes can't contain the maximum position. they are sealed
+  // in the background. this is not to guarantee that the max is valid, but
   // rather to signal to clients connected / using other sequencers that they
   // should grab a new view to see the new sequencer.
-  for (; it != stripes.crend(); it++) {
-    auto& stripe = it->second;
-    int ret = seal_stripe(stripe, next_epoch, nullptr, nullptr);
-    if (ret < 0) {
-      if (ret == -ESPIPE) {
-        update_current_view(v.epoch());
-        return 0;
-      }
-      return ret;
-    }
+  if (next > 0 || scanned_end < object_map.num_stripes()) {
+    async_seal_stripes(SealJob{current, next_epoch, next, scanned_end});
   }
 
   // new sequencer configuration
   SequencerConfig seq_config;
   seq_config.secret = secret_;
   seq_config.position = empty ? 0 : (max_pos + 1);
+  seq_config.address = log_->options.seqr_address;
 
   // this is the epoch at which the new seq takes affect. this controls the
   // validitiy of seq_config.position since the sequencer info is copied into
@@ -388,12 +779,37 @@ int Striper::propose_sequencer()
   // different data structures?
   seq_config.epoch = next_epoch;
 
+  if (log_->options.seq_limit_stripes) {
+    seq_config.limit = seq_config.position + (uint64_t)
+      log_->options.seq_limit_stripes * log_->options.stripe_width *
+      log_->options.stripe_slots;
+  }
+
+  // the shared counter must exist before a view names it. if it can't be
+  // created a process-local sequencer is proposed instead.
+  if (log_->options.shm_sequencer) {
+    const auto shm = SharedCounter::name(secret_, next_epoch);
+    if (!SharedCounter::create(shm, next_epoch, secret_,
+          seq_config.position)) {
+      seq_config.shm = shm;
+    }
+  }
+
   // modify: the view by setting a new sequencer configuration
   v.seq_config = seq_config;
 
   // write: the proposed new view
-  auto data = v.serialize();
-  int ret = log_->backend->ProposeView(log_->hoid, next_epoch, data);
+  int ret = propose_view_(*current, v);
+
+  // remove the segment that won't be used: ours if the proposal failed, and
+  // otherwise the one of the sequencer that was replaced, if it is on this
+  // host.
+  if (ret && !seq_config.shm.empty()) {
+    SharedCounter::remove(seq_config.shm);
+  } else if (!ret && current->seq_config && !current->seq_config->shm.empty()) {
+    SharedCounter::remove(current->seq_config->shm);
+  }
+
   if (!ret || ret == -ESPIPE) {
     update_current_view(v.epoch());
     return 0;
@@ -402,90 +818,264 @@ int Striper::propose_sequencer()
   return ret;
 }
 
+int Striper::raise_seq_limit(const View& view, uint64_t position)
+{
+  assert(view.seq_config);
+  return raise_seq_limit_(view.seq_config->epoch, position);
+}
+
+int Striper::raise_seq_limit_(uint64_t seq_epoch, uint64_t position)
+{
+  std::lock_guard<std::mutex> lk(seq_limit_lock_);
+
+  while (true) {
+    // read: a mutable copy of the current view
+    const auto current = this->view();
+    if (!current->seq_config || current->seq_config->epoch != seq_epoch ||
+        current->seq_limit_covers(position)) {
+      return 0;
+    }
+    auto v = *current;
+
+    // modify: the limit, leaving room for the positions that follow. the limit
+    // may be in the view of a log that doesn't set the option.
+    const uint64_t stripes = std::max(log_->options.seq_limit_stripes, 1U);
+    v.seq_config->limit = position + 1 + stripes *
+      log_->options.stripe_width * log_->options.stripe_slots;
+
+    // write: the proposed new view
+    int ret = propose_view_(*current, v);
+    if (ret && ret != -ESPIPE) {
+      return ret;
+    }
+
+    update_current_view(current->epoch());
+  }
+}
+
+bool Striper::raise_seq_limit_async(const View& view, uint64_t position,
+    std::function<void(int)> cb)
+{
+  assert(view.seq_config);
+  const auto seq_epoch = view.seq_config->epoch;
+
+  std::lock_guard<std::mutex> lk(lock_);
+  if (!view_->seq_config || view_->seq_config->epoch != seq_epoch ||
+      view_->seq_limit_covers(position)) {
+    return true;
+  }
+
+  seq_limit_waiters_.push_back(SeqLimitWaiter{seq_epoch, position,
+      std::move(cb)});
+  seq_limit_raiser_.kick();
+
+  return false;
+}
+
+void Striper::seq_limit_entry_()
+{
+  std::vector<SeqLimitWaiter> waiters;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (shutdown_) {
+      return;
+    }
+    waiters.swap(seq_limit_waiters_);
+  }
+
+  // one proposal covers every waiter of a sequencer
+  std::map<uint64_t, uint64_t> positions;
+  for (const auto& waiter : waiters) {
+    auto it = positions.emplace(waiter.seq_epoch, waiter.position);
+    it.first->second = std::max(it.first->second, waiter.position);
+  }
+
+  std::map<uint64_t, int> rets;
+  for (const auto& pos : positions) {
+    rets[pos.first] = raise_seq_limit_(pos.first, pos.second);
+  }
+
+  for (auto& waiter : waiters) {
+    waiter.cb(rets[waiter.seq_epoch]);
+  }
+}
+
+void Striper::async_seal_stripes(const SealJob& job)
+{
+  std::lock_guard<std::mutex> lk(lock_);
+  if (!seal_job_ || seal_job_->epoch < job.epoch) {
+    seal_job_ = job;
+    sealer_.kick();
+  }
+}
+
+void Striper::sealer_entry_()
+{
+  std::unique_lock<std::mutex> lk(lock_);
+  if (shutdown_ || !seal_job_) {
+    return;
+  }
+
+  const auto job = *seal_job_;
+  seal_job_ = boost::none;
+  lk.unlock();
+
+  std::vector<std::string> oids;
+  const auto& object_map = job.view->object_map;
+  for (size_t i = 0; i < object_map.num_stripes(); i++) {
+    if (i >= job.scanned_begin && i < job.scanned_end) {
+      continue;
+    }
+    const auto stripe = object_map.stripe(i);
+    for (uint32_t i = 0; i < stripe.width(); i++) {
+      oids.push_back(stripe.oid(i));
+    }
+  }
+
+  // seal in rounds so that shutdown, or a newer job, isn't blocked behind a
+  // log with many stripes. a newer job runs once this one returns. errors are
+  // ignored: -ESPIPE means the object has already been sealed by a newer
+  // sequencer.
+  const size_t window = std::max(log_->options.max_inflight_seals, 1U);
+  for (size_t start = 0; start < oids.size(); start += window) {
+    {
+      std::lock_guard<std::mutex> lk(lock_);
+      if (shutdown_ || seal_job_) {
+        break;
+      }
+    }
+
+    const auto count = std::min(window, oids.size() - start);
+    std::vector<int> rets;
+    fan_out(count, window, &rets,
+        [&](size_t i, std::function<void(int)> cb) {
+      return log_->backend->SealAsync(oids[start + i], job.epoch, cb);
+    });
+  }
+}
+
 // no deduplication is performed here, but this is only triggered by the thread
 // that successfully creates a new stripe, of which there should just be one per
 // stripe. later if/when we try to optimize for the rare case of the stripe
 // creator crashing before finishing initialization, we _might_ run into a case
 // where we want to deduplicate the stripe init jobs.
-void Striper::async_init_stripe(uint64_t position)
+void Striper::async_init_stripes(const std::vector<uint64_t>& positions)
 {
   std::lock_guard<std::mutex> lk(lock_);
-  stripe_init_pos_.push_back(position);
-  stripe_init_cond_.notify_one();
+  stripe_init_pos_.insert(stripe_init_pos_.end(), positions.begin(),
+      positions.end());
+  stripe_initializer_.kick();
 }
 
 void Striper::stripe_init_entry_()
 {
-  while (true) {
-    uint64_t position;
-    {
-      std::unique_lock<std::mutex> lk(lock_);
-
-      stripe_init_cond_.wait(lk, [&] {
-        return !stripe_init_pos_.empty() || shutdown_;
-      });
-
-      if (shutdown_) {
-        break;
-      }
-
-      assert(!stripe_init_pos_.empty());
-      position = stripe_init_pos_.front();
-      stripe_init_pos_.pop_front();
+  std::list<uint64_t> positions;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (shutdown_ || stripe_init_pos_.empty()) {
+      return;
     }
+    positions.swap(stripe_init_pos_);
+  }
 
-    auto v = view();
+  // the objects of all the pending stripes are initialized together, with up
+  // to max_inflight_seals requests in flight.
+  auto v = view();
+  std::vector<std::string> oids;
+  for (auto position : positions) {
     auto stripe = v->object_map.map_stripe(position);
     if (!stripe) {
       continue;
     }
-
-    auto& oids = stripe->oids();
-    assert(!oids.empty());
-
-    // TODO: this is a case for not using Seal to initialize objects. if the
-    // objects in the stripe are already initialized, then it is common for this
-    // initialization job to be using a newer epoch/view, which means that the
-    // epoch will be bumped on the objects (for no good reason) in the stripe
-    // even though all we really wanted to do is initialize if not already
-    // initialized.
-    for (auto& oid : oids) {
-      log_->backend->Seal(oid, v->epoch());
+    for (uint32_t i = 0; i < stripe->width(); i++) {
+      oids.push_back(v->object_map.oid(ObjectId{stripe->id(), i}));
     }
   }
+
+  // objects that already exist, for instance because a client initialized
+  // them in the I/O path, are left unchanged. this job may be running with a
+  // newer view, and raising the epoch of the objects would cause the I/O of
+  // clients using the older view to fail.
+  std::vector<int> rets;
+  fan_out(oids.size(), log_->options.max_inflight_seals, &rets,
+      [&](size_t i, std::function<void(int)> cb) {
+    return log_->backend->InitObjectAsync(oids[i], v->epoch(), cb);
+  });
 }
 
-void Striper::expander_entry_()
+bool Striper::try_expand_view_async(uint64_t position,
+    std::function<void(int)> cb)
 {
-  while (true) {
-    std::unique_lock<std::mutex> lk(lock_);
+  std::lock_guard<std::mutex> lk(lock_);
+  if (view_->object_map.map(position).first) {
+    return true;
+  }
 
-    expander_cond_.wait(lk, [&] {
-      return expand_pos_ || shutdown_;
-    });
+  RecordTick(log_->options.statistics, STRIPER_SYNC_EXPAND);
+  expand_waiters_.emplace_back(position, std::move(cb));
+  if (!expand_pos_ || position > *expand_pos_) {
+    expand_pos_ = position;
+  }
+  expander_.kick();
 
-    if (shutdown_) {
-      break;
+  return false;
+}
+
+void Striper::complete_expand_waiters_(int ret)
+{
+  std::vector<std::pair<int, std::function<void(int)>>> done;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    auto it = expand_waiters_.begin();
+    while (it != expand_waiters_.end()) {
+      if (view_->object_map.map(it->first).first) {
+        done.emplace_back(0, std::move(it->second));
+      } else if (ret) {
+        done.emplace_back(ret, std::move(it->second));
+      } else {
+        ++it;
+        continue;
+      }
+      it = expand_waiters_.erase(it);
     }
+  }
 
-    assert(expand_pos_);
-    const auto position = *expand_pos_;
-    lk.unlock();
+  for (auto& waiter : done) {
+    waiter.second(waiter.first);
+  }
+}
 
-    const auto v = view();
-    const auto mapping = v->object_map.map(position);
-    if (!mapping.first) {
-      try_expand_view(position);
-      continue;
-    }
+void Striper::expander_entry_()
+{
+  std::unique_lock<std::mutex> lk(lock_);
+  if (shutdown_ || !expand_pos_) {
+    return;
+  }
 
-    lk.lock();
-    assert(expand_pos_);
-    if (*expand_pos_ > position) {
-      continue;
-    }
-    expand_pos_ = boost::none;
+  const auto position = *expand_pos_;
+  lk.unlock();
+
+  // keep going until the position is mapped, or a larger position has been
+  // requested, in which case that one is expanded next. waiters are
+  // completed as their positions are mapped.
+  const auto v = view();
+  const auto mapping = v->object_map.map(position);
+  if (!mapping.first) {
+    const int ret = expand_or_join_(position, false);
+    complete_expand_waiters_(ret);
+    expander_.kick();
+    return;
+  }
+
+  complete_expand_waiters_(0);
+
+  lk.lock();
+  assert(expand_pos_);
+  if (*expand_pos_ > position) {
+    expander_.kick();
+    return;
   }
+  expand_pos_ = boost::none;
 }
 
 void Striper::async_expand_view(uint64_t position)
@@ -493,151 +1083,299 @@ void Striper::async_expand_view(uint64_t position)
   std::unique_lock<std::mutex> lk(lock_);
   if (!expand_pos_ || position > *expand_pos_) {
     expand_pos_ = position;
-    expander_cond_.notify_one();
+    expander_.kick();
   }
 }
 
-void Striper::refresh_entry_()
+static void parse_view(const std::string& blob, zlog_proto::View *view)
 {
-  while (true) {
-    uint64_t current_epoch;
+  if (!view->ParseFromString(blob)) {
+    assert(0);
+    exit(1);
+  }
+}
 
-    {
-      std::unique_lock<std::mutex> lk(lock_);
+// decode a full view, or a delta view applied to the view at the previous
+// epoch.
+static std::shared_ptr<View> decode_view(const std::string& prefix,
+    const std::shared_ptr<const View>& prev, uint64_t epoch,
+    const zlog_proto::View& view)
+{
+  if (view.delta()) {
+    assert(prev);
+    return std::make_shared<View>(*prev, epoch, view);
+  }
+  return std::make_shared<View>(prefix, epoch, view);
+}
 
-      refresh_cond_.wait(lk, [&] {
-        return !refresh_waiters_.empty() || shutdown_;
-      });
+int Striper::read_latest_view_(const std::shared_ptr<const View>& current,
+    std::shared_ptr<View> *view_out) const
+{
+  uint64_t latest_epoch;
+  std::string blob;
+  int ret = log_->backend->ReadLatestView(log_->hoid, &latest_epoch, &blob);
+  if (ret) {
+    return ret;
+  }
 
-      if (shutdown_) {
-        for (auto waiter : refresh_waiters_) {
-          waiter->done = true;
-          waiter->cond.notify_one();
-        }
-        refresh_waiters_.clear();
-        break;
-      }
+  if (latest_epoch <= current->epoch()) {
+    view_out->reset();
+    return 0;
+  }
 
-      current_epoch = view_->epoch();
+  zlog_proto::View latest;
+  parse_view(blob, &latest);
+
+  // a delta applies to the view at the previous epoch, which is rebuilt by
+  // applying the views that follow the current view, or the most recent full
+  // view if the current view is older than it.
+  std::shared_ptr<const View> prev;
+  if (latest.delta()) {
+    uint64_t epoch;
+    if (current->epoch() >= latest.checkpoint_epoch()) {
+      prev = current;
+      epoch = current->epoch() + 1;
+    } else {
+      epoch = latest.checkpoint_epoch();
     }
 
-    // from which epoch should we start reading updates? note that in the
-    // current version of zlog there are no incremental view updates, so it
-    // would be sufficient to add an interface to retrieve the latest view.
-    // however adding incremental updates is future work, so for now we just eat
-    // the overhead of reading old views and tossing them away since that
-    // machinary will eventually be needed.
-    uint64_t epoch = current_epoch + 1;
+    while (epoch < latest_epoch) {
+      std::map<uint64_t, std::string> views;
+      const auto max_views = std::min(
+          (uint64_t)log_->options.max_refresh_views_read,
+          latest_epoch - epoch);
+      ret = log_->backend->ReadViews(log_->hoid, epoch, max_views, &views);
+      if (ret) {
+        return ret;
+      }
 
-    // read views at or after epoch
-    std::map<uint64_t, std::string> views;
-    int ret = log_->backend->ReadViews(log_->hoid, epoch,
-        log_->options.max_refresh_views_read, &views);
-    if (ret) {
-      std::cerr << "read views error " << ret << std::endl;
-      continue;
-    }
+      if (views.empty()) {
+        return -EIO;
+      }
 
-    // no newer views were found. notify the waiters.
-    if (views.empty()) {
-      std::list<RefreshWaiter*> waiters;
-      {
-        std::lock_guard<std::mutex> lk(lock_);
-        waiters.swap(refresh_waiters_);
+      // the views being read were trimmed after a newer full view was
+      // written. catching up from the newest full view is retried by the
+      // caller if it is beyond the latest view that was read.
+      if (views.cbegin()->first >= latest_epoch) {
+        return -EAGAIN;
       }
-      for (auto it = waiters.begin(); it != waiters.end();) {
-        const auto waiter = *it;
-	// trying to make this locking fine grained to avoid blocking clients
-	// is admirable, but really we probably just need a finger grained lock
-	// to protect the waiters list rather than lock/unlock/lock/unlock/...
-        std::lock_guard<std::mutex> lk(lock_);
-        if (current_epoch > waiter->epoch) {
-          waiter->done = true;
-          waiter->cond.notify_one();
-          it = waiters.erase(it);
-        } else {
-          it++;
+
+      for (const auto& view : views) {
+        if (view.first >= latest_epoch) {
+          break;
         }
+
+        zlog_proto::View view_src;
+        parse_view(view.second, &view_src);
+
+        // a gap is only expected when older views were trimmed, in which
+        // case the view after the gap is a full view.
+        if (view.first != epoch) {
+          if (view.first < epoch || view_src.delta()) {
+            assert(0);
+            exit(0);
+          }
+          epoch = view.first;
+        }
+
+        prev = decode_view(log_->prefix, prev, epoch, view_src);
+        epoch++;
       }
-      if (!waiters.empty()) {
-        std::lock_guard<std::mutex> lk(lock_);
-        refresh_waiters_.splice(refresh_waiters_.begin(), waiters);
-      }
-      // XXX: if a new waiter showed up while we were waking up waiters from the
-      // copy made above, then when we continue we'll loop back around if there
-      // are still waiters. however, when we move to a notify/watch method that
-      // avoids spinning, be careful here to make sure that new waiters are
-      // handled before blocking to wait on updates.
-      continue;
     }
+  }
 
-    // sanity check that there are no missing views
-    for (const auto& view : views) {
-      if (view.first != epoch) {
-        assert(0);
-        exit(0);
-        return;
-      }
-      epoch++;
+  *view_out = decode_view(log_->prefix, prev, latest_epoch, latest);
+
+  return 0;
+}
+
+void Striper::refresh_entry_()
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (shutdown_ || (refresh_waiters_.empty() && !refresh_pending_)) {
+      return;
     }
+  }
 
-    // grab the newest view in the batch
-    const auto it = views.crbegin();
-    assert(it != views.crend());
+  refresh_();
 
-    zlog_proto::View view_src;
-    if (!view_src.ParseFromString(it->second)) {
-      assert(0);
-      exit(1);
+  // waiters that are still waiting are retried on the next run. waiters are
+  // refreshed on demand even when the backend notifies us of new views,
+  // because a notification may be delayed or lost.
+  std::lock_guard<std::mutex> lk(lock_);
+  if (!refresh_waiters_.empty() || refresh_pending_) {
+    refresher_.kick();
+  }
+}
+
+void Striper::refresh_()
+{
+  std::lock_guard<std::mutex> refresh_lk(refresh_lock_);
+
+  std::shared_ptr<const View> current;
+  uint64_t pass;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    current = view_;
+    refresh_pending_ = false;
+    pass = ++refresh_passes_;
+  }
+
+  const uint64_t current_epoch = current->epoch();
+
+  // fetch the newest view. this is a single request when the newest view is
+  // a full view, or a delta on top of the current view. otherwise the deltas
+  // since the most recent full view are also read.
+  std::shared_ptr<View> new_view;
+  int ret = read_latest_view_(current, &new_view);
+  if (ret) {
+    if (ret == -EAGAIN) {
+      // views were trimmed while catching up. try again even if the refresh
+      // was requested by a notification that has already been consumed.
+      std::lock_guard<std::mutex> lk(lock_);
+      refresh_pending_ = true;
+    } else {
+      std::cerr << "read views error " << ret << std::endl;
     }
+    return;
+  }
 
-    auto new_view = std::make_shared<View>(log_->prefix, it->first, view_src);
+  // no newer views were found. notify the waiters.
+  if (!new_view) {
+    std::vector<std::function<void()>> cbs;
+    {
+      std::lock_guard<std::mutex> lk(lock_);
+      wake_refresh_waiters_(current_epoch, pass, &cbs);
+    }
+    for (const auto& cb : cbs) {
+      cb();
+    }
+    return;
+  }
 
-    if (new_view->seq_config) {
-      if (new_view->seq_config->secret == secret_) { // we should be the active seq
-        if (new_view->seq_config->epoch == it->first) {
-          new_view->seq = std::make_shared<Sequencer>(it->first,
-              new_view->seq_config->position);
+  if (new_view->seq_config) {
+    // we should be the active seq, or share it through shared memory
+    if (new_view->seq_config->secret == secret_ ||
+        !new_view->seq_config->shm.empty()) {
+      const auto seq_epoch = new_view->seq_config->epoch;
+      assert(seq_epoch <= new_view->epoch());
+      std::lock_guard<std::mutex> lk(lock_);
+      if (seq_epoch < new_view->epoch() && view_->seq &&
+          view_->seq->epoch() == seq_epoch) {
+        assert(view_->seq_config);
+        assert(view_->seq_config->epoch == seq_epoch);
+        // be careful that this isn't copying the state of the sequencer. when
+        // this comment was written, this was copying a shared_ptr to the
+        // state which is fine. the issue that other threads may be
+        // simultaneously incrementing the sequencer and we don't want to miss
+        // those increments when setting up the new view.
+        new_view->seq = view_->seq;
+      } else if (!new_view->seq_config->shm.empty()) {
+        // the shared counter holds the positions handed out by every process
+        // that shares it. if it can't be mapped (e.g. it is on another host)
+        // this instance will have to take over.
+        std::unique_ptr<SharedCounter> counter;
+        int ret = SharedCounter::open(new_view->seq_config->shm, seq_epoch,
+            new_view->seq_config->secret, &counter);
+        if (ret) {
+          new_view->seq = nullptr;
         } else {
-          assert(new_view->seq_config->epoch < it->first);
-          std::lock_guard<std::mutex> lk(lock_);
-          assert(view_->seq);
-          assert(view_->seq_config);
-          assert(view_->seq_config->epoch == new_view->seq_config->epoch);
-          assert(view_->seq->epoch() == view_->seq_config->epoch);
-          // be careful that this isn't copying the state of the sequencer. when
-          // this comment was written, this was copying a shared_ptr to the
-          // state which is fine. the issue that other threads may be
-          // simultaneously incrementing the sequencer and we don't want to miss
-          // those increments when setting up the new view.
-          new_view->seq = view_->seq;
+          new_view->seq = std::make_shared<Sequencer>(seq_epoch,
+              std::move(counter));
         }
       } else {
-        new_view->seq = nullptr;
+        // the sequencer is new in this view, or the view that installed it
+        // was skipped over when catching up. either way it hasn't handed out
+        // any positions yet, so it starts at the configured position.
+        new_view->seq = std::make_shared<Sequencer>(seq_epoch,
+            new_view->seq_config->position);
       }
     } else {
       new_view->seq = nullptr;
     }
+  } else {
+    new_view->seq = nullptr;
+  }
 
+  // the waiters that were waiting for this view don't need to wait for the
+  // next round.
+  std::vector<std::function<void()>> cbs;
+  {
     std::lock_guard<std::mutex> lk(lock_);
-    view_ = std::move(new_view);
+    const auto epoch = new_view->epoch();
+    publish_view_(std::move(new_view));
+    wake_refresh_waiters_(epoch, pass, &cbs);
+  }
+  for (const auto& cb : cbs) {
+    cb();
   }
 }
 
-void Striper::update_current_view(const uint64_t epoch)
+void Striper::wake_refresh_waiters_(const uint64_t epoch, const uint64_t pass,
+    std::vector<std::function<void()>> *cbs)
 {
-  std::unique_lock<std::mutex> lk(lock_);
+  for (auto it = refresh_waiters_.begin(); it != refresh_waiters_.end();) {
+    if (it->pass ? pass > *it->pass : epoch > it->epoch) {
+      cbs->push_back(std::move(it->cb));
+      it = refresh_waiters_.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+void Striper::view_notify_(const uint64_t epoch)
+{
+  std::lock_guard<std::mutex> lk(lock_);
   if (shutdown_) {
     return;
   }
-  RefreshWaiter waiter(epoch);
-  // XXX: is it necessary to hold the lock here to ensure that the epoch set
-  // above in waiter is always seen by by the refresh thread, even though the
-  // refresh thread will always grab the lock too to discover the waiter?  need
-  // to go do a quick refresher on the memory consistency semantics.
-  refresh_waiters_.emplace_back(&waiter);
-  refresh_cond_.notify_one();
-  waiter.cond.wait(lk, [&waiter] { return waiter.done; });
+  // an epoch of zero means that the backend doesn't know which views are new
+  if (epoch == 0 || epoch > view_->epoch()) {
+    refresh_pending_ = true;
+    refresher_.kick();
+  }
+}
+
+void Striper::update_current_view(const uint64_t epoch)
+{
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(lock_);
+      if (shutdown_ || view_->epoch() > epoch) {
+        return;
+      }
+    }
+    refresh_();
+  }
+}
+
+bool Striper::update_current_view_async(const uint64_t epoch,
+    std::function<void()> cb)
+{
+  std::lock_guard<std::mutex> lk(lock_);
+  if (shutdown_ || view_->epoch() > epoch) {
+    return true;
+  }
+  refresh_waiters_.push_back(RefreshWaiter{epoch, std::move(cb),
+      boost::none});
+  refresher_.kick();
+  return false;
+}
+
+void Striper::refresh_view_async(std::function<void()> cb)
+{
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (!shutdown_) {
+      refresh_waiters_.push_back(RefreshWaiter{0, std::move(cb),
+          refresh_passes_});
+      refresher_.kick();
+      return;
+    }
+  }
+  cb();
 }
 
 std::string View::create_initial()
@@ -651,26 +1389,27 @@ std::string View::create_initial()
   return blob;
 }
 
-std::string View::serialize() const
+void View::encode_seq(zlog_proto::View *view) const
 {
-  zlog_proto::View view;
-
-  for (const auto& stripe : object_map.stripes()) {
-    auto pb_stripe = view.add_stripes();
-    pb_stripe->set_id(stripe.second.id());
-    pb_stripe->set_width(stripe.second.width());
-    pb_stripe->set_min_position(stripe.first);
-    pb_stripe->set_max_position(stripe.second.max_position());
-  }
-  view.set_next_stripe_id(object_map.next_stripe_id());
-
   if (seq_config) {
-    auto seq = view.mutable_seq();
+    auto seq = view->mutable_seq();
     seq->set_epoch(seq_config->epoch);
     seq->set_secret(seq_config->secret);
     seq->set_position(seq_config->position);
+    if (!seq_config->address.empty()) {
+      seq->set_address(seq_config->address);
+    }
+    if (!seq_config->shm.empty()) {
+      seq->set_shm(seq_config->shm);
+    }
+    if (seq_config->limit) {
+      seq->set_limit(seq_config->limit);
+    }
   }
+}
 
+static std::string serialize_view(const zlog_proto::View& view)
+{
   std::string blob;
   if (!view.SerializeToString(&blob)) {
     std::cerr << "invalid proto" << std::endl << std::flush;
@@ -678,49 +1417,84 @@ std::string View::serialize() const
     exit(1);
     return "";
   }
-
   return blob;
 }
 
-View::View(const std::string& prefix, uint64_t epoch,
-    const zlog_proto::View& view) :
-  epoch_(epoch)
-{
-  std::map<uint64_t, Stripe> stripes;
-  for (auto stripe : view.stripes()) {
-    auto res = stripes.emplace(stripe.min_position(),
-        Stripe(prefix, stripe.id(), stripe.width(), stripe.max_position()));
-    assert(res.second);
-  }
-
-  if (!stripes.empty()) {
-    std::set<uint64_t> ids;
-    auto it = stripes.cbegin();
-    auto it2 = std::next(it);
-    for (; it != stripes.cend(); it++) {
-      assert(it->first <= it->second.max_position());
-      assert(it->second.width() > 0);
-      auto res = ids.emplace(it->second.id());
-      assert(res.second);
-      if (it2 != stripes.cend()) {
-        assert(it->second.max_position() < it2->first);
-	it2++;
-      }
-    }
-    assert(ids.find(view.next_stripe_id()) == ids.end());
+std::string View::serialize() const
+{
+  zlog_proto::View view;
+  object_map.encode(&view);
+  encode_seq(&view);
+  return serialize_view(view);
+}
+
+std::string View::serialize(const View& prev,
+    uint32_t checkpoint_interval, bool *full) const
+{
+  assert(epoch_ == prev.epoch());
+  const auto epoch = prev.epoch() + 1;
+
+  // the zero state view is never stored, so the first view is always full
+  *full = prev.epoch() == 0 ||
+    epoch - prev.checkpoint_epoch() >= checkpoint_interval;
+  if (*full) {
+    return serialize();
   }
 
-  object_map = ObjectMap(view.next_stripe_id(), stripes);
+  zlog_proto::View view;
+  view.set_delta(true);
+  view.set_checkpoint_epoch(prev.checkpoint_epoch());
+  object_map.encode_delta(prev.object_map, &view);
+  encode_seq(&view);
+  return serialize_view(view);
+}
+
+static boost::optional<SequencerConfig> decode_seq(
+    const zlog_proto::View& view)
+{
+  if (!view.has_seq()) {
+    return boost::none;
+  }
+
+  auto seq = view.seq();
+  SequencerConfig conf;
+  conf.epoch = seq.epoch();
+  conf.secret = seq.secret();
+  conf.position = seq.position();
+  conf.address = seq.address();
+  conf.shm = seq.shm();
+  conf.limit = seq.limit();
+  assert(conf.epoch > 0);
+  assert(!conf.secret.empty());
+  return conf;
+}
 
-  if (view.has_seq()) {
-    auto seq = view.seq();
-    SequencerConfig conf;
-    conf.epoch = seq.epoch();
-    conf.secret = seq.secret();
-    conf.position = seq.position();
-    seq_config = conf;
-    assert(seq_config->epoch > 0);
-    assert(!seq_config->secret.empty());
+View::View(const std::string& prefix, uint64_t epoch,
+    const zlog_proto::View& view) :
+  seq_config(decode_seq(view)),
+  epoch_(epoch),
+  checkpoint_epoch_(epoch)
+{
+  assert(!view.delta());
+  object_map = ObjectMap(prefix, view.next_stripe_id());
+  object_map.decode(view);
+}
+
+View::View(const View& prev, uint64_t epoch,
+    const zlog_proto::View& delta) :
+  object_map(prev.object_map),
+  seq_config(prev.seq_config),
+  epoch_(epoch),
+  checkpoint_epoch_(delta.checkpoint_epoch())
+{
+  assert(delta.delta());
+  assert(prev.epoch() + 1 == epoch);
+  assert(checkpoint_epoch_ <= prev.epoch());
+  object_map.decode(delta);
+
+  // a sequencer is never removed from the view
+  if (delta.has_seq()) {
+    seq_config = decode_seq(delta);
   }
 }
 
@@ -1,13 +1,18 @@
 #pragma once
 #include <atomic>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <sstream>
 #include <list>
+#include <vector>
 #include <condition_variable>
 #include <boost/optional.hpp>
 #include "proto/zlog.pb.h"
+#include "util/srcu.h"
+#include "executor.h"
+#include "shared_counter.h"
 
   // don't want to expand mappings on an empty object map (like the zero state)
   // need to figure that out. as it stands map would send caller to
@@ -43,100 +48,182 @@ class Sequencer {
  public:
   explicit Sequencer(uint64_t epoch, uint64_t position) :
     epoch_(epoch),
-    position_(position)
+    local_position_(position),
+    position_(&local_position_)
+  {}
+
+  // a sequencer whose counter is shared with other processes
+  Sequencer(uint64_t epoch, std::unique_ptr<SharedCounter> counter) :
+    epoch_(epoch),
+    local_position_(0),
+    position_(counter->position()),
+    counter_(std::move(counter))
   {}
 
   uint64_t check_tail(bool next) {
     if (next) {
-      return position_.fetch_add(1);
+      return position_->fetch_add(1);
     } else {
-      return position_.load();
+      return position_->load();
     }
   }
 
+  // reserve `count` consecutive positions, returning the first
+  uint64_t reserve(uint64_t count) {
+    return position_->fetch_add(count);
+  }
+
   uint64_t epoch() const {
     return epoch_;
   }
 
  private:
   const uint64_t epoch_;
-  std::atomic<uint64_t> position_;
+  std::atomic<uint64_t> local_position_;
+  std::atomic<uint64_t> *position_;
+  std::unique_ptr<SharedCounter> counter_;
 };
 
+// A stripe is a value computed from the object map on request. Object names
+// aren't stored, and are formatted when they are asked for.
 class Stripe {
  public:
-  Stripe(const std::string& prefix, uint64_t id,
-      uint32_t width, uint64_t max_position) :
+  Stripe(const std::string& prefix, uint64_t id, uint32_t width,
+      uint64_t min_position, uint64_t max_position) :
+    prefix_(prefix),
     id_(id),
-    max_position_(max_position),
-    oids_(make_oids(prefix, id_, width))
+    width_(width),
+    min_position_(min_position),
+    max_position_(max_position)
   {
-    assert(width > 0);
-    assert(!prefix.empty());
-    assert(!oids_.empty());
-  }
-
-  std::string map(uint64_t position) const {
-    const auto index = position % oids_.size();
-    return oids_.at(index);
+    assert(width_ > 0);
+    assert(!prefix_.empty());
+    assert(min_position_ <= max_position_);
   }
 
   uint64_t id() const {
     return id_;
   }
 
+  uint64_t min_position() const {
+    return min_position_;
+  }
+
   uint64_t max_position() const {
     return max_position_;
   }
 
   uint32_t width() const {
-    return oids_.size();
+    return width_;
   }
 
-  const std::vector<std::string>& oids() const {
-    return oids_;
-  }
+  // the name of the object at the given index
+  std::string oid(uint32_t index) const;
 
- private:
-  static std::vector<std::string> make_oids(
-      const std::string& prefix, uint64_t id, uint32_t width);
+  std::vector<std::string> oids() const;
 
-  const uint64_t id_;
+ private:
+  std::string prefix_;
+  uint64_t id_;
+  uint32_t width_;
+  uint64_t min_position_;
   uint64_t max_position_;
-  const std::vector<std::string> oids_;
 };
 
+// identifies the object at `index` within stripe `stripe_id`. the object name
+// is formatted by ObjectMap::oid.
+struct ObjectId {
+  uint64_t stripe_id;
+  uint32_t index;
+
+  bool operator==(const ObjectId& other) const {
+    return stripe_id == other.stripe_id && index == other.index;
+  }
+
+  bool operator<(const ObjectId& other) const {
+    return stripe_id < other.stripe_id ||
+      (stripe_id == other.stripe_id && index < other.index);
+  }
+};
+
+// The object map is stored as a flat array of runs sorted by position. A run
+// is a sequence of stripes with consecutive ids that have the same width and
+// number of entries and cover a contiguous range of positions. Stripes created
+// by expand_mapping with fixed options all fall into a single run, so mapping a
+// position is a search over a handful of runs followed by arithmetic, rather
+// than a search over every stripe. Stripes and object names are not stored,
+// and are only materialized on request.
+//
+// The runs are shared copy-on-write between copies of an object map, so that
+// views derived from one another don't copy the runs that they share.
 class ObjectMap {
  public:
   ObjectMap() :
-    next_stripe_id_(0)
+    next_stripe_id_(0),
+    runs_(std::make_shared<const std::vector<StripeRun>>())
   {}
 
-  ObjectMap(uint64_t next_stripe_id,
-      const std::map<uint64_t, Stripe>& stripes) :
+  ObjectMap(const std::string& prefix, uint64_t next_stripe_id) :
+    prefix_(prefix),
     next_stripe_id_(next_stripe_id),
-    stripes_(stripes)
+    runs_(std::make_shared<const std::vector<StripeRun>>())
   {}
 
  public:
   // returns a pair where the first element is either boost::none if the
-  // position doesn't map, or it is the name of the object that the position
-  // maps to. The second element is true iff the position maps to the last
-  // stripe in the object map.
-  std::pair<boost::optional<std::string>, bool> map(uint64_t position) const;
+  // position doesn't map, or it is the object that the position maps to. The
+  // second element is the number of stripes that follow the stripe that the
+  // position maps to, and is zero if the position maps to the last stripe.
+  std::pair<boost::optional<ObjectId>, uint64_t> map(uint64_t position) const;
+
+  // format the name of an object into oid, reusing its buffer.
+  void oid(const ObjectId& id, std::string *oid) const;
+
+  // format the name of an object into a thread-local buffer. the returned
+  // reference is valid until the next call on the same thread.
+  const std::string& oid(const ObjectId& id) const;
 
   // return the stripe that maps the position.
   boost::optional<Stripe> map_stripe(uint64_t position) const;
 
+  // the number of positions mapped by each stripe in the run that maps the
+  // position, or zero if the position doesn't map.
+  uint64_t stripe_entries(uint64_t position) const;
+
   // expand the mapping to include the given position. true is returned when the
   // mapping changed, and false if the position is already mapped.
   bool expand_mapping(const std::string& prefix, uint64_t position,
       uint32_t stripe_width, uint32_t stripe_slots);
 
-  const std::map<uint64_t, Stripe>& stripes() const {
-    return stripes_;
+  // add a stripe that maps positions after the current maximum position.
+  void add_stripe(uint64_t id, uint32_t width, uint64_t min_position,
+      uint64_t max_position) {
+    add_stripes(id, width, min_position, max_position - min_position + 1, 1);
   }
 
+  // add `count` stripes with consecutive ids, starting at min_position, each
+  // mapping `entries` positions.
+  void add_stripes(uint64_t first_id, uint32_t width, uint64_t min_position,
+      uint64_t entries, uint64_t count);
+
+  size_t num_stripes() const {
+    return runs_->empty() ? 0 :
+      (runs_->back().first_index + runs_->back().count);
+  }
+
+  // serialize the runs into a view
+  void encode(zlog_proto::View *view) const;
+
+  // serialize the runs added since base into a delta view. base must be the
+  // object map that this one was expanded from.
+  void encode_delta(const ObjectMap& base, zlog_proto::View *view) const;
+
+  // restore the runs from a view, or apply a delta view
+  void decode(const zlog_proto::View& view);
+
+  // the i-th stripe, in position order
+  Stripe stripe(size_t i) const;
+
   uint64_t next_stripe_id() const {
     return next_stripe_id_;
   }
@@ -144,14 +231,37 @@ class ObjectMap {
   uint64_t max_position() const;
 
  private:
+  struct StripeRun {
+    uint64_t min_position;
+    uint64_t first_id;
+    // index of the run's first stripe among all stripes
+    uint64_t first_index;
+    uint64_t count;
+    // positions per stripe
+    uint64_t entries;
+    uint32_t width;
+
+    uint64_t max_position() const {
+      return min_position + count * entries - 1;
+    }
+  };
+
+  std::string prefix_;
   uint64_t next_stripe_id_;
-  std::map<uint64_t, Stripe> stripes_;
+  std::shared_ptr<const std::vector<StripeRun>> runs_;
 };
 
 struct SequencerConfig {
   uint64_t epoch;
   std::string secret;
   uint64_t position;
+  // set when the sequencer is run by a sequencer service
+  std::string address;
+  // set when the sequencer's counter is in a shared memory segment
+  std::string shm;
+  // positions at or above the limit have not been written by clients of the
+  // sequencer. zero when there is no limit.
+  uint64_t limit = 0;
 };
 
 // separate configuration from initialization. for instance, after deserializing
@@ -159,27 +269,145 @@ struct SequencerConfig {
 class View {
  public:
   View() :
-    epoch_(0)
+    epoch_(0),
+    checkpoint_epoch_(0)
   {}
 
+  // a view decoded from a full view
   View(const std::string& prefix, uint64_t epoch,
       const zlog_proto::View& view);
 
+  // a view decoded from a delta view, applied to the view at the previous
+  // epoch.
+  View(const View& prev, uint64_t epoch, const zlog_proto::View& delta);
+
   static std::string create_initial();
 
   uint64_t epoch() const {
     return epoch_;
   }
 
+  // epoch of the most recent full view
+  uint64_t checkpoint_epoch() const {
+    return checkpoint_epoch_;
+  }
+
+  // serialize as a full view
   std::string serialize() const;
 
+  // serialize as the view following prev, which this view was copied from and
+  // then modified. the result is a delta view unless a full view is due, in
+  // which case full is set to true.
+  std::string serialize(const View& prev, uint32_t checkpoint_interval,
+      bool *full) const;
+
   ObjectMap object_map;
   boost::optional<SequencerConfig> seq_config;
 
   std::shared_ptr<Sequencer> seq;
 
+  // the sequencer is run by a sequencer service that isn't this instance, and
+  // positions are requested from the service.
+  bool remote_seq() const {
+    return !seq && seq_config && !seq_config->address.empty();
+  }
+
+  // the position can be written without raising the sequencer limit
+  bool seq_limit_covers(uint64_t position) const {
+    return !seq_config || !seq_config->limit || position < seq_config->limit;
+  }
+
  private:
+  void encode_seq(zlog_proto::View *view) const;
+
   const uint64_t epoch_;
+  const uint64_t checkpoint_epoch_;
+};
+
+// A read-side reference to a published view.
+//
+// The view is guaranteed to remain valid until the reference is released
+// (destroyed, reset, or assigned to). Acquiring a reference doesn't take a
+// lock or touch a shared reference count: the current view is loaded from an
+// atomic pointer inside an SRCU read-side critical section, and retired views
+// are reclaimed by the striper once all references that may point to them have
+// been released. References may be held across asynchronous I/O and released
+// on another thread.
+class ViewRef {
+ public:
+  ViewRef() :
+    srcu_(nullptr),
+    idx_(0),
+    core_(0),
+    view_(nullptr)
+  {}
+
+  ViewRef(ViewRef&& other) :
+    srcu_(other.srcu_),
+    idx_(other.idx_),
+    core_(other.core_),
+    view_(other.view_)
+  {
+    other.srcu_ = nullptr;
+    other.view_ = nullptr;
+  }
+
+  ViewRef& operator=(ViewRef&& other) {
+    if (this != &other) {
+      reset();
+      srcu_ = other.srcu_;
+      idx_ = other.idx_;
+      core_ = other.core_;
+      view_ = other.view_;
+      other.srcu_ = nullptr;
+      other.view_ = nullptr;
+    }
+    return *this;
+  }
+
+  ViewRef(const ViewRef&) = delete;
+  ViewRef& operator=(const ViewRef&) = delete;
+
+  ~ViewRef() {
+    reset();
+  }
+
+  void reset() {
+    if (srcu_) {
+      srcu_->read_unlock(idx_, core_);
+      srcu_ = nullptr;
+      view_ = nullptr;
+    }
+  }
+
+  const View *get() const {
+    return view_;
+  }
+
+  const View *operator->() const {
+    assert(view_);
+    return view_;
+  }
+
+  const View& operator*() const {
+    assert(view_);
+    return *view_;
+  }
+
+ private:
+  friend class Striper;
+
+  ViewRef(SRCU *srcu, int idx, size_t core, const View *view) :
+    srcu_(srcu),
+    idx_(idx),
+    core_(core),
+    view_(view)
+  {}
+
+  SRCU *srcu_;
+  int idx_;
+  size_t core_;
+  const View *view_;
 };
 
 class Striper {
@@ -188,81 +416,232 @@ class Striper {
 
   ~Striper();
 
+  // start watching for new views. the watch callback runs background tasks
+  // that read the log's options, so this is called once the log is fully
+  // constructed. shutdown() removes the watch.
+  void start();
   void shutdown();
 
+  // the current view. this takes a lock and copies a shared pointer, and is
+  // meant for background tasks that hold on to a view for a long time or need
+  // a copy. the I/O path uses read_view.
   std::shared_ptr<const View> view() const;
 
-  boost::optional<std::string> map(const std::shared_ptr<const View>& view,
-      uint64_t position);
+  // the current view, without locking or reference counting
+  ViewRef read_view() const {
+    size_t core;
+    const int idx = srcu_.read_lock(&core);
+    return ViewRef(&srcu_, idx, core,
+        current_view_.load(std::memory_order_acquire));
+  }
+
+  boost::optional<ObjectId> map(const View& view, uint64_t position);
 
   // proposes a new log view as a copy of the current view that has been
   // expanded to map the position. no proposal is made if the current view maps
   // the position. if a proposal is made this method doesn't return until the
   // new view (or a newer view) is made active. on success, callers should
   // verify that the position has been mapped, and retry if it is still missing.
+  // concurrent callers share a single proposal.
   int try_expand_view(uint64_t position);
   void async_expand_view(uint64_t position);
 
-  // schedule initialization of the stripe that maps the position.
-  void async_init_stripe(uint64_t position);
+  // like try_expand_view, but doesn't block. true is returned if the current
+  // view maps the position, and cb is not invoked. otherwise false is
+  // returned, and cb is invoked by the view expander once the position is
+  // mapped, or with the error of a failed proposal.
+  bool try_expand_view_async(uint64_t position, std::function<void(int)> cb);
+
+  // schedule initialization of the stripes that map the positions.
+  void async_init_stripes(const std::vector<uint64_t>& positions);
 
   // wait until a view that is newer than the given epoch is read and made
   // active. this is typically used when a backend method (e.g. read, write)
   // returns -ESPIPE indicating that I/O was tagged with an out-of-date epoch,
-  // and the caller should retrieve the latest view.
+  // and the caller should retrieve the latest view. the caller reads the views
+  // itself rather than waiting for the refresh task, which may be queued
+  // behind the caller on the executor.
   void update_current_view(uint64_t epoch);
 
+  // like update_current_view, but doesn't block. true is returned if a view
+  // newer than the given epoch is already active, and cb is not invoked.
+  // otherwise false is returned, and cb is invoked by the refresh task once a
+  // newer view is active.
+  bool update_current_view_async(uint64_t epoch, std::function<void()> cb);
+
+  // read the newest view without blocking, and invoke cb once a refresh that
+  // started after this call has finished, whether or not it found a newer
+  // view.
+  void refresh_view_async(std::function<void()> cb);
+
   // proposes a new view with this log instance configured as the active
   // sequencer. this method waits until the propsoed view (or a newer view) is
   // made active. on success, caller should check the sequencer of the current
   // view and propose again if necessary.
   int propose_sequencer();
 
+  // proposes a new view in which the limit of the view's sequencer is above
+  // the position. the position must not be written until the limit covers it
+  // in the writer's view. no proposal is made if the current view's limit
+  // covers the position, or the current view has a different sequencer, in
+  // which case the caller will obtain a new position anyway. like
+  // try_expand_view, this doesn't return until the new view is active.
+  int raise_seq_limit(const View& view, uint64_t position);
+
+  // like raise_seq_limit, but doesn't block. true is returned if no proposal
+  // is needed, and cb is not invoked. otherwise false is returned, and cb is
+  // invoked once the proposal has finished.
+  bool raise_seq_limit_async(const View& view, uint64_t position,
+      std::function<void(int)> cb);
+
  private:
   mutable std::mutex lock_;
   bool shutdown_;
   LogImpl * const log_;
   const std::string secret_;
 
+  // background work runs as tasks on the log's executor
+  TaskQueue tasks_;
+
  private:
-  // seals the given stripe with the given epoch. on success, *pempty will be
-  // set to true if the stripe is empty (no positions have been written, filled,
-  // etc...), and if the stripe is non-empty, *pposition will be set to the
-  // maximum position written. otherwise it is left unmodified.
-  int seal_stripe(const Stripe& stripe, uint64_t epoch,
-      uint64_t *pposition, bool *pempty) const;
+  struct StripeMaxPos {
+    bool empty;
+    uint64_t position;
+  };
+
+  // seals the objects in the given stripes with the given epoch, and then
+  // reads the maximum position of each object. at most max_inflight_seals
+  // backend requests are issued concurrently. on success, (*max_pos)[i]
+  // describes stripes[i]: empty is true if the stripe is empty (no positions
+  // have been written, filled, etc...), and otherwise position is the maximum
+  // position written.
+  int seal_stripes(const std::vector<Stripe>& stripes, uint64_t epoch,
+      std::vector<StripeMaxPos> *max_pos) const;
+
+  // propose v, a modified copy of current, as the next view
+  int propose_view_(const View& current, const View& v);
+
+  // read the newest view. view_out is set to null if there is no view newer
+  // than current.
+  int read_latest_view_(const std::shared_ptr<const View>& current,
+      std::shared_ptr<View> *view_out) const;
+
+  // make a new view current. requires lock_. the previous view is retired, and
+  // is released once no ViewRef can be referencing it.
+  void publish_view_(std::shared_ptr<const View> view);
 
   std::shared_ptr<const View> view_;
 
+  // view_ published for lock-free readers
+  std::atomic<const View*> current_view_;
+  mutable SRCU srcu_;
+  std::list<std::pair<uint64_t, std::shared_ptr<const View>>> retired_views_;
+
  private:
+  // waits for a view newer than epoch, and then invokes cb. when pass is
+  // set, the waiter instead waits for a refresh pass after that one.
   struct RefreshWaiter {
-    explicit RefreshWaiter(uint64_t epoch) :
+    uint64_t epoch;
+    std::function<void()> cb;
+    boost::optional<uint64_t> pass;
+  };
+
+  // wake up the waiters that are waiting for a view newer than their epoch.
+  // requires lock_. the callbacks are returned through cbs, to be invoked after
+  // lock_ is released.
+  void wake_refresh_waiters_(uint64_t epoch, uint64_t pass,
+      std::vector<std::function<void()>> *cbs);
+
+  // log replay (read and activate views). refresh_ reads the newest view once,
+  // and refresh_lock_ keeps passes from racing to publish views.
+  void refresh_();
+  std::mutex refresh_lock_;
+  std::list<RefreshWaiter> refresh_waiters_;
+  // number of refresh passes that have started
+  uint64_t refresh_passes_;
+
+  // set when the backend reports a new view. the refresh task installs the new
+  // view without waiting for a client to find a stale epoch.
+  void view_notify_(uint64_t epoch);
+  bool refresh_pending_;
+  boost::optional<uint64_t> view_watch_;
+
+  // refreshes while there are waiters or a refresh is pending
+  void refresh_entry_();
+  SerialTask refresher_;
+
+  // an expansion proposal in flight. callers of try_expand_view whose position
+  // is covered by the proposal wait for it to finish rather than making their
+  // own proposal.
+  struct Expansion {
+    explicit Expansion(uint64_t position) :
+      position(position),
       done(false),
-      epoch(epoch)
+      ret(0)
     {}
 
+    const uint64_t position;
     bool done;
-    const uint64_t epoch;
+    int ret;
     std::condition_variable cond;
   };
 
-  // log replay (read and activate views)
-  void refresh_entry_();
-  std::list<RefreshWaiter*> refresh_waiters_;
-  std::condition_variable refresh_cond_;
-  std::thread refresh_thread_;
+  int expand_view_(uint64_t position);
+  // try_expand_view. the view expander passes sync = false so that its
+  // expansions aren't counted as expansions in the I/O path.
+  int expand_or_join_(uint64_t position, bool sync);
+  std::shared_ptr<Expansion> expansion_;
+  // largest position requested while a proposal was in flight
+  uint64_t expand_request_;
+
+  // serializes raise_seq_limit proposals. concurrent callers wait for the
+  // proposal in flight, and then usually find their position covered.
+  std::mutex seq_limit_lock_;
+  int raise_seq_limit_(uint64_t seq_epoch, uint64_t position);
 
   // async view expansion
   boost::optional<uint64_t> expand_pos_;
-  std::condition_variable expander_cond_;
   void expander_entry_();
-  std::thread expander_thread_;
+  SerialTask expander_;
+
+  // try_expand_view_async callers waiting for their positions to be mapped.
+  // they are completed with the error when a proposal fails.
+  std::vector<std::pair<uint64_t,
+    std::function<void(int)>>> expand_waiters_;
+  void complete_expand_waiters_(int ret);
+
+  // raise_seq_limit_async callers, by the epoch of the sequencer whose limit
+  // they need raised.
+  struct SeqLimitWaiter {
+    uint64_t seq_epoch;
+    uint64_t position;
+    std::function<void(int)> cb;
+  };
+  std::vector<SeqLimitWaiter> seq_limit_waiters_;
+  void seq_limit_entry_();
+  SerialTask seq_limit_raiser_;
 
   // async stripe initilization
   std::list<uint64_t> stripe_init_pos_;
-  std::condition_variable stripe_init_cond_;
   void stripe_init_entry_();
-  std::thread stripe_init_thread_;
+  SerialTask stripe_initializer_;
+
+  // async sealing of the stripes that can't contain the maximum position
+  // during a sequencer takeover. only the newest job is kept, since sealing
+  // with a newer epoch supersedes an older job.
+  struct SealJob {
+    std::shared_ptr<const View> view;
+    uint64_t epoch;
+    // seal the stripes, except the range [scanned_begin, scanned_end) of
+    // stripes that were sealed while looking for the maximum position.
+    size_t scanned_begin;
+    size_t scanned_end;
+  };
+
+  void async_seal_stripes(const SealJob& job);
+  boost::optional<SealJob> seal_job_;
+  void sealer_entry_();
+  SerialTask sealer_;
 };
 
 }
@@ -0,0 +1,180 @@
+#include <cerrno>
+#include <numeric>
+#include <set>
+#include <string>
+#include "gtest/gtest.h"
+#include "zlog/cache.h"
+#include "zlog/eviction/clock.h"
+#include "zlog/eviction/s3fifo.h"
+#include "zlog/options.h"
+
+// entries removed by trims and fills free their slots even when nothing is
+// ever evicted
+TEST(S3FIFO, RemoveChurn) {
+  zlog::S3FIFO eviction;
+  for (uint64_t pos = 0; pos < 10000; pos++) {
+    ASSERT_EQ(eviction.cache_put_miss(pos), 0);
+    if (pos >= 10) {
+      ASSERT_EQ(eviction.cache_remove(pos - 10), 0);
+    }
+  }
+  ASSERT_LE(eviction.num_slots(), 64u);
+
+  // the remaining entries are evicted in insertion order
+  for (uint64_t pos = 9990; pos < 10000; pos++) {
+    uint64_t evicted;
+    ASSERT_EQ(eviction.get_evicted(&evicted), 0);
+    ASSERT_EQ(evicted, pos);
+  }
+  uint64_t evicted;
+  ASSERT_EQ(eviction.get_evicted(&evicted), -ENOENT);
+}
+
+TEST(CLOCK, SecondChance) {
+  zlog::CLOCK eviction;
+  for (uint64_t pos = 0; pos < 4; pos++) {
+    ASSERT_EQ(eviction.cache_put_miss(pos), 0);
+  }
+
+  uint64_t pos = 0;
+  ASSERT_EQ(eviction.cache_get_hit(&pos), 0);
+
+  // the referenced entry is passed over once and evicted last
+  for (uint64_t expected : {1, 2, 3, 0}) {
+    uint64_t evicted;
+    ASSERT_EQ(eviction.get_evicted(&evicted), 0);
+    ASSERT_EQ(evicted, expected);
+  }
+  uint64_t evicted;
+  ASSERT_EQ(eviction.get_evicted(&evicted), -ENOENT);
+}
+
+TEST(CLOCK, Remove) {
+  zlog::CLOCK eviction;
+  ASSERT_EQ(eviction.cache_remove(5), -1);
+
+  ASSERT_EQ(eviction.cache_put_miss(5), 0);
+  ASSERT_EQ(eviction.cache_put_miss(6), 0);
+  ASSERT_EQ(eviction.cache_remove(5), 0);
+  ASSERT_EQ(eviction.cache_remove(5), -1);
+
+  uint64_t pos = 5;
+  ASSERT_EQ(eviction.cache_get_hit(&pos), -1);
+
+  uint64_t evicted;
+  ASSERT_EQ(eviction.get_evicted(&evicted), 0);
+  ASSERT_EQ(evicted, 6u);
+  ASSERT_EQ(eviction.get_evicted(&evicted), -ENOENT);
+}
+
+// removed entries free their slots, so only live entries are evicted
+TEST(CLOCK, RemoveChurn) {
+  zlog::CLOCK eviction;
+  for (uint64_t pos = 0; pos < 10000; pos++) {
+    ASSERT_EQ(eviction.cache_put_miss(pos), 0);
+    if (pos >= 10) {
+      ASSERT_EQ(eviction.cache_remove(pos - 10), 0);
+    }
+  }
+
+  std::set<uint64_t> evicted;
+  uint64_t pos;
+  while (eviction.get_evicted(&pos) == 0) {
+    ASSERT_TRUE(evicted.insert(pos).second);
+  }
+
+  std::set<uint64_t> expected;
+  for (uint64_t pos = 9990; pos < 10000; pos++) {
+    expected.insert(pos);
+  }
+  ASSERT_EQ(evicted, expected);
+}
+
+static size_t total_capacity(zlog::Cache& cache)
+{
+  const auto stats = cache.shard_stats();
+  return std::accumulate(stats.begin(), stats.end(), (size_t)0,
+      [](size_t total, const zlog::Cache::ShardStats& s) {
+        return total + s.capacity;
+      });
+}
+
+TEST(Cache, CapacitySplit) {
+  zlog::Options options;
+  options.cache_size = 16 * zlog::Cache::kMinShardCapacity + 3;
+  options.cache_num_shards = 16;
+
+  zlog::Cache cache(options);
+  const auto stats = cache.shard_stats();
+  ASSERT_EQ(stats.size(), 16u);
+  ASSERT_EQ(total_capacity(cache), options.cache_size);
+  for (const auto& s : stats) {
+    ASSERT_GE(s.capacity, zlog::Cache::kMinShardCapacity);
+    ASSERT_LE(s.capacity, zlog::Cache::kMinShardCapacity + 1);
+  }
+}
+
+TEST(Cache, NumShardsRoundedUp) {
+  zlog::Options options;
+  options.cache_size = 64 * zlog::Cache::kMinShardCapacity;
+  options.cache_num_shards = 5;
+
+  zlog::Cache cache(options);
+  ASSERT_EQ(cache.shard_stats().size(), 8u);
+  ASSERT_EQ(total_capacity(cache), options.cache_size);
+}
+
+// a cache too small to split keeps every byte of its capacity usable
+TEST(Cache, SmallCacheFewerShards) {
+  zlog::Options options;
+  options.cache_size = 10;
+  options.cache_num_shards = 16;
+
+  {
+    zlog::Cache cache(options);
+    const auto stats = cache.shard_stats();
+    ASSERT_EQ(stats.size(), 1u);
+    ASSERT_EQ(stats[0].capacity, 10u);
+  }
+
+  const std::string data(100, 'x');
+  options.cache_size = 4 * zlog::Cache::charge(data.size());
+  zlog::Cache cache(options);
+  ASSERT_EQ(total_capacity(cache), options.cache_size);
+
+  for (uint64_t pos = 0; pos < 4; pos++) {
+    ASSERT_EQ(cache.put(pos, data), 0);
+  }
+  for (uint64_t pos = 0; pos < 4; pos++) {
+    uint64_t p = pos;
+    std::string out;
+    ASSERT_EQ(cache.get(&p, &out), 0);
+    ASSERT_EQ(out, data);
+  }
+}
+
+TEST(Cache, EvictsWithinShardCapacity) {
+  for (auto policy : {zlog::Eviction::Eviction_Policy::LRU,
+                      zlog::Eviction::Eviction_Policy::ARC,
+                      zlog::Eviction::Eviction_Policy::CLOCK,
+                      zlog::Eviction::Eviction_Policy::S3FIFO}) {
+    zlog::Options options;
+    options.eviction = policy;
+    options.cache_size = 4 * zlog::Cache::kMinShardCapacity;
+    options.cache_num_shards = 4;
+
+    zlog::Cache cache(options);
+    const std::string data(100, 'x');
+    for (uint64_t pos = 0; pos < 10000; pos++) {
+      ASSERT_EQ(cache.put(pos, data), 0);
+    }
+
+    const auto stats = cache.shard_stats();
+    ASSERT_EQ(stats.size(), 4u);
+    for (const auto& s : stats) {
+      ASSERT_GT(s.entries, 0u);
+      ASSERT_LE(s.bytes, s.capacity);
+      ASSERT_GT(s.evictions, 0u);
+    }
+  }
+}
@@ -1,5 +1,15 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <numeric>
 #include <deque>
+#include <set>
+#include <thread>
+#include "zlog/backend.h"
+#include "zlog/executor.h"
+#include "libseq/libseqr.h"
+#include "libzlog/log_impl.h"
+#include "libzlog/seqr_service.h"
 #include "test_libzlog.h"
 
 // TODO
@@ -49,6 +59,79 @@ TEST_P(LibZLogTest, OpenClose) {
   ASSERT_EQ(input, output);
 }
 
+TEST_P(LibZLogTest, TakeoverManyStripes) {
+  if (backend() != "lmdb") {
+    std::cout << "TakeoverManyStripes test not enabled for "
+      << backend() << " backend" << std::endl;
+    return;
+  }
+
+  uint64_t pos;
+  int ret = log->Append("data", &pos);
+  ASSERT_EQ(ret, 0);
+
+  // map enough empty stripes after the tail that a takeover has to scan back
+  // through several groups of stripes to find the maximum position.
+  const uint64_t stripe_entries =
+    (uint64_t)options.stripe_width * options.stripe_slots;
+  const uint64_t num_stripes = 4 * options.max_inflight_seals;
+
+  std::string data;
+  ret = log->Read(num_stripes * stripe_entries, &data);
+  ASSERT_EQ(ret, -ERANGE);
+
+  ret = reopen();
+  ASSERT_EQ(ret, 0);
+
+  uint64_t tail;
+  ret = log->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, pos + 1);
+
+  ret = log->Append("data", &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, tail);
+}
+
+TEST_P(LibZLogTest, CatchUpViews) {
+  // each fill maps a new stripe, so a view is proposed for every fill. most of
+  // these views are written as deltas.
+  const uint64_t stripe_entries =
+    (uint64_t)options.stripe_width * options.stripe_slots;
+  const uint64_t num_stripes = 3 * options.view_checkpoint_interval + 5;
+
+  for (uint64_t i = 0; i < num_stripes; i++) {
+    int ret = log->Fill(i * stripe_entries);
+    ASSERT_EQ(ret, 0);
+  }
+
+  std::string data;
+  for (uint64_t i = 0; i < num_stripes; i++) {
+    int ret = log->Read(i * stripe_entries, &data);
+    ASSERT_EQ(ret, -ENODATA);
+  }
+
+  if (backend() != "lmdb") {
+    std::cout << "CatchUpViews reopen not enabled for "
+      << backend() << " backend" << std::endl;
+    return;
+  }
+
+  // a new client catches up from the most recent full view
+  int ret = reopen();
+  ASSERT_EQ(ret, 0);
+
+  for (uint64_t i = 0; i < num_stripes; i++) {
+    ret = log->Read(i * stripe_entries, &data);
+    ASSERT_EQ(ret, -ENODATA);
+  }
+
+  uint64_t pos;
+  ret = log->Append("data", &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_GT(pos, (num_stripes - 1) * stripe_entries);
+}
+
 /*
  * Use a log name other than `mylog` below because the test fixture
  * automatically creates a log with that name before the test is run. The other
@@ -110,6 +193,98 @@ TEST_P(LibZLogTest, CheckTail) {
   ASSERT_EQ(pos, (unsigned)0);
 }
 
+TEST_P(LibZLogTest, PeekTail) {
+  uint64_t pos;
+  int ret = log->PeekTail(0, &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, (unsigned)0);
+
+  // span several stripes
+  for (int i = 0; i < 120; i++) {
+    ret = log->Append(std::string(), &pos);
+    ASSERT_EQ(ret, 0);
+
+    uint64_t tail;
+    ret = log->PeekTail(0, &tail);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(tail, pos + 1);
+  }
+
+  uint64_t tail;
+  ret = log->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, pos + 1);
+
+  // a cached result may be returned within the staleness bound
+  uint64_t cached;
+  ret = log->PeekTail(60000000, &cached);
+  ASSERT_EQ(ret, 0);
+  ret = log->Append(std::string(), &pos);
+  ASSERT_EQ(ret, 0);
+  ret = log->PeekTail(60000000, &tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, cached);
+  ret = log->PeekTail(0, &tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, pos + 1);
+}
+
+TEST_P(LibZLogTest, PeekTailNoTakeover) {
+  // peeking from an instance that isn't the sequencer doesn't take over
+  std::shared_ptr<zlog::Backend> be;
+  int ret = zlog::Backend::Load(backend(), {}, be);
+  ASSERT_EQ(ret, 0);
+
+  zlog::Options opts;
+  opts.backend = be;
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+
+  zlog::Log *l;
+  ret = zlog::Log::Open(opts, "peek", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> a(l);
+
+  uint64_t pos;
+  for (int i = 0; i < 10; i++) {
+    ret = a->Append(std::string(), &pos);
+    ASSERT_EQ(ret, 0);
+  }
+
+  opts.create_if_missing = false;
+  opts.error_if_exists = false;
+  ret = zlog::Log::Open(opts, "peek", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> b(l);
+  auto b_impl = static_cast<zlog::LogImpl*>(b.get());
+
+  // the epoch of the sequencer's view
+  const auto epoch =
+    static_cast<zlog::LogImpl*>(a.get())->striper.read_view()->epoch();
+
+  uint64_t tail;
+  ret = b->PeekTail(0, &tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, pos + 1);
+
+  {
+    const auto view = b_impl->striper.read_view();
+    ASSERT_EQ(view->epoch(), epoch);
+    ASSERT_FALSE(view->seq);
+  }
+
+  // the sequencer is undisturbed
+  ret = a->Append(std::string(), &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, tail);
+  {
+    const auto view =
+      static_cast<zlog::LogImpl*>(a.get())->striper.read_view();
+    ASSERT_TRUE(view->seq);
+    ASSERT_EQ(view->epoch(), epoch);
+  }
+}
+
 TEST_P(LibZLogTest, Append) {
   // this basic test does a series and also checks if checktail is returning an
   // updated tail. we do an append here first because it may be that internally
@@ -153,6 +328,406 @@ TEST_P(LibZLogTest, Append) {
   ASSERT_GT(pos2, pos);
 }
 
+TEST_P(LibZLogTest, SharedExecutor) {
+  // several logs sharing a single thread all make progress
+  auto executor = std::make_shared<zlog::Executor>(1);
+
+  std::vector<zlog::Log*> logs;
+  for (int i = 0; i < 4; i++) {
+    zlog::Options opts = options;
+    opts.executor = executor;
+    opts.executor_quantum = 2;
+    opts.create_if_missing = true;
+    opts.error_if_exists = true;
+    zlog::Log *l;
+    int ret = zlog::Log::Open(opts, "shared" + std::to_string(i), &l);
+    ASSERT_EQ(ret, 0);
+    logs.push_back(l);
+  }
+
+  const int count = 50;
+  std::mutex lock;
+  std::condition_variable cond;
+  int done = 0;
+  int failed = 0;
+  for (int i = 0; i < count; i++) {
+    for (auto l : logs) {
+      int ret = l->appendAsync("data", [&](int ret, uint64_t position) {
+        std::lock_guard<std::mutex> lk(lock);
+        if (ret) {
+          failed++;
+        }
+        done++;
+        cond.notify_one();
+      });
+      ASSERT_EQ(ret, 0);
+    }
+  }
+
+  {
+    std::unique_lock<std::mutex> lk(lock);
+    cond.wait(lk, [&] { return done == count * (int)logs.size(); });
+  }
+  ASSERT_EQ(failed, 0);
+
+  for (auto l : logs) {
+    uint64_t tail;
+    int ret = l->CheckTail(&tail);
+    ASSERT_EQ(ret, 0);
+    ASSERT_GE(tail, (uint64_t)count);
+
+    std::string data;
+    ret = l->Read(tail - 1, &data);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(data, "data");
+  }
+
+  for (auto l : logs) {
+    delete l;
+  }
+}
+
+TEST_P(LibZLogTest, RemoteSequencer) {
+  // the service and the client share a backend instance
+  std::shared_ptr<zlog::Backend> be;
+  int ret = zlog::Backend::Load(backend(), {}, be);
+  ASSERT_EQ(ret, 0);
+
+  std::unique_ptr<zlog::SeqrService> service;
+  zlog::SeqrServer server("127.0.0.1", 0, 2, [&] {
+    return service->NewSession();
+  });
+
+  zlog::Options opts;
+  opts.backend = be;
+  opts.seqr_address = "127.0.0.1:" + std::to_string(server.port());
+  service.reset(new zlog::SeqrService(opts));
+  server.start();
+
+  // the connections to a stopped server stay open, so the client notices
+  // that the service is gone when its requests time out.
+  opts.seqr_address.clear();
+  opts.seqr_timeout_ms = 200;
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+  zlog::Log *l;
+  ret = zlog::Log::Open(opts, "remote", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> client(l);
+
+  ret = service->Serve("remote");
+  ASSERT_EQ(ret, 0);
+
+  uint64_t tail;
+  ret = client->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, 0u);
+
+  for (uint64_t i = 0; i < 20; i++) {
+    uint64_t pos;
+    ret = client->Append("data" + std::to_string(i), &pos);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(pos, i);
+  }
+
+  ret = client->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, 20u);
+
+  // every tail request went through the service
+  ASSERT_GE(server.num_requests(), 22u);
+
+  for (uint64_t i = 0; i < 20; i++) {
+    std::string data;
+    ret = client->Read(i, &data);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(data, "data" + std::to_string(i));
+  }
+
+  // the client takes over when the service goes away
+  server.stop();
+  service.reset();
+
+  uint64_t pos;
+  ret = client->Append("data", &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, 20u);
+
+  {
+    const auto view =
+      static_cast<zlog::LogImpl*>(client.get())->striper.read_view();
+    ASSERT_TRUE(view->seq);
+  }
+
+  client.reset();
+}
+
+TEST_P(LibZLogTest, RemoteSequencerDeposed) {
+  std::shared_ptr<zlog::Backend> be;
+  int ret = zlog::Backend::Load(backend(), {}, be);
+  ASSERT_EQ(ret, 0);
+
+  std::unique_ptr<zlog::SeqrService> service;
+  zlog::SeqrServer server("127.0.0.1", 0, 1, [&] {
+    return service->NewSession();
+  });
+
+  zlog::Options opts;
+  opts.backend = be;
+  opts.seqr_address = "127.0.0.1:" + std::to_string(server.port());
+  service.reset(new zlog::SeqrService(opts));
+  server.start();
+
+  opts.seqr_address.clear();
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+  zlog::Log *l;
+  ret = zlog::Log::Open(opts, "deposed", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> other(l);
+  auto other_impl = static_cast<zlog::LogImpl*>(other.get());
+
+  ret = service->Serve("deposed");
+  ASSERT_EQ(ret, 0);
+
+  uint64_t tail;
+  ret = other->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+
+  uint64_t epoch;
+  {
+    const auto view = other_impl->striper.read_view();
+    ASSERT_TRUE(view->remote_seq());
+    epoch = view->seq_config->epoch;
+  }
+
+  // the sessions of both channels have the sequencer cached
+  zlog::SeqrClient client("127.0.0.1", std::to_string(server.port()));
+  ret = client.Connect();
+  ASSERT_EQ(ret, 0);
+  for (int i = 0; i < 4; i++) {
+    uint64_t pos;
+    ret = client.CheckTail(epoch, "deposed", &pos, true);
+    ASSERT_EQ(ret, 0);
+  }
+
+  // another instance takes over, and once the service has seen the new view
+  // it stops handing out positions in the old epoch.
+  ret = other_impl->striper.propose_sequencer();
+  ASSERT_EQ(ret, 0);
+
+  bool rejected = false;
+  for (int i = 0; i < 1000 && !rejected; i++) {
+    uint64_t pos;
+    ret = client.CheckTail(epoch, "deposed", &pos, true);
+    if (ret) {
+      ASSERT_TRUE(ret == -EAGAIN || ret == -ERANGE);
+      rejected = true;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  ASSERT_TRUE(rejected);
+
+  other.reset();
+  server.stop();
+  service.reset();
+}
+
+TEST_P(LibZLogTest, SharedMemorySequencer) {
+  // the logs share a backend instance, like processes on a host that share
+  // storage, and take turns appending without taking over from each other.
+  std::shared_ptr<zlog::Backend> be;
+  int ret = zlog::Backend::Load(backend(), {}, be);
+  ASSERT_EQ(ret, 0);
+
+  zlog::Options opts;
+  opts.backend = be;
+  opts.shm_sequencer = true;
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+
+  zlog::Log *l;
+  ret = zlog::Log::Open(opts, "shm", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> a(l);
+
+  uint64_t pos;
+  ret = a->Append("data0", &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, 0u);
+
+  uint64_t epoch;
+  std::string shm;
+  {
+    const auto view =
+      static_cast<zlog::LogImpl*>(a.get())->striper.read_view();
+    epoch = view->epoch();
+    ASSERT_TRUE(view->seq_config);
+    shm = view->seq_config->shm;
+    ASSERT_FALSE(shm.empty());
+  }
+
+  opts.create_if_missing = false;
+  opts.error_if_exists = false;
+  ret = zlog::Log::Open(opts, "shm", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> b(l);
+
+  for (uint64_t i = 1; i < 20; i++) {
+    auto& log = (i % 2) ? b : a;
+    ret = log->Append("data" + std::to_string(i), &pos);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(pos, i);
+  }
+
+  uint64_t tail;
+  ret = b->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, 20u);
+
+  // neither log took over
+  for (auto log : {a.get(), b.get()}) {
+    auto impl = static_cast<zlog::LogImpl*>(log);
+    ASSERT_EQ(impl->striper.read_view()->epoch(), epoch);
+  }
+
+  for (uint64_t i = 0; i < 20; i++) {
+    std::string data;
+    ret = a->Read(i, &data);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(data, "data" + std::to_string(i));
+  }
+
+  a.reset();
+  b.reset();
+  zlog::SharedCounter::remove(shm);
+}
+
+TEST_P(LibZLogTest, SeqLimit) {
+  // stripes are mapped well ahead of the tail, and a new sequencer only looks
+  // for the tail below the limit.
+  std::shared_ptr<zlog::Backend> be;
+  int ret = zlog::Backend::Load(backend(), {}, be);
+  ASSERT_EQ(ret, 0);
+
+  zlog::Options opts;
+  opts.backend = be;
+  opts.seq_limit_stripes = 1;
+  opts.stripe_lookahead = 8;
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+
+  const uint64_t stripe_entries =
+    (uint64_t)opts.stripe_width * opts.stripe_slots;
+
+  zlog::Log *l;
+  ret = zlog::Log::Open(opts, "limit", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> a(l);
+
+  const uint64_t count = 3 * stripe_entries;
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t pos;
+    ret = a->Append("data", &pos);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(pos, i);
+  }
+
+  {
+    const auto view =
+      static_cast<zlog::LogImpl*>(a.get())->striper.read_view();
+    ASSERT_TRUE(view->seq_config);
+    ASSERT_GE(view->seq_config->limit, count);
+    ASSERT_LE(view->seq_config->limit, count + stripe_entries);
+  }
+
+  opts.create_if_missing = false;
+  opts.error_if_exists = false;
+  ret = zlog::Log::Open(opts, "limit", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> b(l);
+
+  uint64_t tail;
+  ret = b->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, count);
+
+  // a fill past the limit raises it, so the next sequencer finds the fill
+  const uint64_t fill_pos = count + 3 * stripe_entries;
+  ret = b->Fill(fill_pos);
+  ASSERT_EQ(ret, 0);
+
+  ret = zlog::Log::Open(opts, "limit", &l);
+  ASSERT_EQ(ret, 0);
+  std::unique_ptr<zlog::Log> c(l);
+
+  ret = c->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, fill_pos + 1);
+
+  uint64_t pos;
+  ret = c->Append("data", &pos);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(pos, fill_pos + 1);
+}
+
+TEST_P(LibZLogTest, AppendBatch) {
+  std::vector<uint64_t> positions;
+  int ret = log->AppendBatch({}, &positions);
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(positions.empty());
+
+  // large enough to span several stripes
+  std::vector<std::string> entries;
+  for (int i = 0; i < 500; i++) {
+    entries.push_back(std::to_string(i));
+  }
+
+  ret = log->AppendBatch(entries, &positions);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(positions.size(), entries.size());
+  for (size_t i = 1; i < positions.size(); i++) {
+    ASSERT_EQ(positions[i], positions[i-1] + 1);
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    std::string entry;
+    ret = log->Read(positions[i], &entry);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(entry, entries[i]);
+  }
+
+  uint64_t tail;
+  ret = log->CheckTail(&tail);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(tail, positions.back() + 1);
+
+  // an entry whose reserved position is filled is given a new position
+  ret = log->Fill(tail + 2);
+  ASSERT_EQ(ret, 0);
+
+  entries = {"a", "b", "c", "d", "e"};
+  ret = log->AppendBatch(entries, &positions);
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(positions.size(), entries.size());
+
+  std::set<uint64_t> unique(positions.begin(), positions.end());
+  ASSERT_EQ(unique.size(), entries.size());
+  ASSERT_EQ(unique.count(tail + 2), 0u);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    std::string entry;
+    ret = log->Read(positions[i], &entry);
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(entry, entries[i]);
+  }
+
+  std::string entry;
+  ret = log->Read(tail + 2, &entry);
+  ASSERT_EQ(ret, -ENODATA);
+}
+
 TEST_P(LibZLogTest, Fill) {
   int ret = log->Fill(0);
   ASSERT_EQ(ret, 0);
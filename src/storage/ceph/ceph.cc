@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <sstream>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
@@ -29,6 +30,17 @@ CephBackend::CephBackend(librados::IoCtx *ioctx) :
 
 CephBackend::~CephBackend()
 {
+  std::vector<uint64_t> handles;
+  {
+    std::lock_guard<std::mutex> lk(watch_lock_);
+    for (const auto& watch : watches_) {
+      handles.push_back(watch.first);
+    }
+  }
+  for (auto handle : handles) {
+    UnwatchViews(handle);
+  }
+
   // cluster_ is only non-null when it was created via Initialize() in which
   // case the backend owns both the cluster and ioctx and needs to release them.
   if (cluster_) {
@@ -297,6 +309,50 @@ int CephBackend::ReadViews(const std::string& hoid, uint64_t epoch,
   return 0;
 }
 
+int CephBackend::ReadLatestView(const std::string& hoid,
+    uint64_t *epoch_out, std::string *view_out)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectReadOperation op;
+  zlog::cls_zlog_read_latest_view(op);
+  ::ceph::bufferlist bl;
+  int ret = ioctx_->operate(hoid, &op, &bl);
+  if (ret) {
+    return ret;
+  }
+
+  zlog_ceph_proto::Views views;
+  if (!decode(bl, &views)) {
+    return -EIO;
+  }
+
+  if (views.views_size() == 0) {
+    *epoch_out = 0;
+    view_out->clear();
+  } else {
+    assert(views.views_size() == 1);
+    const auto& view = views.views(0);
+    *epoch_out = view.epoch();
+    view_out->assign(view.data().c_str(), view.data().size());
+  }
+
+  return 0;
+}
+
+int CephBackend::TrimViews(const std::string& hoid, uint64_t epoch)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_trim_views(op, epoch);
+  return ioctx_->operate(hoid, &op);
+}
+
 int CephBackend::ProposeView(const std::string& hoid,
     uint64_t epoch, const std::string& view)
 {
@@ -309,6 +365,95 @@ int CephBackend::ProposeView(const std::string& hoid,
   librados::ObjectWriteOperation op;
   zlog::cls_zlog_create_view(op, epoch, bl);
   int ret = ioctx_->operate(hoid, &op);
+  if (ret) {
+    return ret;
+  }
+
+  // wake up the clients watching the head object. notifications are only
+  // hints, so this doesn't wait for the watchers to acknowledge.
+  ::ceph::bufferlist notify_bl;
+  const auto epoch_str = std::to_string(epoch);
+  notify_bl.append(epoch_str.c_str(), epoch_str.size());
+  auto c = librados::Rados::aio_create_completion();
+  ret = ioctx_->aio_notify(hoid, c, notify_bl, 10000, nullptr);
+  c->release();
+  if (ret) {
+    std::cerr << "view notify error " << ret << std::endl;
+  }
+
+  return 0;
+}
+
+struct CephBackend::ViewWatch : public librados::WatchCtx2 {
+  ViewWatch(librados::IoCtx *ioctx, const std::string& hoid,
+      std::function<void(uint64_t)> cb) :
+    ioctx(ioctx),
+    hoid(hoid),
+    cb(cb)
+  {}
+
+  void handle_notify(uint64_t notify_id, uint64_t cookie,
+      uint64_t notifier_id, ::ceph::bufferlist& bl) override {
+    uint64_t epoch = 0;
+    if (bl.length()) {
+      epoch = std::strtoull(bl.to_str().c_str(), NULL, 10);
+    }
+    ::ceph::bufferlist reply;
+    ioctx->notify_ack(hoid, notify_id, cookie, reply);
+    cb(epoch);
+  }
+
+  // the watch was disconnected, and new views may have been missed. librados
+  // re-establishes the watch, and the client is told to look for new views.
+  void handle_error(uint64_t cookie, int err) override {
+    cb(0);
+  }
+
+  librados::IoCtx *ioctx;
+  const std::string hoid;
+  const std::function<void(uint64_t)> cb;
+};
+
+int CephBackend::WatchViews(const std::string& hoid,
+    std::function<void(uint64_t epoch)> cb, uint64_t *handle_out)
+{
+  if (hoid.empty() || !cb) {
+    return -EINVAL;
+  }
+
+  std::unique_ptr<ViewWatch> watch(new ViewWatch(ioctx_, hoid, cb));
+  uint64_t cookie;
+  int ret = ioctx_->watch2(hoid, &cookie, watch.get());
+  if (ret) {
+    return ret;
+  }
+
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  watches_.emplace(cookie, std::move(watch));
+  *handle_out = cookie;
+
+  return 0;
+}
+
+int CephBackend::UnwatchViews(uint64_t handle)
+{
+  std::unique_ptr<ViewWatch> watch;
+  {
+    std::lock_guard<std::mutex> lk(watch_lock_);
+    auto it = watches_.find(handle);
+    if (it == watches_.end()) {
+      return -ENOENT;
+    }
+    watch = std::move(it->second);
+    watches_.erase(it);
+  }
+
+  int ret = ioctx_->unwatch2(handle);
+
+  // wait for callbacks that are already queued before releasing the context
+  librados::Rados cluster(*ioctx_);
+  cluster.watch_flush();
+
   return ret;
 }
 
@@ -384,6 +529,17 @@ int CephBackend::Seal(const std::string& oid, uint64_t epoch)
   return ioctx_->operate(oid, &op);
 }
 
+int CephBackend::InitObject(const std::string& oid, uint64_t epoch)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_init_entry(op, epoch);
+  return ioctx_->operate(oid, &op);
+}
+
 int CephBackend::MaxPos(const std::string& oid, uint64_t epoch,
     uint64_t *position_out, bool *empty_out)
 {
@@ -413,6 +569,234 @@ int CephBackend::MaxPos(const std::string& oid, uint64_t epoch,
   return 0;
 }
 
+int CephBackend::PeekMaxPos(const std::string& oid, uint64_t *position_out,
+    bool *empty_out)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectReadOperation op;
+  zlog::cls_zlog_peek_max_position(op);
+
+  ::ceph::bufferlist bl;
+  int ret = ioctx_->operate(oid, &op, &bl);
+  if (ret) {
+    return ret;
+  }
+
+  zlog_ceph_proto::MaxPos reply;
+  if (!decode(bl, &reply)) {
+    return -EIO;
+  }
+
+  *empty_out = !reply.has_pos();
+  if (reply.has_pos()) {
+    *position_out = reply.pos();
+  }
+
+  return 0;
+}
+
+// state for an in-flight asynchronous operation. the context is released by
+// the librados completion callback after the caller's callback runs.
+struct CephBackend::AioContext {
+  explicit AioContext(std::function<void(int)> cb) :
+    cb(cb),
+    data(nullptr),
+    pos(nullptr),
+    empty(nullptr),
+    c(nullptr)
+  {}
+
+  std::function<void(int)> cb;
+  std::string *data;
+  uint64_t *pos;
+  bool *empty;
+  ::ceph::bufferlist bl;
+  librados::AioCompletion *c;
+};
+
+void CephBackend::aio_complete(librados::completion_t c, void *arg)
+{
+  auto ctx = static_cast<AioContext*>(arg);
+
+  int ret = ctx->c->get_return_value();
+  if (!ret && ctx->data) {
+    ctx->data->assign(ctx->bl.c_str(), ctx->bl.length());
+  }
+
+  if (!ret && ctx->empty) {
+    zlog_ceph_proto::MaxPos reply;
+    if (decode(ctx->bl, &reply)) {
+      *ctx->empty = !reply.has_pos();
+      if (reply.has_pos()) {
+        *ctx->pos = reply.pos();
+      }
+    } else {
+      ret = -EIO;
+    }
+  }
+
+  ctx->c->release();
+  ctx->cb(ret);
+  delete ctx;
+}
+
+int CephBackend::aio_operate(const std::string& oid,
+    librados::ObjectWriteOperation *op, std::function<void(int)> cb)
+{
+  auto ctx = new AioContext(cb);
+  ctx->c = librados::Rados::aio_create_completion(ctx,
+      &CephBackend::aio_complete, nullptr);
+
+  int ret = ioctx_->aio_operate(oid, ctx->c, op);
+  if (ret) {
+    ctx->c->release();
+    delete ctx;
+  }
+
+  return ret;
+}
+
+int CephBackend::ReadAsync(const std::string& oid, uint64_t epoch,
+    uint64_t position, std::string *data, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectReadOperation op;
+  zlog::cls_zlog_read(op, epoch, position);
+
+  auto ctx = new AioContext(cb);
+  ctx->data = data;
+  ctx->c = librados::Rados::aio_create_completion(ctx,
+      &CephBackend::aio_complete, nullptr);
+
+  int ret = ioctx_->aio_operate(oid, ctx->c, &op, &ctx->bl);
+  if (ret) {
+    ctx->c->release();
+    delete ctx;
+  }
+
+  return ret;
+}
+
+int CephBackend::WriteAsync(const std::string& oid, const std::string& data,
+    uint64_t epoch, uint64_t position, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  ::ceph::bufferlist data_bl;
+  data_bl.append(data.data(), data.size());
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_write(op, epoch, position, data_bl);
+
+  return aio_operate(oid, &op, cb);
+}
+
+int CephBackend::FillAsync(const std::string& oid, uint64_t epoch,
+    uint64_t position, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_invalidate(op, epoch, position, false);
+  return aio_operate(oid, &op, cb);
+}
+
+int CephBackend::TrimAsync(const std::string& oid, uint64_t epoch,
+    uint64_t position, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_invalidate(op, epoch, position, true);
+  return aio_operate(oid, &op, cb);
+}
+
+int CephBackend::SealAsync(const std::string& oid, uint64_t epoch,
+    std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_seal(op, epoch);
+  return aio_operate(oid, &op, cb);
+}
+
+int CephBackend::InitObjectAsync(const std::string& oid, uint64_t epoch,
+    std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectWriteOperation op;
+  zlog::cls_zlog_init_entry(op, epoch);
+  return aio_operate(oid, &op, cb);
+}
+
+int CephBackend::MaxPosAsync(const std::string& oid, uint64_t epoch,
+    uint64_t *pos_out, bool *empty_out, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectReadOperation op;
+  zlog::cls_zlog_max_position(op, epoch);
+
+  auto ctx = new AioContext(cb);
+  ctx->pos = pos_out;
+  ctx->empty = empty_out;
+  ctx->c = librados::Rados::aio_create_completion(ctx,
+      &CephBackend::aio_complete, nullptr);
+
+  int ret = ioctx_->aio_operate(oid, ctx->c, &op, &ctx->bl);
+  if (ret) {
+    ctx->c->release();
+    delete ctx;
+  }
+
+  return ret;
+}
+
+int CephBackend::PeekMaxPosAsync(const std::string& oid, uint64_t *pos_out,
+    bool *empty_out, std::function<void(int)> cb)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  librados::ObjectReadOperation op;
+  zlog::cls_zlog_peek_max_position(op);
+
+  auto ctx = new AioContext(cb);
+  ctx->pos = pos_out;
+  ctx->empty = empty_out;
+  ctx->c = librados::Rados::aio_create_completion(ctx,
+      &CephBackend::aio_complete, nullptr);
+
+  int ret = ioctx_->aio_operate(oid, ctx->c, &op, &ctx->bl);
+  if (ret) {
+    ctx->c->release();
+    delete ctx;
+  }
+
+  return ret;
+}
+
 std::string CephBackend::LinkObjectName(const std::string& name)
 {
   std::stringstream ss;
@@ -205,6 +205,42 @@ static int log_entry_seal(cls_method_context_t hctx, ceph::bufferlist *in,
   return 0;
 }
 
+// create the object with the given epoch if it doesn't exist. unlike seal, the
+// epoch of an existing object is never changed.
+static int log_entry_init(cls_method_context_t hctx, ceph::bufferlist *in,
+    ceph::bufferlist *out)
+{
+  zlog_ceph_proto::InitEntry op;
+  if (!decode(*in, &op)) {
+    CLS_ERR("ERROR: log_entry_init(): failed to decode input");
+    return -EINVAL;
+  }
+
+  if (op.epoch() < 1) {
+    CLS_ERR("ERROR: log_entry_init(): invalid epoch %llu",
+        op.epoch());
+    return -EINVAL;
+  }
+
+  cls_zlog::LogObjectHeader header(hctx);
+  int ret = header.read();
+  if (ret == 0) {
+    return 0;
+  } else if (ret != -ENOENT) {
+    CLS_ERR("ERROR: log_entry_init(): failed to read header %d", ret);
+    return ret;
+  }
+
+  header.set_epoch(op.epoch());
+  ret = header.write();
+  if (ret < 0) {
+    CLS_ERR("ERROR: log_entry_init(): write header failed %d", ret);
+    return ret;
+  }
+
+  return 0;
+}
+
 static int log_entry_max_position(cls_method_context_t hctx,
     ceph::bufferlist *in, ceph::bufferlist *out)
 {
@@ -242,6 +278,29 @@ static int log_entry_max_position(cls_method_context_t hctx,
   return 0;
 }
 
+// same as log_entry_max_position, but doesn't check the epoch. used by
+// read-only clients to estimate the tail without sealing.
+static int log_entry_peek_max_position(cls_method_context_t hctx,
+    ceph::bufferlist *in, ceph::bufferlist *out)
+{
+  cls_zlog::LogObjectHeader header(hctx);
+  int ret = header.read();
+  if (ret < 0) {
+    CLS_ERR("ERROR: log_entry_peek_max_position(): failed to load header %d", ret);
+    return ret;
+  }
+
+  zlog_ceph_proto::MaxPos reply;
+  auto max_pos = header.max_pos();
+  if (max_pos) {
+    reply.set_pos(*max_pos);
+  }
+
+  encode(*out, reply);
+
+  return 0;
+}
+
 static int head_init(cls_method_context_t hctx, ceph::bufferlist *in,
     ceph::bufferlist *out)
 {
@@ -349,6 +408,9 @@ static int view_read(cls_method_context_t hctx, ceph::bufferlist *in,
   uint32_t max_views = std::min(((uint32_t)op.max_views()),
       ((uint32_t)ZLOG_MAX_VIEW_READS));
 
+  // start at the oldest view if older views have been trimmed
+  epoch = std::max(epoch, head.min_epoch());
+
   uint32_t count = 0;
   zlog_ceph_proto::Views views;
   while (epoch <= head.epoch() && count < max_views) {
@@ -381,6 +443,87 @@ static int view_read(cls_method_context_t hctx, ceph::bufferlist *in,
   return 0;
 }
 
+static int view_trim(cls_method_context_t hctx, ceph::bufferlist *in,
+    ceph::bufferlist *out)
+{
+  zlog_ceph_proto::TrimViews op;
+  if (!decode(*in, &op)) {
+    CLS_ERR("ERROR: view_trim(): decoding input");
+    return -EINVAL;
+  }
+
+  if (op.epoch() < 1) {
+    CLS_ERR("ERROR: view_trim(): invalid epoch %llu",
+        (unsigned long long)op.epoch());
+    return -EINVAL;
+  }
+
+  cls_zlog::HeadObject head(hctx);
+  int ret = head.initialize();
+  if (ret < 0) {
+    CLS_ERR("ERROR: view_trim(): initializing ret %d", ret);
+    return ret;
+  }
+
+  if (op.epoch() > head.epoch()) {
+    CLS_ERR("ERROR: view_trim(): epoch %llu hdr %llu",
+        (unsigned long long)op.epoch(), (unsigned long long)head.epoch());
+    return -EINVAL;
+  }
+
+  if (op.epoch() <= head.min_epoch()) {
+    return 0;
+  }
+
+  ret = head.trim_views(op.epoch());
+  if (ret < 0) {
+    CLS_ERR("ERROR: view_trim(): trimming ret %d", ret);
+    return ret;
+  }
+
+  ret = head.finalize();
+  if (ret < 0) {
+    CLS_ERR("ERROR: view_trim(): finalizing ret %d", ret);
+    return ret;
+  }
+
+  return 0;
+}
+
+// returns the view at the current epoch of the head object, or no views if
+// no view has been created.
+static int view_read_latest(cls_method_context_t hctx, ceph::bufferlist *in,
+    ceph::bufferlist *out)
+{
+  cls_zlog::HeadObject head(hctx);
+  int ret = head.initialize();
+  if (ret < 0) {
+    CLS_ERR("ERROR: view_read_latest(): initializing ret %d", ret);
+    return ret;
+  }
+
+  zlog_ceph_proto::Views views;
+  const uint64_t epoch = head.epoch();
+  if (epoch > 0) {
+    ceph::bufferlist bl;
+    ret = head.read_view(epoch, &bl);
+    if (ret < 0) {
+      CLS_ERR("ERROR: view_read_latest(): reading view %llu ret %d",
+          (unsigned long long)epoch, ret);
+      // see view_read: a missing epoch is a critical error
+      return ret == -ENOENT ? -EIO : ret;
+    }
+
+    auto view = views.add_views();
+    view->set_epoch(epoch);
+    view->set_data(bl.c_str(), bl.length());
+  }
+
+  encode(*out, views);
+
+  return 0;
+}
+
 static int __unique_id_read(cls_method_context_t hctx, uint64_t *pid)
 {
   ceph::bufferlist bl;
@@ -470,12 +613,16 @@ void __cls_init()
   cls_method_handle_t h_log_entry_write;
   cls_method_handle_t h_log_entry_invalidate;
   cls_method_handle_t h_log_entry_seal;
+  cls_method_handle_t h_log_entry_init;
   cls_method_handle_t h_log_entry_max_position;
+  cls_method_handle_t h_log_entry_peek_max_position;
 
   // head object methods
   cls_method_handle_t h_head_init;
   cls_method_handle_t h_view_create;
   cls_method_handle_t h_view_read;
+  cls_method_handle_t h_view_read_latest;
+  cls_method_handle_t h_view_trim;
   cls_method_handle_t h_unique_id_read;
   cls_method_handle_t h_unique_id_write;
 
@@ -498,10 +645,18 @@ void __cls_init()
       CLS_METHOD_RD | CLS_METHOD_WR,
       log_entry_seal, &h_log_entry_seal);
 
+  cls_register_cxx_method(h_class, "entry_init",
+      CLS_METHOD_RD | CLS_METHOD_WR,
+      log_entry_init, &h_log_entry_init);
+
   cls_register_cxx_method(h_class, "entry_max_position",
       CLS_METHOD_RD,
       log_entry_max_position, &h_log_entry_max_position);
 
+  cls_register_cxx_method(h_class, "entry_peek_max_position",
+      CLS_METHOD_RD,
+      log_entry_peek_max_position, &h_log_entry_peek_max_position);
+
   cls_register_cxx_method(h_class, "head_init",
       CLS_METHOD_RD | CLS_METHOD_WR,
       head_init, &h_head_init);
@@ -514,6 +669,14 @@ void __cls_init()
       CLS_METHOD_RD,
       view_read, &h_view_read);
 
+  cls_register_cxx_method(h_class, "view_read_latest",
+      CLS_METHOD_RD,
+      view_read_latest, &h_view_read_latest);
+
+  cls_register_cxx_method(h_class, "view_trim",
+      CLS_METHOD_RD | CLS_METHOD_WR,
+      view_trim, &h_view_trim);
+
   cls_register_cxx_method(h_class, "unique_id_read",
       CLS_METHOD_RD,
       unique_id_read, &h_unique_id_read);
@@ -246,6 +246,24 @@ class HeadObject {
     return cls_cxx_map_get_val(hctx_, key, bl);
   }
 
+  uint64_t min_epoch() const {
+    return hdr_.min_epoch();
+  }
+
+  // remove the views before epoch
+  int trim_views(uint64_t epoch) {
+    for (uint64_t e = hdr_.min_epoch(); e < epoch; e++) {
+      int ret = cls_cxx_map_remove_key(hctx_, view_key(e));
+      if (ret < 0 && ret != -ENOENT) {
+        return ret;
+      }
+    }
+    if (epoch > hdr_.min_epoch()) {
+      hdr_.set_min_epoch(epoch);
+    }
+    return 0;
+  }
+
  private:
   inline std::string view_key(uint64_t epoch) const {
     return u64tostr(epoch, ZLOG_VIEW_KEY_PREFIX);
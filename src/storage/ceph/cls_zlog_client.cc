@@ -50,6 +50,15 @@ void cls_zlog_seal(librados::ObjectWriteOperation& op, uint64_t epoch)
   op.exec("zlog", "entry_seal", bl);
 }
 
+void cls_zlog_init_entry(librados::ObjectWriteOperation& op, uint64_t epoch)
+{
+  ceph::bufferlist bl;
+  zlog_ceph_proto::InitEntry call;
+  call.set_epoch(epoch);
+  encode(bl, call);
+  op.exec("zlog", "entry_init", bl);
+}
+
 void cls_zlog_max_position(librados::ObjectReadOperation& op, uint64_t epoch)
 {
   ceph::bufferlist bl;
@@ -59,6 +68,12 @@ void cls_zlog_max_position(librados::ObjectReadOperation& op, uint64_t epoch)
   op.exec("zlog", "entry_max_position", bl);
 }
 
+void cls_zlog_peek_max_position(librados::ObjectReadOperation& op)
+{
+  ceph::bufferlist bl;
+  op.exec("zlog", "entry_peek_max_position", bl);
+}
+
 void cls_zlog_init_head(librados::ObjectWriteOperation& op,
     const std::string& prefix)
 {
@@ -93,6 +108,21 @@ void cls_zlog_read_view(librados::ObjectReadOperation& op,
   op.exec("zlog", "view_read", bl);
 }
 
+void cls_zlog_read_latest_view(librados::ObjectReadOperation& op)
+{
+  ceph::bufferlist bl;
+  op.exec("zlog", "view_read_latest", bl);
+}
+
+void cls_zlog_trim_views(librados::ObjectWriteOperation& op, uint64_t epoch)
+{
+  ceph::bufferlist bl;
+  zlog_ceph_proto::TrimViews call;
+  call.set_epoch(epoch);
+  encode(bl, call);
+  op.exec("zlog", "view_trim", bl);
+}
+
 void cls_zlog_read_unique_id(librados::ObjectReadOperation& op)
 {
   ceph::bufferlist bl;
@@ -17,7 +17,10 @@ namespace zlog {
 
   void cls_zlog_seal(librados::ObjectWriteOperation& op, uint64_t epoch);
 
+  void cls_zlog_init_entry(librados::ObjectWriteOperation& op, uint64_t epoch);
+
   void cls_zlog_max_position(librados::ObjectReadOperation& op, uint64_t epoch);
+  void cls_zlog_peek_max_position(librados::ObjectReadOperation& op);
 
   void cls_zlog_init_head(librados::ObjectWriteOperation& op,
       const std::string& prefix);
@@ -25,6 +28,11 @@ namespace zlog {
   void cls_zlog_read_view(librados::ObjectReadOperation& op,
       uint64_t epoch, uint32_t max_views);
 
+  void cls_zlog_read_latest_view(librados::ObjectReadOperation& op);
+
+  void cls_zlog_trim_views(librados::ObjectWriteOperation& op,
+      uint64_t epoch);
+
   void cls_zlog_create_view(librados::ObjectWriteOperation& op,
       uint64_t epoch, ceph::bufferlist& bl);
 
@@ -70,6 +70,12 @@ class ClsZlogTest : public ::testing::Test {
     return ioctx.operate(oid, &op);
   }
 
+  int entry_init(uint64_t epoch, const std::string& oid = "obj") {
+    librados::ObjectWriteOperation op;
+    zlog::cls_zlog_init_entry(op, epoch);
+    return ioctx.operate(oid, &op);
+  }
+
   int entry_maxpos(uint64_t epoch, uint64_t *position_out,
       bool *empty_out, const std::string& oid = "obj") {
     librados::ObjectReadOperation op;
@@ -660,6 +666,44 @@ TEST_F(ClsZlogTest, InvalidateEntry_Force) {
   ASSERT_EQ(ret, 0);
 }
 
+TEST_F(ClsZlogTest, InitEntry_BadInput) {
+  ceph::bufferlist inbl, outbl;
+  inbl.append("foo", strlen("foo"));
+  int ret = exec("entry_init", inbl, outbl);
+  ASSERT_EQ(ret, -EINVAL);
+}
+
+TEST_F(ClsZlogTest, InitEntry_BadEpoch) {
+  int ret = entry_init(0);
+  ASSERT_EQ(ret, -EINVAL);
+  ret = entry_init(11);
+  ASSERT_EQ(ret, 0);
+}
+
+TEST_F(ClsZlogTest, InitEntry_MissingHeader) {
+  int ret = ioctx.create("obj", true);
+  ASSERT_EQ(ret, 0);
+
+  ret = entry_init(1);
+  ASSERT_EQ(ret, -EIO);
+}
+
+TEST_F(ClsZlogTest, InitEntry_Exists) {
+  int ret = entry_init(5);
+  ASSERT_EQ(ret, 0);
+
+  // the epoch of an existing object isn't changed
+  ret = entry_init(10);
+  ASSERT_EQ(ret, 0);
+  ret = entry_init(1);
+  ASSERT_EQ(ret, 0);
+
+  ret = entry_seal(5);
+  ASSERT_EQ(ret, -ESPIPE);
+  ret = entry_seal(6);
+  ASSERT_EQ(ret, 0);
+}
+
 TEST_F(ClsZlogTest, SealEntry_BadInput) {
   ceph::bufferlist inbl, outbl;
   inbl.append("foo", strlen("foo"));
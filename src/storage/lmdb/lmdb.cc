@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 #include <atomic>
 #include <cassert>
+#include <cstring>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -268,6 +270,15 @@ int LMDBBackend::ReadViews(const std::string& hoid, uint64_t epoch,
     return 0;
   }
 
+  // start at the oldest view if older views have been trimmed
+  uint64_t min_epoch;
+  ret = GetMinEpoch(txn, hoid, &min_epoch);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+  epoch = std::max(epoch, min_epoch);
+
   uint32_t count = 0;
   while (true) {
     if (count == max_views) {
@@ -300,6 +311,125 @@ int LMDBBackend::ReadViews(const std::string& hoid, uint64_t epoch,
   return 0;
 }
 
+int LMDBBackend::GetMinEpoch(Transaction& txn, const std::string& hoid,
+    uint64_t *epoch)
+{
+  MDB_val val;
+  int ret = txn.Get(MinEpochKey(hoid), val);
+  if (ret == -ENOENT) {
+    *epoch = 1;
+    return 0;
+  } else if (ret) {
+    return ret;
+  }
+
+  assert(val.mv_size == sizeof(*epoch));
+  memcpy(epoch, val.mv_data, sizeof(*epoch));
+
+  return 0;
+}
+
+int LMDBBackend::TrimViews(const std::string& hoid, uint64_t epoch)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction();
+
+  MDB_val val;
+  int ret = txn.Get(hoid, val);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  ProjectionObject *proj_obj = (ProjectionObject*)val.mv_data;
+  assert(val.mv_size == sizeof(*proj_obj));
+
+  if (epoch > proj_obj->epoch) {
+    txn.Abort();
+    return -EINVAL;
+  }
+
+  uint64_t min_epoch;
+  ret = GetMinEpoch(txn, hoid, &min_epoch);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  if (epoch <= min_epoch) {
+    txn.Abort();
+    return 0;
+  }
+
+  for (uint64_t e = min_epoch; e < epoch; e++) {
+    ret = txn.Del(ProjectionKey(hoid, e));
+    if (ret && ret != -ENOENT) {
+      txn.Abort();
+      return ret;
+    }
+  }
+
+  MDB_val min_val;
+  min_val.mv_size = sizeof(epoch);
+  min_val.mv_data = &epoch;
+  ret = txn.Put(MinEpochKey(hoid), min_val, false);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  return txn.Commit();
+}
+
+int LMDBBackend::ReadLatestView(const std::string& hoid,
+    uint64_t *epoch_out, std::string *view_out)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction(true);
+
+  MDB_val val;
+  int ret = txn.Get(hoid, val);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  ProjectionObject *proj_obj = (ProjectionObject*)val.mv_data;
+  assert(val.mv_size == sizeof(*proj_obj));
+
+  const uint64_t epoch = proj_obj->epoch;
+  std::string view;
+  if (epoch > 0) {
+    std::string proj_key = ProjectionKey(hoid, epoch);
+    ret = txn.Get(proj_key, val);
+    if (ret) {
+      txn.Abort();
+      // the view at the current epoch must exist
+      return ret == -ENOENT ? -EIO : ret;
+    }
+    view.assign((const char *)val.mv_data, val.mv_size);
+  }
+
+  ret = txn.Commit();
+  if (ret)
+    return ret;
+
+  *epoch_out = epoch;
+  view_out->swap(view);
+
+  return 0;
+}
+
 int LMDBBackend::ProposeView(const std::string& hoid,
     uint64_t epoch, const std::string& view)
 {
@@ -358,10 +488,60 @@ int LMDBBackend::ProposeView(const std::string& hoid,
     return ret;
   }
 
-  txn.Commit();
+  ret = txn.Commit();
+  if (ret) {
+    return ret;
+  }
+
+  NotifyViewWatchers(hoid, epoch);
+
+  return 0;
+}
+
+int LMDBBackend::WatchViews(const std::string& hoid,
+    std::function<void(uint64_t epoch)> cb, uint64_t *handle_out)
+{
+  if (hoid.empty() || !cb) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction(true);
+  MDB_val val;
+  int ret = txn.Get(hoid, val);
+  txn.Abort();
+  if (ret) {
+    return ret;
+  }
+
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  const auto handle = next_watch_handle_++;
+  watches_.emplace(handle, ViewWatch{hoid, std::move(cb)});
+  *handle_out = handle;
+
   return 0;
 }
 
+int LMDBBackend::UnwatchViews(uint64_t handle)
+{
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  if (watches_.erase(handle) == 0) {
+    return -ENOENT;
+  }
+  return 0;
+}
+
+// callbacks run with watch_lock_ held, so a watch can't be removed while its
+// callback is running.
+void LMDBBackend::NotifyViewWatchers(const std::string& hoid, uint64_t epoch)
+{
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  for (const auto& watch : watches_) {
+    if (watch.second.hoid == hoid) {
+      watch.second.cb(epoch);
+    }
+  }
+}
+
 int LMDBBackend::Write(const std::string& oid, const std::string& data,
     uint64_t epoch, uint64_t position)
 {
@@ -471,6 +651,134 @@ int LMDBBackend::Read(const std::string& oid, uint64_t epoch,
   return 0;
 }
 
+int LMDBBackend::WriteMany(const std::string& oid, uint64_t epoch,
+    const std::vector<std::pair<uint64_t, std::string>>& entries,
+    std::vector<int> *results)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction();
+
+  int ret = CheckEpoch(txn, epoch, oid);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  // read max position
+  uint64_t pos = 0;
+  MDB_val maxval;
+  auto maxkey = MaxPosKey(oid);
+  ret = txn.Get(maxkey, maxval);
+  if (ret < 0 && ret != -ENOENT) {
+    txn.Abort();
+    return ret;
+  } else if (ret == 0) {
+    LogMaxPos *maxpos = (LogMaxPos*)maxval.mv_data;
+    assert(maxval.mv_size == sizeof(*maxpos));
+    pos = maxpos->maxpos;
+  }
+
+  results->clear();
+  results->reserve(entries.size());
+
+  bool updated = false;
+  std::vector<unsigned char> blob;
+  for (const auto& entry : entries) {
+    LogEntry log_entry;
+    blob.clear();
+    blob.reserve(sizeof(log_entry) + entry.second.size());
+    blob.insert(blob.end(), (unsigned char *)&log_entry,
+        ((unsigned char *)&log_entry) + sizeof(log_entry));
+    blob.insert(blob.end(), (unsigned char *)entry.second.data(),
+        ((unsigned char *)entry.second.data()) + entry.second.size());
+
+    std::string key = LogEntryKey(oid, entry.first);
+    ret = txn.Put(key, blob, true);
+    if (ret == -EEXIST) {
+      results->push_back(-EROFS);
+      continue;
+    }
+
+    pos = std::max(pos, entry.first);
+    updated = true;
+    results->push_back(0);
+  }
+
+  if (!updated) {
+    txn.Abort();
+    return 0;
+  }
+
+  // update max pos
+  LogMaxPos new_maxpos;
+  new_maxpos.maxpos = pos;
+  maxval.mv_data = &new_maxpos;
+  maxval.mv_size = sizeof(new_maxpos);
+  txn.Put(maxkey, maxval, false);
+
+  ret = txn.Commit();
+  if (ret)
+    return ret;
+
+  return 0;
+}
+
+int LMDBBackend::ReadMany(const std::string& oid, uint64_t epoch,
+    const std::vector<uint64_t>& positions,
+    std::vector<std::pair<int, std::string>> *results)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction(true);
+
+  int ret = CheckEpoch(txn, epoch, oid);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  results->clear();
+  results->reserve(positions.size());
+
+  for (const auto position : positions) {
+    MDB_val val;
+    std::string key = LogEntryKey(oid, position);
+    ret = txn.Get(key, val);
+    if (ret == -ENOENT) {
+      results->emplace_back(-ERANGE, std::string());
+      continue;
+    }
+
+    LogEntry *entry = (LogEntry*)val.mv_data;
+    if (entry->trimmed || entry->invalidated) {
+      results->emplace_back(-ENODATA, std::string());
+      continue;
+    }
+
+    const char *blob = (const char *)val.mv_data + sizeof(*entry);
+    results->emplace_back(0, std::string(blob, val.mv_size - sizeof(*entry)));
+  }
+
+  ret = txn.Commit();
+  if (ret)
+    return ret;
+
+  return 0;
+}
+
 int LMDBBackend::Trim(const std::string& oid, uint64_t epoch,
     uint64_t position)
 {
@@ -674,6 +982,43 @@ int LMDBBackend::MaxPos(const std::string& oid, uint64_t epoch,
   return 0;
 }
 
+int LMDBBackend::PeekMaxPos(const std::string& oid, uint64_t *pos,
+    bool *empty)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction(true);
+
+  MDB_val val;
+  int ret = txn.Get(oid, val);
+  if (ret) {
+    txn.Abort();
+    return ret;
+  }
+
+  auto key = MaxPosKey(oid);
+  ret = txn.Get(key, val);
+  if (ret < 0) {
+    if (ret == -ENOENT) {
+      *empty = true;
+      txn.Commit();
+      return 0;
+    }
+    txn.Abort();
+    return ret;
+  }
+
+  LogMaxPos *maxpos = (LogMaxPos*)val.mv_data;
+  assert(val.mv_size == sizeof(*maxpos));
+  txn.Commit();
+  *pos = maxpos->maxpos;
+  *empty = false;
+
+  return 0;
+}
+
 int LMDBBackend::Seal(const std::string& oid, uint64_t epoch)
 {
   if (oid.empty()) {
@@ -715,6 +1060,37 @@ int LMDBBackend::Seal(const std::string& oid, uint64_t epoch)
   return 0;
 }
 
+int LMDBBackend::InitObject(const std::string& oid, uint64_t epoch)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  auto txn = NewTransaction();
+
+  // an existing object is left unchanged
+  LogObject obj;
+  obj.epoch = epoch;
+  MDB_val val;
+  val.mv_data = &obj;
+  val.mv_size = sizeof(obj);
+  int ret = txn.Put(oid, val, true);
+  if (ret == -EEXIST) {
+    txn.Abort();
+    return 0;
+  }
+
+  ret = txn.Commit();
+  if (ret)
+    return ret;
+
+  return 0;
+}
+
 void LMDBBackend::Init(const std::string& path)
 {
   options["path"] = path;
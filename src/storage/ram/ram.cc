@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 #include <atomic>
 #include <boost/algorithm/string.hpp>
@@ -183,7 +184,10 @@ int RAMBackend::ReadViews(const std::string& hoid, uint64_t epoch,
     return 0;
   }
 
-  // TODO shouldn't this just return empty views?
+  // start at the oldest view if older views have been trimmed
+  assert(!proj_obj.projections.empty());
+  epoch = std::max(epoch, proj_obj.projections.cbegin()->first);
+
   auto it2 = proj_obj.projections.find(epoch);
   if (it2 == proj_obj.projections.end()) {
     return -EIO;
@@ -212,8 +216,39 @@ int RAMBackend::ReadViews(const std::string& hoid, uint64_t epoch,
   return 0;
 }
 
-int RAMBackend::ProposeView(const std::string& hoid,
-    uint64_t epoch, const std::string& view)
+int RAMBackend::ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+    std::string *view_out)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lk(lock_);
+
+  auto it = objects_.find(hoid);
+  if (it == objects_.end()) {
+    return -ENOENT;
+  }
+
+  auto& proj_obj = boost::get<ProjectionObject>(it->second);
+  if (proj_obj.epoch == 0) {
+    *epoch_out = 0;
+    view_out->clear();
+    return 0;
+  }
+
+  auto it2 = proj_obj.projections.find(proj_obj.epoch);
+  if (it2 == proj_obj.projections.end()) {
+    return -EIO;
+  }
+
+  *epoch_out = proj_obj.epoch;
+  *view_out = it2->second;
+
+  return 0;
+}
+
+int RAMBackend::TrimViews(const std::string& hoid, uint64_t epoch)
 {
   if (hoid.empty()) {
     return -EINVAL;
@@ -230,25 +265,101 @@ int RAMBackend::ProposeView(const std::string& hoid,
     return -ENOENT;
   }
 
-  ProjectionObject& proj_obj = boost::get<ProjectionObject>(it->second);
-  const auto required_epoch = proj_obj.epoch + 1;
-  if (epoch > required_epoch) {
+  auto& proj_obj = boost::get<ProjectionObject>(it->second);
+  if (epoch > proj_obj.epoch) {
     return -EINVAL;
   }
-  if (epoch != required_epoch) {
-    return -ESPIPE;
+
+  proj_obj.projections.erase(proj_obj.projections.begin(),
+      proj_obj.projections.lower_bound(epoch));
+
+  return 0;
+}
+
+int RAMBackend::ProposeView(const std::string& hoid,
+    uint64_t epoch, const std::string& view)
+{
+  if (hoid.empty()) {
+    return -EINVAL;
   }
 
-  auto ret = proj_obj.projections.emplace(epoch, view);
-  if (!ret.second) {
-    return -EEXIST;
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+
+    auto it = objects_.find(hoid);
+    if (it == objects_.end()) {
+      return -ENOENT;
+    }
+
+    ProjectionObject& proj_obj = boost::get<ProjectionObject>(it->second);
+    const auto required_epoch = proj_obj.epoch + 1;
+    if (epoch > required_epoch) {
+      return -EINVAL;
+    }
+    if (epoch != required_epoch) {
+      return -ESPIPE;
+    }
+
+    auto ret = proj_obj.projections.emplace(epoch, view);
+    if (!ret.second) {
+      return -EEXIST;
+    }
+
+    proj_obj.epoch = epoch;
+  }
+
+  NotifyViewWatchers(hoid, epoch);
+
+  return 0;
+}
+
+int RAMBackend::WatchViews(const std::string& hoid,
+    std::function<void(uint64_t epoch)> cb, uint64_t *handle_out)
+{
+  if (hoid.empty() || !cb) {
+    return -EINVAL;
   }
 
-  proj_obj.epoch = epoch;
+  {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (objects_.find(hoid) == objects_.end()) {
+      return -ENOENT;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  const auto handle = next_watch_handle_++;
+  watches_.emplace(handle, ViewWatch{hoid, std::move(cb)});
+  *handle_out = handle;
 
   return 0;
 }
 
+int RAMBackend::UnwatchViews(uint64_t handle)
+{
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  if (watches_.erase(handle) == 0) {
+    return -ENOENT;
+  }
+  return 0;
+}
+
+// callbacks run with watch_lock_ held, so a watch can't be removed while its
+// callback is running.
+void RAMBackend::NotifyViewWatchers(const std::string& hoid, uint64_t epoch)
+{
+  std::lock_guard<std::mutex> lk(watch_lock_);
+  for (const auto& watch : watches_) {
+    if (watch.second.hoid == hoid) {
+      watch.second.cb(epoch);
+    }
+  }
+}
+
 int RAMBackend::Read(const std::string& oid, uint64_t epoch,
     uint64_t position, std::string *data)
 {
@@ -323,6 +434,85 @@ int RAMBackend::Write(const std::string& oid, const std::string& data,
   }
 }
 
+int RAMBackend::WriteMany(const std::string& oid, uint64_t epoch,
+    const std::vector<std::pair<uint64_t, std::string>>& entries,
+    std::vector<int> *results)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lk(lock_);
+
+  LogObject *lobj = nullptr;
+  int ret = CheckEpoch(epoch, oid, false, lobj);
+  if (ret) {
+    return ret;
+  }
+
+  assert(lobj);
+  results->clear();
+  results->reserve(entries.size());
+
+  for (const auto& entry : entries) {
+    LogEntry new_entry;
+    if (!blackhole_) {
+      new_entry.data = entry.second;
+    }
+    auto res = lobj->entries.emplace(entry.first, std::move(new_entry));
+    if (res.second) {
+      lobj->maxpos = std::max(lobj->maxpos, entry.first);
+      results->push_back(0);
+    } else {
+      results->push_back(-EROFS);
+    }
+  }
+
+  return 0;
+}
+
+int RAMBackend::ReadMany(const std::string& oid, uint64_t epoch,
+    const std::vector<uint64_t>& positions,
+    std::vector<std::pair<int, std::string>> *results)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lk(lock_);
+
+  LogObject *lobj = nullptr;
+  int ret = CheckEpoch(epoch, oid, false, lobj);
+  if (ret) {
+    return ret;
+  }
+
+  assert(lobj);
+  results->clear();
+  results->reserve(positions.size());
+
+  for (const auto position : positions) {
+    const auto it = lobj->entries.find(position);
+    if (it == lobj->entries.end()) {
+      results->emplace_back(-ERANGE, std::string());
+    } else if (it->second.trimmed || it->second.invalidated) {
+      results->emplace_back(-ENODATA, std::string());
+    } else {
+      results->emplace_back(0, it->second.data);
+    }
+  }
+
+  return 0;
+}
+
 int RAMBackend::Trim(const std::string& oid, uint64_t epoch,
     uint64_t position)
 {
@@ -432,6 +622,26 @@ int RAMBackend::Seal(const std::string& oid, uint64_t epoch)
   return 0;
 }
 
+int RAMBackend::InitObject(const std::string& oid, uint64_t epoch)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  if (epoch == 0) {
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lk(lock_);
+
+  auto ret = objects_.emplace(oid, LogObject());
+  if (ret.second) {
+    boost::get<LogObject>(ret.first->second).epoch = epoch;
+  }
+
+  return 0;
+}
+
 int RAMBackend::MaxPos(const std::string& oid, uint64_t epoch,
     uint64_t *pos, bool *empty)
 {
@@ -463,6 +673,29 @@ int RAMBackend::MaxPos(const std::string& oid, uint64_t epoch,
   return 0;
 }
 
+int RAMBackend::PeekMaxPos(const std::string& oid, uint64_t *pos,
+    bool *empty)
+{
+  if (oid.empty()) {
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lk(lock_);
+
+  auto it = objects_.find(oid);
+  if (it == objects_.end()) {
+    return -ENOENT;
+  }
+
+  auto& lobj = boost::get<LogObject>(it->second);
+  bool is_empty = lobj.entries.empty();
+  if (!is_empty)
+    *pos = lobj.maxpos;
+  *empty = is_empty;
+
+  return 0;
+}
+
 int RAMBackend::CheckEpoch(uint64_t epoch, const std::string& oid,
     bool eq, LogObject*& lobj)
 {
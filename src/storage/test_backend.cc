@@ -1,7 +1,11 @@
 #include "test_backend.h"
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <map>
 #include <set>
+#include <condition_variable>
+#include <mutex>
 
 TEST_F(BackendTest, DeleteBeforeInit) {
   auto no_init_be = create_minimal_backend();
@@ -216,6 +220,169 @@ TEST_F(BackendTest, ReadViews) {
   ASSERT_EQ(backend->ReadViews(hoid, 0, 1, &views), -EINVAL);
 }
 
+TEST_F(BackendTest, ReadLatestView_Args) {
+  uint64_t epoch;
+  std::string view;
+  ASSERT_EQ(backend->ReadLatestView("", &epoch, &view), -EINVAL);
+}
+
+TEST_F(BackendTest, ReadLatestView_NoInit) {
+  uint64_t epoch;
+  std::string view;
+  ASSERT_EQ(backend->ReadLatestView("a", &epoch, &view), -ENOENT);
+}
+
+TEST_F(BackendTest, ReadLatestView) {
+  std::string hoid, prefix;
+  ASSERT_EQ(backend->CreateLog("a", "v1", &hoid, &prefix), 0);
+
+  uint64_t epoch;
+  std::string view;
+  ASSERT_EQ(backend->ReadLatestView(hoid, &epoch, &view), 0);
+  ASSERT_EQ(epoch, 1u);
+  ASSERT_EQ(view, "v1");
+
+  for (int i = 2; i <= 10; i++) {
+    std::stringstream ss;
+    ss << "v" << i;
+    ASSERT_EQ(backend->ProposeView(hoid, i, ss.str()), 0);
+    ASSERT_EQ(backend->ReadLatestView(hoid, &epoch, &view), 0);
+    ASSERT_EQ(epoch, (uint64_t)i);
+    ASSERT_EQ(view, ss.str());
+  }
+
+  // a rejected proposal doesn't change the latest view
+  ASSERT_EQ(backend->ProposeView(hoid, 10, "x"), -ESPIPE);
+  ASSERT_EQ(backend->ReadLatestView(hoid, &epoch, &view), 0);
+  ASSERT_EQ(epoch, 10u);
+  ASSERT_EQ(view, "v10");
+}
+
+TEST_F(BackendTest, TrimViews_Args) {
+  ASSERT_EQ(backend->TrimViews("", 1), -EINVAL);
+
+  std::string hoid, prefix;
+  ASSERT_EQ(backend->CreateLog("a", "", &hoid, &prefix), 0);
+  ASSERT_EQ(backend->TrimViews(hoid, 0), -EINVAL);
+
+  // can't trim past the current epoch
+  ASSERT_EQ(backend->TrimViews(hoid, 2), -EINVAL);
+  ASSERT_EQ(backend->TrimViews(hoid, 1), 0);
+}
+
+TEST_F(BackendTest, TrimViews_NoInit) {
+  ASSERT_EQ(backend->TrimViews("a", 1), -ENOENT);
+}
+
+TEST_F(BackendTest, TrimViews) {
+  std::string hoid, prefix;
+  ASSERT_EQ(backend->CreateLog("a", "1", &hoid, &prefix), 0);
+
+  for (int i = 2; i <= 10; i++) {
+    ASSERT_EQ(backend->ProposeView(hoid, i, std::to_string(i)), 0);
+  }
+
+  ASSERT_EQ(backend->TrimViews(hoid, 5), 0);
+
+  // reads of trimmed views start at the oldest view
+  std::map<uint64_t, std::string> views;
+  ASSERT_EQ(backend->ReadViews(hoid, 1, 20, &views), 0);
+  ASSERT_EQ(views.size(), 6u);
+  ASSERT_EQ(views.cbegin()->first, 5u);
+  ASSERT_EQ(views.cbegin()->second, "5");
+
+  ASSERT_EQ(backend->ReadViews(hoid, 7, 20, &views), 0);
+  ASSERT_EQ(views.size(), 4u);
+  ASSERT_EQ(views.cbegin()->first, 7u);
+
+  // trimming older epochs has no effect
+  ASSERT_EQ(backend->TrimViews(hoid, 3), 0);
+  ASSERT_EQ(backend->ReadViews(hoid, 1, 20, &views), 0);
+  ASSERT_EQ(views.cbegin()->first, 5u);
+
+  // the current view can be trimmed up to
+  ASSERT_EQ(backend->TrimViews(hoid, 10), 0);
+  ASSERT_EQ(backend->ReadViews(hoid, 1, 20, &views), 0);
+  ASSERT_EQ(views.size(), 1u);
+  ASSERT_EQ(views.cbegin()->first, 10u);
+
+  uint64_t epoch;
+  std::string view;
+  ASSERT_EQ(backend->ReadLatestView(hoid, &epoch, &view), 0);
+  ASSERT_EQ(epoch, 10u);
+  ASSERT_EQ(view, "10");
+
+  ASSERT_EQ(backend->ProposeView(hoid, 11, "11"), 0);
+  ASSERT_EQ(backend->ReadViews(hoid, 1, 20, &views), 0);
+  ASSERT_EQ(views.size(), 2u);
+}
+
+TEST_F(BackendTest, WatchViews_Args) {
+  uint64_t handle;
+  ASSERT_EQ(backend->WatchViews("", [](uint64_t) {}, &handle), -EINVAL);
+
+  std::string hoid, prefix;
+  ASSERT_EQ(backend->CreateLog("a", "1", &hoid, &prefix), 0);
+  ASSERT_EQ(backend->WatchViews(hoid, nullptr, &handle), -EINVAL);
+}
+
+TEST_F(BackendTest, WatchViews_NoInit) {
+  uint64_t handle;
+  ASSERT_EQ(backend->WatchViews("a", [](uint64_t) {}, &handle), -ENOENT);
+}
+
+TEST_F(BackendTest, WatchViews) {
+  std::string hoid, prefix;
+  ASSERT_EQ(backend->CreateLog("a", "1", &hoid, &prefix), 0);
+
+  std::mutex lock;
+  std::condition_variable cond;
+  uint64_t max_epoch = 0;
+  auto wait_for_epoch = [&](uint64_t epoch) {
+    std::unique_lock<std::mutex> lk(lock);
+    return cond.wait_for(lk, std::chrono::seconds(30),
+        [&] { return max_epoch >= epoch; });
+  };
+
+  uint64_t handle;
+  ASSERT_EQ(backend->WatchViews(hoid, [&](uint64_t epoch) {
+    std::lock_guard<std::mutex> lk(lock);
+    max_epoch = std::max(max_epoch, epoch);
+    cond.notify_all();
+  }, &handle), 0);
+
+  ASSERT_EQ(backend->ProposeView(hoid, 2, "2"), 0);
+  ASSERT_TRUE(wait_for_epoch(2));
+
+  // failed proposals aren't reported
+  ASSERT_EQ(backend->ProposeView(hoid, 2, "2"), -ESPIPE);
+  ASSERT_EQ(backend->ProposeView(hoid, 3, "3"), 0);
+  ASSERT_TRUE(wait_for_epoch(3));
+
+  // watches are per head object
+  std::string hoid2;
+  ASSERT_EQ(backend->CreateLog("b", "1", &hoid2, &prefix), 0);
+  for (int i = 2; i <= 6; i++) {
+    ASSERT_EQ(backend->ProposeView(hoid2, i, std::to_string(i)), 0);
+  }
+  ASSERT_EQ(backend->ProposeView(hoid, 4, "4"), 0);
+  ASSERT_TRUE(wait_for_epoch(4));
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    ASSERT_EQ(max_epoch, 4u);
+  }
+
+  ASSERT_EQ(backend->UnwatchViews(handle), 0);
+  ASSERT_EQ(backend->UnwatchViews(handle), -ENOENT);
+
+  // no callbacks after the watch is removed
+  ASSERT_EQ(backend->ProposeView(hoid, 5, "5"), 0);
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    ASSERT_EQ(max_epoch, 4u);
+  }
+}
+
 TEST_F(BackendTest, Write_Args) {
   ASSERT_EQ(backend->Write("", "", 1, 0), -EINVAL);
 
@@ -651,6 +818,35 @@ TEST_F(BackendTest, Seal) {
   ASSERT_EQ(backend->Seal("a", 21), 0);
 }
 
+TEST_F(BackendTest, InitObject_Args) {
+  ASSERT_EQ(backend->InitObject("", 1), -EINVAL);
+  ASSERT_EQ(backend->InitObject("a", 0), -EINVAL);
+  ASSERT_EQ(backend->InitObject("a", 1), 0);
+}
+
+TEST_F(BackendTest, InitObject) {
+  ASSERT_EQ(backend->Write("a", "", 1, 0), -ENOENT);
+  ASSERT_EQ(backend->InitObject("a", 5), 0);
+  ASSERT_EQ(backend->InitObject("a", 5), 0);
+  ASSERT_EQ(backend->Write("a", "", 5, 0), 0);
+  ASSERT_EQ(backend->Write("a", "", 4, 1), -ESPIPE);
+
+  // the epoch of an existing object isn't changed
+  ASSERT_EQ(backend->InitObject("a", 10), 0);
+  ASSERT_EQ(backend->Write("a", "", 5, 1), 0);
+  ASSERT_EQ(backend->InitObject("a", 1), 0);
+  ASSERT_EQ(backend->Write("a", "", 5, 2), 0);
+
+  // the object is sealed at the epoch it was initialized with
+  ASSERT_EQ(backend->Seal("a", 5), -ESPIPE);
+  ASSERT_EQ(backend->Seal("a", 6), 0);
+
+  // sealing doesn't conflict with an object that was already initialized
+  ASSERT_EQ(backend->Seal("b", 3), 0);
+  ASSERT_EQ(backend->InitObject("b", 7), 0);
+  ASSERT_EQ(backend->Seal("b", 4), 0);
+}
+
 TEST_F(BackendTest, MaxPos_Args) {
   bool empty;
   uint64_t pos;
@@ -731,6 +927,185 @@ TEST_F(BackendTest, MaxPos) {
   ASSERT_EQ(pos, 200000001u);
 }
 
+TEST_F(BackendTest, PeekMaxPos_Args) {
+  bool empty;
+  uint64_t pos;
+  ASSERT_EQ(backend->PeekMaxPos("", &pos, &empty), -EINVAL);
+}
+
+TEST_F(BackendTest, PeekMaxPos_NoInit) {
+  bool empty;
+  uint64_t pos;
+  ASSERT_EQ(backend->PeekMaxPos("a", &pos, &empty), -ENOENT);
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+  ASSERT_EQ(backend->PeekMaxPos("a", &pos, &empty), 0);
+  ASSERT_TRUE(empty);
+}
+
+TEST_F(BackendTest, PeekMaxPos) {
+  bool empty;
+  uint64_t pos;
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+
+  ASSERT_EQ(backend->Write("a", "", 1, 20), 0);
+  ASSERT_EQ(backend->PeekMaxPos("a", &pos, &empty), 0);
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(pos, 20u);
+
+  // the epoch isn't checked or changed
+  ASSERT_EQ(backend->Seal("a", 5), 0);
+  ASSERT_EQ(backend->PeekMaxPos("a", &pos, &empty), 0);
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(pos, 20u);
+  ASSERT_EQ(backend->MaxPos("a", 5, &pos, &empty), 0);
+
+  ASSERT_EQ(backend->Write("a", "", 5, 30), 0);
+  ASSERT_EQ(backend->Fill("a", 5, 40), 0);
+  ASSERT_EQ(backend->PeekMaxPos("a", &pos, &empty), 0);
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(pos, 40u);
+
+  std::mutex lock;
+  std::condition_variable cond;
+  bool done = false;
+  int ret = -1;
+  ASSERT_EQ(backend->PeekMaxPosAsync("a", &pos, &empty, [&](int r) {
+    std::lock_guard<std::mutex> lk(lock);
+    ret = r;
+    done = true;
+    cond.notify_one();
+  }), 0);
+  std::unique_lock<std::mutex> lk(lock);
+  cond.wait(lk, [&] { return done; });
+  ASSERT_EQ(ret, 0);
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(pos, 40u);
+}
+
+TEST_F(BackendTest, WriteMany_Args) {
+  std::vector<int> results;
+  ASSERT_EQ(backend->WriteMany("", 1, {{0, "a"}}, &results), -EINVAL);
+  ASSERT_EQ(backend->WriteMany("a", 0, {{0, "a"}}, &results), -EINVAL);
+}
+
+TEST_F(BackendTest, WriteMany_NoInit) {
+  std::vector<int> results;
+  ASSERT_EQ(backend->WriteMany("a", 1, {{0, "a"}, {1, "b"}}, &results),
+      -ENOENT);
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+  ASSERT_EQ(backend->WriteMany("a", 1, {{0, "a"}, {1, "b"}}, &results), 0);
+  ASSERT_EQ(results, std::vector<int>({0, 0}));
+}
+
+TEST_F(BackendTest, WriteMany_InvalidEpoch) {
+  std::vector<int> results;
+  ASSERT_EQ(backend->Seal("a", 10), 0);
+  ASSERT_EQ(backend->WriteMany("a", 9, {{0, "a"}, {1, "b"}}, &results),
+      -ESPIPE);
+
+  // nothing was written
+  std::string data;
+  ASSERT_EQ(backend->Read("a", 10, 0, &data), -ERANGE);
+  ASSERT_EQ(backend->Read("a", 10, 1, &data), -ERANGE);
+
+  ASSERT_EQ(backend->WriteMany("a", 10, {{0, "a"}, {1, "b"}}, &results), 0);
+  ASSERT_EQ(backend->WriteMany("a", 11, {{2, "c"}}, &results), 0);
+  ASSERT_EQ(results, std::vector<int>({0}));
+}
+
+TEST_F(BackendTest, WriteMany) {
+  std::vector<int> results;
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+
+  ASSERT_EQ(backend->WriteMany("a", 1, {}, &results), 0);
+  ASSERT_TRUE(results.empty());
+
+  ASSERT_EQ(backend->Write("a", "x", 1, 2), 0);
+  ASSERT_EQ(backend->Fill("a", 1, 4), 0);
+
+  // positions that exist (written or filled) fail individually
+  ASSERT_EQ(backend->WriteMany("a", 1,
+        {{1, "a"}, {2, "b"}, {3, "c"}, {4, "d"}, {50, "e"}}, &results), 0);
+  ASSERT_EQ(results, std::vector<int>({0, -EROFS, 0, -EROFS, 0}));
+
+  std::string data;
+  ASSERT_EQ(backend->Read("a", 1, 1, &data), 0);
+  ASSERT_EQ(data, "a");
+  ASSERT_EQ(backend->Read("a", 1, 2, &data), 0);
+  ASSERT_EQ(data, "x");
+  ASSERT_EQ(backend->Read("a", 1, 3, &data), 0);
+  ASSERT_EQ(data, "c");
+  ASSERT_EQ(backend->Read("a", 1, 4, &data), -ENODATA);
+  ASSERT_EQ(backend->Read("a", 1, 50, &data), 0);
+  ASSERT_EQ(data, "e");
+
+  bool empty;
+  uint64_t pos;
+  ASSERT_EQ(backend->MaxPos("a", 1, &pos, &empty), 0);
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(pos, 50u);
+
+  // duplicates within a batch
+  ASSERT_EQ(backend->WriteMany("a", 1, {{60, "a"}, {60, "b"}}, &results), 0);
+  ASSERT_EQ(results, std::vector<int>({0, -EROFS}));
+  ASSERT_EQ(backend->Read("a", 1, 60, &data), 0);
+  ASSERT_EQ(data, "a");
+
+  // all positions exist
+  ASSERT_EQ(backend->WriteMany("a", 1, {{1, "a"}, {3, "c"}}, &results), 0);
+  ASSERT_EQ(results, std::vector<int>({-EROFS, -EROFS}));
+}
+
+TEST_F(BackendTest, ReadMany_Args) {
+  std::vector<std::pair<int, std::string>> results;
+  ASSERT_EQ(backend->ReadMany("", 1, {0}, &results), -EINVAL);
+  ASSERT_EQ(backend->ReadMany("a", 0, {0}, &results), -EINVAL);
+}
+
+TEST_F(BackendTest, ReadMany_NoInit) {
+  std::vector<std::pair<int, std::string>> results;
+  ASSERT_EQ(backend->ReadMany("a", 1, {0, 1}, &results), -ENOENT);
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+  ASSERT_EQ(backend->ReadMany("a", 1, {0, 1}, &results), 0);
+  ASSERT_EQ(results.size(), 2u);
+  ASSERT_EQ(results[0].first, -ERANGE);
+  ASSERT_EQ(results[1].first, -ERANGE);
+}
+
+TEST_F(BackendTest, ReadMany_InvalidEpoch) {
+  std::vector<std::pair<int, std::string>> results;
+  ASSERT_EQ(backend->Seal("a", 10), 0);
+  ASSERT_EQ(backend->ReadMany("a", 9, {0, 1}, &results), -ESPIPE);
+  ASSERT_EQ(backend->ReadMany("a", 10, {0, 1}, &results), 0);
+  ASSERT_EQ(backend->ReadMany("a", 11, {0, 1}, &results), 0);
+}
+
+TEST_F(BackendTest, ReadMany) {
+  std::vector<std::pair<int, std::string>> results;
+  ASSERT_EQ(backend->Seal("a", 1), 0);
+
+  ASSERT_EQ(backend->ReadMany("a", 1, {}, &results), 0);
+  ASSERT_TRUE(results.empty());
+
+  ASSERT_EQ(backend->Write("a", "x", 1, 1), 0);
+  ASSERT_EQ(backend->Write("a", "y", 1, 2), 0);
+  ASSERT_EQ(backend->Write("a", "z", 1, 3), 0);
+  ASSERT_EQ(backend->Fill("a", 1, 4), 0);
+  ASSERT_EQ(backend->Trim("a", 1, 3), 0);
+
+  ASSERT_EQ(backend->ReadMany("a", 1, {2, 1, 3, 4, 5, 2}, &results), 0);
+  ASSERT_EQ(results.size(), 6u);
+  ASSERT_EQ(results[0].first, 0);
+  ASSERT_EQ(results[0].second, "y");
+  ASSERT_EQ(results[1].first, 0);
+  ASSERT_EQ(results[1].second, "x");
+  ASSERT_EQ(results[2].first, -ENODATA);
+  ASSERT_EQ(results[3].first, -ENODATA);
+  ASSERT_EQ(results[4].first, -ERANGE);
+  ASSERT_EQ(results[5].first, 0);
+  ASSERT_EQ(results[5].second, "y");
+}
+
 TEST_F(BackendTest, ListHeads_Empty) {
   std::vector<std::string> output;
   ASSERT_EQ(backend->ListHeads(output), 0);
@@ -777,3 +1152,65 @@ TEST_F(BackendTest, ListLinks) {
 
   ASSERT_EQ(output, expected);
 }
+
+TEST_F(BackendTest, Async) {
+  struct Completion {
+    std::mutex lock;
+    std::condition_variable cond;
+    bool done = false;
+    int ret;
+
+    std::function<void(int)> cb() {
+      return [this](int r) {
+        std::lock_guard<std::mutex> lk(lock);
+        ret = r;
+        done = true;
+        cond.notify_one();
+      };
+    }
+
+    int wait() {
+      std::unique_lock<std::mutex> lk(lock);
+      cond.wait(lk, [this] { return done; });
+      done = false;
+      return ret;
+    }
+  } c;
+
+  std::string data;
+
+  ASSERT_EQ(backend->WriteAsync("a", "foo", 1, 0, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ENOENT);
+
+  ASSERT_EQ(backend->SealAsync("a", 1, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(backend->SealAsync("a", 1, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ESPIPE);
+
+  ASSERT_EQ(backend->ReadAsync("a", 1, 0, &data, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ERANGE);
+
+  ASSERT_EQ(backend->WriteAsync("a", "foo", 1, 0, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(backend->WriteAsync("a", "foo", 1, 0, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -EROFS);
+
+  ASSERT_EQ(backend->ReadAsync("a", 1, 0, &data, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(data, "foo");
+
+  ASSERT_EQ(backend->FillAsync("a", 1, 1, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(backend->ReadAsync("a", 1, 1, &data, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ENODATA);
+
+  ASSERT_EQ(backend->TrimAsync("a", 1, 0, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(backend->ReadAsync("a", 1, 0, &data, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ENODATA);
+
+  ASSERT_EQ(backend->SealAsync("a", 5, c.cb()), 0);
+  ASSERT_EQ(c.wait(), 0);
+  ASSERT_EQ(backend->ReadAsync("a", 1, 0, &data, c.cb()), 0);
+  ASSERT_EQ(c.wait(), -ESPIPE);
+}
@@ -0,0 +1,201 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "zlog/cache.h"
+
+// Compares the entry cache eviction policies on synthetic read traces.
+//
+// Each trace is replayed as a read-through workload: a get, followed by a put
+// of the entry when the get misses. The hit ratio is measured with a single
+// thread, and throughput is measured with every thread replaying its own copy
+// of the trace against a shared cache.
+//
+// Usage: ./eviction_bench [KEYS] [CACHE_ENTRIES] [THREADS]
+
+static const size_t ENTRY_SIZE = 64;
+static const size_t TRACE_LEN = 2000000;
+
+// Zipfian generator from Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases", as used by YCSB.
+class ZipfGenerator {
+ public:
+  ZipfGenerator(uint64_t n, double theta, uint64_t seed) :
+    n_(n), theta_(theta), rng_(seed), uniform_(0.0, 1.0)
+  {
+    zetan_ = zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) /
+      (1.0 - zeta(2, theta) / zetan_);
+  }
+
+  uint64_t next() {
+    const double u = uniform_(rng_);
+    const double uz = u * zetan_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_))
+      return 1;
+    return (uint64_t)(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)) % n_;
+  }
+
+ private:
+  static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++)
+      sum += 1.0 / std::pow(i + 1, theta);
+    return sum;
+  }
+
+  const uint64_t n_;
+  const double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<double> uniform_;
+};
+
+// hashed so that popular keys are spread over the position space
+static uint64_t scramble(uint64_t key)
+{
+  return (key * 0x9E3779B97F4A7C15ULL) >> 16;
+}
+
+static std::vector<uint64_t> zipf_trace(uint64_t keys, uint64_t seed)
+{
+  ZipfGenerator gen(keys, 0.99, seed);
+  std::vector<uint64_t> trace;
+  trace.reserve(TRACE_LEN);
+  for (size_t i = 0; i < TRACE_LEN; i++)
+    trace.push_back(scramble(gen.next()));
+  return trace;
+}
+
+// zipfian reads interleaved with sequential scans over positions that are
+// never read again, like a reader catching up from the head of the log.
+static std::vector<uint64_t> scan_trace(uint64_t keys, uint64_t seed)
+{
+  ZipfGenerator gen(keys, 0.99, seed);
+  std::vector<uint64_t> trace;
+  trace.reserve(TRACE_LEN);
+  uint64_t next_scan = 1ULL << 40;
+  while (trace.size() < TRACE_LEN) {
+    for (size_t i = 0; i < 4 * keys && trace.size() < TRACE_LEN; i++)
+      trace.push_back(scramble(gen.next()));
+    for (size_t i = 0; i < keys && trace.size() < TRACE_LEN; i++)
+      trace.push_back(next_scan++);
+  }
+  return trace;
+}
+
+static zlog::Options cache_options(zlog::Eviction::Eviction_Policy policy,
+    size_t cache_entries)
+{
+  zlog::Options options;
+  options.eviction = policy;
+  options.cache_size = cache_entries * zlog::Cache::charge(ENTRY_SIZE);
+  options.cache_num_shards = 16;
+  return options;
+}
+
+static void replay(zlog::Cache *cache, const std::vector<uint64_t>& trace,
+    uint64_t *hits)
+{
+  const std::string value(ENTRY_SIZE, 'x');
+  std::string data;
+  uint64_t count = 0;
+  for (auto pos : trace) {
+    if (cache->get(&pos, &data) == 0) {
+      count++;
+    } else {
+      cache->put(pos, value);
+    }
+  }
+  *hits = count;
+}
+
+static void run(const std::string& name, zlog::Eviction::Eviction_Policy policy,
+    const std::string& trace_name,
+    const std::vector<std::vector<uint64_t>>& traces, size_t cache_entries)
+{
+  const auto options = cache_options(policy, cache_entries);
+
+  double hit_ratio;
+  {
+    zlog::Cache cache(options);
+    uint64_t hits;
+    replay(&cache, traces[0], &hits);
+    hit_ratio = (double)hits / traces[0].size();
+  }
+
+  zlog::Cache cache(options);
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> hits(traces.size());
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < traces.size(); i++)
+    threads.emplace_back(replay, &cache, std::cref(traces[i]), &hits[i]);
+  for (auto& t : threads)
+    t.join();
+  const auto end = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(end - start).count();
+  const double ops = (double)traces.size() * TRACE_LEN / secs;
+
+  std::cout << std::left << std::setw(8) << name
+    << std::setw(10) << trace_name
+    << std::right << std::fixed
+    << std::setw(10) << std::setprecision(4) << hit_ratio
+    << std::setw(14) << std::setprecision(0) << ops
+    << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  const uint64_t keys = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 100000;
+  const size_t cache_entries = argc > 2 ?
+    std::strtoull(argv[2], NULL, 10) : keys / 10;
+  const size_t num_threads = argc > 3 ?
+    std::strtoull(argv[3], NULL, 10) : std::thread::hardware_concurrency();
+
+  if (keys < 2 || cache_entries == 0 || num_threads == 0) {
+    std::cerr << "Usage: ./eviction_bench [KEYS] [CACHE_ENTRIES] [THREADS]"
+      << std::endl;
+    return -1;
+  }
+
+  std::cout << "keys " << keys << " cache entries " << cache_entries
+    << " threads " << num_threads << std::endl;
+
+  std::vector<std::vector<uint64_t>> zipf, scan;
+  for (size_t i = 0; i < num_threads; i++) {
+    zipf.push_back(zipf_trace(keys, i + 1));
+    scan.push_back(scan_trace(keys, i + 1));
+  }
+
+  const std::vector<std::pair<std::string, zlog::Eviction::Eviction_Policy>>
+    policies = {
+      {"lru", zlog::Eviction::Eviction_Policy::LRU},
+      {"arc", zlog::Eviction::Eviction_Policy::ARC},
+      {"clock", zlog::Eviction::Eviction_Policy::CLOCK},
+      {"s3fifo", zlog::Eviction::Eviction_Policy::S3FIFO},
+    };
+
+  std::cout << std::left << std::setw(8) << "policy"
+    << std::setw(10) << "trace"
+    << std::right << std::setw(10) << "hit ratio"
+    << std::setw(14) << "ops/sec" << std::endl;
+
+  for (auto& p : policies) {
+    run(p.first, p.second, "zipf", zipf, cache_entries);
+    run(p.first, p.second, "scan", scan, cache_entries);
+  }
+
+  return 0;
+}
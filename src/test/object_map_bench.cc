@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "libzlog/striper.h"
+#include "proto/zlog.pb.h"
+
+// Measures the cost of mapping a position to an object, and formatting the
+// object name, as the number of stripes in the object map grows. The time to
+// restore the object map from a serialized view, which is done for every view
+// refresh, is also reported.
+//
+// In the uniform layout every stripe has the same width and number of entries,
+// which is the layout produced by a log that has always used the same options,
+// and the object map is a single run of stripes. In the fragmented layout the
+// stripe width alternates, so that every stripe is its own run. This is the
+// worst case for the object map.
+//
+// Usage: ./object_map_bench [LOOKUPS]
+
+static const uint32_t STRIPE_SLOTS = 10;
+
+static zlog::ObjectMap make_map(uint64_t num_stripes, bool fragmented)
+{
+  zlog::ObjectMap map("prefix", num_stripes);
+  uint64_t min_position = 0;
+  for (uint64_t id = 0; id < num_stripes; id++) {
+    const uint32_t width = (fragmented && (id % 2)) ? 20 : 10;
+    const uint64_t max_position = min_position + width * STRIPE_SLOTS - 1;
+    map.add_stripe(id, width, min_position, max_position);
+    min_position = max_position + 1;
+  }
+  return map;
+}
+
+// returns nanoseconds per lookup
+static double run(const zlog::ObjectMap& map, uint64_t lookups)
+{
+  std::mt19937_64 rng(1);
+  std::uniform_int_distribution<uint64_t> dist(0, map.max_position());
+  std::vector<uint64_t> positions;
+  positions.reserve(lookups);
+  for (uint64_t i = 0; i < lookups; i++) {
+    positions.push_back(dist(rng));
+  }
+
+  std::string oid;
+  uint64_t total_len = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (auto position : positions) {
+    const auto mapping = map.map(position);
+    if (!mapping.first) {
+      std::cerr << "position not mapped" << std::endl;
+      exit(1);
+    }
+    map.oid(*mapping.first, &oid);
+    total_len += oid.size();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  // keep the loop from being optimized away
+  if (total_len == 0) {
+    std::cerr << "unexpected oid length" << std::endl;
+    exit(1);
+  }
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+    lookups;
+}
+
+// returns microseconds to decode the object map from a view
+static double decode(const zlog::ObjectMap& map)
+{
+  zlog_proto::View view;
+  map.encode(&view);
+  std::string blob;
+  view.SerializeToString(&blob);
+
+  const int iters = 100;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++) {
+    zlog_proto::View src;
+    src.ParseFromString(blob);
+    zlog::ObjectMap decoded("prefix", 0);
+    decoded.decode(src);
+    if (decoded.num_stripes() != map.num_stripes()) {
+      std::cerr << "decoded map mismatch" << std::endl;
+      exit(1);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+    iters;
+}
+
+int main(int argc, char **argv)
+{
+  const uint64_t lookups = argc > 1 ?
+    std::strtoull(argv[1], NULL, 10) : 5000000;
+
+  std::cout << std::setw(10) << "stripes"
+    << std::setw(14) << "uniform ns"
+    << std::setw(16) << "fragmented ns"
+    << std::setw(14) << "decode us" << std::endl;
+
+  for (uint64_t stripes : {10ULL, 10000ULL, 1000000ULL}) {
+    const auto uniform_map = make_map(stripes, false);
+    const double uniform = run(uniform_map, lookups);
+    const double fragmented = run(make_map(stripes, true), lookups);
+    const double decode_us = decode(uniform_map);
+    std::cout << std::setw(10) << stripes << std::fixed << std::setprecision(1)
+      << std::setw(14) << uniform
+      << std::setw(16) << fragmented
+      << std::setw(14) << decode_us << std::endl;
+  }
+
+  return 0;
+}
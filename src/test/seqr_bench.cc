@@ -0,0 +1,101 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libseq/libseqr.h"
+
+// Measures sequencer service throughput over loopback as a function of the
+// number of client threads sharing one SeqrClient.
+//
+// Each client thread reserves positions one at a time in a loop. The service
+// handler only increments a counter, so the results reflect the cost of the
+// client and the network path. The number of requests that reached the
+// service is reported alongside, and the ratio of the two is the average
+// number of positions that were coalesced into each request.
+//
+// Usage: ./seqr_bench [SECONDS] [MAX_THREADS] [CHANNELS] [PIPELINE_DEPTH]
+//   [SERVER_THREADS]
+
+int main(int argc, char **argv)
+{
+  const int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  const int max_threads = argc > 2 ? std::atoi(argv[2]) : 32;
+  const int channels = argc > 3 ? std::atoi(argv[3]) : 2;
+  const int depth = argc > 4 ? std::atoi(argv[4]) : 4;
+  const int server_threads = argc > 5 ? std::atoi(argv[5]) : 1;
+
+  std::atomic<uint64_t> tail(0);
+  zlog::SeqrServer server("127.0.0.1", 0, server_threads, [&] {
+    return [&](const std::string& name, uint64_t epoch, bool next,
+        uint32_t count, uint64_t *position) {
+      *position = next ? tail.fetch_add(count) : tail.load();
+      return 0;
+    };
+  });
+  server.start();
+
+  std::cout << "channels " << channels << " pipeline depth " << depth
+    << " server threads " << server_threads << std::endl;
+  std::cout << std::setw(10) << "threads"
+    << std::setw(16) << "positions/sec"
+    << std::setw(16) << "requests/sec"
+    << std::setw(12) << "batch" << std::endl;
+
+  for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+    zlog::SeqrClient client("127.0.0.1", std::to_string(server.port()),
+        channels, depth);
+    int ret = client.Connect();
+    if (ret) {
+      std::cerr << "failed to connect " << ret << std::endl;
+      return 1;
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> num_positions(0);
+    std::atomic<int> failed(0);
+    const auto requests_start = server.num_requests();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nthreads; i++) {
+      threads.emplace_back([&] {
+        uint64_t count = 0;
+        while (!stop) {
+          uint64_t position;
+          int ret = client.CheckTail(1, "log", &position, true);
+          if (ret) {
+            failed++;
+            break;
+          }
+          count++;
+        }
+        num_positions += count;
+      });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    if (failed) {
+      std::cerr << "requests failed" << std::endl;
+      return 1;
+    }
+
+    const auto requests = server.num_requests() - requests_start;
+    std::cout << std::setw(10) << nthreads
+      << std::setw(16) << (num_positions / seconds)
+      << std::setw(16) << (requests / seconds)
+      << std::setw(12) << std::fixed << std::setprecision(2)
+      << ((double)num_positions / requests) << std::endl;
+  }
+
+  server.stop();
+
+  return 0;
+}
@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "libzlog/log_impl.h"
+#include "zlog/backend.h"
+#include "zlog/log.h"
+#include "zlog/options.h"
+
+// Measures append throughput of several processes on one host appending to the
+// same LMDB-backed log, with and without the shared memory sequencer.
+//
+// Without it, every process that finds that it isn't the sequencer takes over
+// by proposing a new view, and the others then find their writes rejected and
+// take over in turn. With it, the processes share the first sequencer. The
+// number of views proposed during the run is reported with the throughput.
+//
+// Usage: ./shm_seq_bench DB_PATH [PROCS] [SECONDS]
+
+static int open_log(const std::string& db_path, const std::string& name,
+    bool shm, bool create, std::unique_ptr<zlog::Log> *log)
+{
+  zlog::Options options;
+  options.backend_name = "lmdb";
+  options.backend_options["path"] = db_path;
+  options.shm_sequencer = shm;
+  options.create_if_missing = create;
+  options.error_if_exists = create;
+
+  zlog::Log *l;
+  int ret = zlog::Log::Open(options, name, &l);
+  if (ret) {
+    return ret;
+  }
+  log->reset(l);
+  return 0;
+}
+
+static uint64_t view_epoch(zlog::Log *log)
+{
+  return static_cast<zlog::LogImpl*>(log)->striper.read_view()->epoch();
+}
+
+// append until the deadline, and write the number of appends to fd
+static int child(const std::string& db_path, const std::string& name,
+    bool shm, std::chrono::steady_clock::time_point deadline, int fd)
+{
+  std::unique_ptr<zlog::Log> log;
+  int ret = open_log(db_path, name, shm, false, &log);
+  if (ret) {
+    std::cerr << "failed to open log " << ret << std::endl;
+    return 1;
+  }
+
+  uint64_t count = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    uint64_t pos;
+    ret = log->Append("data", &pos);
+    if (ret) {
+      std::cerr << "append failed " << ret << std::endl;
+      return 1;
+    }
+    count++;
+  }
+
+  if (write(fd, &count, sizeof(count)) != sizeof(count)) {
+    return 1;
+  }
+
+  return 0;
+}
+
+static int run(const std::string& db_path, const std::string& name,
+    bool shm, int procs, int seconds)
+{
+  uint64_t start_epoch;
+  {
+    std::unique_ptr<zlog::Log> log;
+    int ret = open_log(db_path, name, shm, true, &log);
+    if (ret) {
+      std::cerr << "failed to create log " << ret << std::endl;
+      return 1;
+    }
+    uint64_t tail;
+    log->CheckTail(&tail);
+    start_epoch = view_epoch(log.get());
+  }
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    return 1;
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::seconds(seconds);
+
+  std::vector<pid_t> pids;
+  for (int i = 0; i < procs; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      return 1;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      _exit(child(db_path, name, shm, deadline, fds[1]));
+    }
+    pids.push_back(pid);
+  }
+  close(fds[1]);
+
+  bool failed = false;
+  for (auto pid : pids) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status)) {
+      failed = true;
+    }
+  }
+
+  uint64_t total = 0;
+  uint64_t count;
+  while (read(fds[0], &count, sizeof(count)) == sizeof(count)) {
+    total += count;
+  }
+  close(fds[0]);
+
+  if (failed) {
+    std::cerr << "a process failed" << std::endl;
+    return 1;
+  }
+
+  uint64_t end_epoch;
+  {
+    std::unique_ptr<zlog::Log> log;
+    int ret = open_log(db_path, name, shm, false, &log);
+    if (ret) {
+      return 1;
+    }
+    end_epoch = view_epoch(log.get());
+
+    // the segment of the last sequencer outlives the processes
+    const auto view =
+      static_cast<zlog::LogImpl*>(log.get())->striper.read_view();
+    if (view->seq_config && !view->seq_config->shm.empty()) {
+      zlog::SharedCounter::remove(view->seq_config->shm);
+    }
+  }
+
+  std::cout << std::setw(10) << (shm ? "shm" : "local")
+    << std::setw(10) << procs
+    << std::setw(16) << (total / seconds)
+    << std::setw(10) << (end_epoch - start_epoch) << std::endl;
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " DB_PATH [PROCS] [SECONDS]"
+      << std::endl;
+    return 1;
+  }
+
+  const std::string db_path = argv[1];
+  const int max_procs = argc > 2 ? std::atoi(argv[2]) : 8;
+  const int seconds = argc > 3 ? std::atoi(argv[3]) : 3;
+
+  std::cout << std::setw(10) << "sequencer"
+    << std::setw(10) << "procs"
+    << std::setw(16) << "appends/sec"
+    << std::setw(10) << "views" << std::endl;
+
+  for (int procs = 1; procs <= max_procs; procs *= 2) {
+    for (bool shm : {false, true}) {
+      const auto name = std::string(shm ? "shm" : "local") + "." +
+        std::to_string(procs);
+      if (run(db_path, name, shm, procs, seconds)) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "zlog/backend.h"
+#include "zlog/log.h"
+#include "zlog/options.h"
+
+// Measures sequencer takeover latency as a function of the number of stripes
+// written to, and the number of idle stripes mapped after the tail.
+//
+// A log is created with the given number of written stripes followed by the
+// idle stripes, and a second log instance then calls CheckTail, which makes it
+// the sequencer by sealing the log and finding the maximum position. Without a
+// sequencer limit, every idle stripe has to be examined before the tail is
+// found. With a limit (Options::seq_limit_stripes), only the stripes below the
+// limit are examined, and the idle stripes are sealed in the background.
+//
+// Storage latency is simulated by wrapping the in-memory backend and delaying
+// every data object request. Asynchronous requests complete on their own
+// threads, like a networked backend.
+//
+// Usage: ./takeover_bench [DELAY_US] [MAX_STRIPES]
+
+class DelayBackend : public zlog::Backend {
+ public:
+  explicit DelayBackend(std::shared_ptr<zlog::Backend> backend) :
+    backend_(backend),
+    delay_us_(0),
+    inflight_(0)
+  {}
+
+  ~DelayBackend() {
+    while (inflight_) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void set_delay(uint64_t delay_us) {
+    delay_us_ = delay_us;
+  }
+
+  int Initialize(const std::map<std::string, std::string>& opts) override {
+    return backend_->Initialize(opts);
+  }
+
+  std::map<std::string, std::string> meta() override {
+    return backend_->meta();
+  }
+
+  int CreateLog(const std::string& name, const std::string& view,
+      std::string *hoid_out, std::string *prefix_out) override {
+    return backend_->CreateLog(name, view, hoid_out, prefix_out);
+  }
+
+  int OpenLog(const std::string& name, std::string *hoid_out,
+      std::string *prefix_out) override {
+    return backend_->OpenLog(name, hoid_out, prefix_out);
+  }
+
+  int ReadViews(const std::string& hoid, uint64_t epoch, uint32_t max_views,
+      std::map<uint64_t, std::string> *views_out) override {
+    return backend_->ReadViews(hoid, epoch, max_views, views_out);
+  }
+
+  int ReadLatestView(const std::string& hoid, uint64_t *epoch_out,
+      std::string *view_out) override {
+    return backend_->ReadLatestView(hoid, epoch_out, view_out);
+  }
+
+  int TrimViews(const std::string& hoid, uint64_t epoch) override {
+    return backend_->TrimViews(hoid, epoch);
+  }
+
+  int ProposeView(const std::string& hoid, uint64_t epoch,
+      const std::string& view) override {
+    return backend_->ProposeView(hoid, epoch, view);
+  }
+
+  int WatchViews(const std::string& hoid,
+      std::function<void(uint64_t epoch)> cb, uint64_t *handle_out) override {
+    return backend_->WatchViews(hoid, cb, handle_out);
+  }
+
+  int UnwatchViews(uint64_t handle) override {
+    return backend_->UnwatchViews(handle);
+  }
+
+  int uniqueId(const std::string& hoid, uint64_t *id_out) override {
+    return backend_->uniqueId(hoid, id_out);
+  }
+
+  int Read(const std::string& oid, uint64_t epoch, uint64_t position,
+      std::string *data_out) override {
+    delay();
+    return backend_->Read(oid, epoch, position, data_out);
+  }
+
+  int Write(const std::string& oid, const std::string& data, uint64_t epoch,
+      uint64_t position) override {
+    delay();
+    return backend_->Write(oid, data, epoch, position);
+  }
+
+  int Fill(const std::string& oid, uint64_t epoch,
+      uint64_t position) override {
+    delay();
+    return backend_->Fill(oid, epoch, position);
+  }
+
+  int Trim(const std::string& oid, uint64_t epoch,
+      uint64_t position) override {
+    delay();
+    return backend_->Trim(oid, epoch, position);
+  }
+
+  int Seal(const std::string& oid, uint64_t epoch) override {
+    delay();
+    return backend_->Seal(oid, epoch);
+  }
+
+  int InitObject(const std::string& oid, uint64_t epoch) override {
+    delay();
+    return backend_->InitObject(oid, epoch);
+  }
+
+  int MaxPos(const std::string& oid, uint64_t epoch, uint64_t *pos_out,
+      bool *empty_out) override {
+    delay();
+    return backend_->MaxPos(oid, epoch, pos_out, empty_out);
+  }
+
+  int PeekMaxPos(const std::string& oid, uint64_t *pos_out,
+      bool *empty_out) override {
+    delay();
+    return backend_->PeekMaxPos(oid, pos_out, empty_out);
+  }
+
+  int SealAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) override {
+    async([=] { return Seal(oid, epoch); }, cb);
+    return 0;
+  }
+
+  int InitObjectAsync(const std::string& oid, uint64_t epoch,
+      std::function<void(int)> cb) override {
+    async([=] { return InitObject(oid, epoch); }, cb);
+    return 0;
+  }
+
+  int MaxPosAsync(const std::string& oid, uint64_t epoch, uint64_t *pos_out,
+      bool *empty_out, std::function<void(int)> cb) override {
+    async([=] { return MaxPos(oid, epoch, pos_out, empty_out); }, cb);
+    return 0;
+  }
+
+ private:
+  void delay() {
+    const uint64_t delay_us = delay_us_;
+    if (delay_us) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    }
+  }
+
+  void async(std::function<int()> op, std::function<void(int)> cb) {
+    inflight_++;
+    std::thread([this, op, cb] {
+      cb(op());
+      inflight_--;
+    }).detach();
+  }
+
+  std::shared_ptr<zlog::Backend> backend_;
+  std::atomic<uint64_t> delay_us_;
+  std::atomic<uint64_t> inflight_;
+};
+
+// returns the takeover latency in microseconds, or a negative error code
+static double takeover(uint64_t written_stripes, uint64_t idle_stripes,
+    bool seq_limit, uint64_t delay_us)
+{
+  std::shared_ptr<zlog::Backend> ram;
+  int ret = zlog::Backend::Load("ram", {}, ram);
+  if (ret) {
+    std::cerr << "failed to load ram backend " << ret << std::endl;
+    return ret;
+  }
+
+  auto backend = std::make_shared<DelayBackend>(ram);
+
+  zlog::Options options;
+  options.backend = backend;
+  options.create_if_missing = true;
+  options.seq_limit_stripes = seq_limit ? 1 : 0;
+
+  zlog::Log *writer;
+  ret = zlog::Log::Open(options, "log", &writer);
+  if (ret) {
+    return ret;
+  }
+
+  const uint64_t stripe_entries =
+    (uint64_t)options.stripe_width * options.stripe_slots;
+
+  // the tail is in the last written stripe
+  uint64_t pos;
+  ret = writer->Append("data", &pos);
+  if (!ret && written_stripes > 1) {
+    pos = (written_stripes - 1) * stripe_entries;
+    ret = writer->Fill(pos);
+  }
+
+  if (!ret && idle_stripes) {
+    // map the stripes after the tail without writing to them
+    std::string data;
+    writer->Read((written_stripes + idle_stripes) * stripe_entries - 1, &data);
+  }
+
+  if (ret) {
+    delete writer;
+    return ret;
+  }
+
+  options.create_if_missing = false;
+  zlog::Log *reader;
+  ret = zlog::Log::Open(options, "log", &reader);
+  if (ret) {
+    delete writer;
+    return ret;
+  }
+
+  backend->set_delay(delay_us);
+
+  uint64_t tail;
+  const auto start = std::chrono::steady_clock::now();
+  ret = reader->CheckTail(&tail);
+  const auto end = std::chrono::steady_clock::now();
+
+  backend->set_delay(0);
+
+  delete reader;
+  delete writer;
+
+  if (ret) {
+    return ret;
+  }
+
+  if (tail != pos + 1) {
+    std::cerr << "unexpected tail " << tail << " expected " << (pos + 1)
+      << std::endl;
+    return -EIO;
+  }
+
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+  const uint64_t delay_us = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 1000;
+  const uint64_t max_stripes = argc > 2 ?
+    std::strtoull(argv[2], NULL, 10) : 1000;
+
+  std::cout << "delay " << delay_us << "us" << std::endl;
+  std::cout << "takeover latency (ms)" << std::endl;
+  std::cout << std::setw(10) << "written"
+    << std::setw(10) << "idle"
+    << std::setw(14) << "no limit"
+    << std::setw(14) << "limit" << std::endl;
+
+  for (uint64_t written = 1; written <= max_stripes; written *= 10) {
+    for (uint64_t idle = 0; idle <= max_stripes; idle = idle ? idle * 10 : 1) {
+      const double us = takeover(written, idle, false, delay_us);
+      const double limit_us = takeover(written, idle, true, delay_us);
+      if (us < 0 || limit_us < 0) {
+        std::cerr << "takeover failed" << std::endl;
+        return 1;
+      }
+      std::cout << std::setw(10) << written
+        << std::setw(10) << idle
+        << std::fixed << std::setprecision(2)
+        << std::setw(14) << (us / 1000)
+        << std::setw(14) << (limit_us / 1000)
+        << std::endl;
+    }
+  }
+
+  return 0;
+}
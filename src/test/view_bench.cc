@@ -0,0 +1,102 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libzlog/log_impl.h"
+#include "zlog/log.h"
+#include "zlog/options.h"
+
+// Measures the cost of getting the current view and mapping a position, which
+// every log operation does, as the number of threads grows. The locked
+// shared_ptr accessor, Striper::view(), is compared with the lock-free
+// Striper::read_view() used by the I/O path.
+//
+// Usage: ./view_bench [SECONDS] [MAX_THREADS]
+
+static const uint64_t NUM_POSITIONS = 1000;
+
+template<typename F>
+static double run(int num_threads, int seconds, F op)
+{
+  std::atomic<bool> stop(false);
+  std::vector<uint64_t> counts(num_threads);
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&, i] {
+      uint64_t count = 0;
+      uint64_t pos = i;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!op(pos % NUM_POSITIONS)) {
+          std::cerr << "position not mapped" << std::endl;
+          exit(1);
+        }
+        pos++;
+        count++;
+      }
+      counts[i] = count;
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  stop = true;
+
+  uint64_t total = 0;
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].join();
+    total += counts[i];
+  }
+
+  return (double)total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+  const int seconds = argc > 1 ? std::atoi(argv[1]) : 1;
+  const int max_threads = argc > 2 ? std::atoi(argv[2]) : 64;
+
+  zlog::Options options;
+  options.backend_name = "ram";
+  options.create_if_missing = true;
+
+  zlog::Log *log;
+  int ret = zlog::Log::Open(options, "log", &log);
+  if (ret) {
+    std::cerr << "failed to open log " << ret << std::endl;
+    return 1;
+  }
+
+  auto impl = static_cast<zlog::LogImpl*>(log);
+
+  // map the positions used by the benchmark
+  std::string data;
+  log->Read(NUM_POSITIONS, &data);
+
+  std::cout << std::setw(8) << "threads"
+    << std::setw(16) << "view() ops/s"
+    << std::setw(18) << "read_view() ops/s" << std::endl;
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    const double locked = run(threads, seconds, [&](uint64_t pos) {
+      const auto view = impl->striper.view();
+      return (bool)impl->striper.map(*view, pos);
+    });
+
+    const double lockfree = run(threads, seconds, [&](uint64_t pos) {
+      const auto view = impl->striper.read_view();
+      return (bool)impl->striper.map(*view, pos);
+    });
+
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(0)
+      << std::setw(16) << locked
+      << std::setw(18) << lockfree << std::endl;
+  }
+
+  delete log;
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "port/port_posix.h"
+
+namespace zlog {
+
+// Bounded multi-producer, multi-consumer queue.
+//
+// This is the array-based queue described by Dmitry Vyukov. Each slot carries a
+// sequence number which producers and consumers use to claim the slot with a
+// single compare-and-swap on the shared enqueue / dequeue cursor. Neither side
+// takes a lock, and the two cursors live on separate cache lines so producers
+// and consumers don't bounce the same line in the common case.
+//
+// The capacity is rounded up to a power of two. try_push fails when the queue
+// is full and try_pop fails when it is empty; callers that need blocking
+// semantics layer their own admission control / wakeups on top.
+template<typename T>
+class MPMCQueue {
+ public:
+  explicit MPMCQueue(size_t capacity) :
+    mask_(round_up(capacity) - 1),
+    slots_(new Slot[mask_ + 1])
+  {
+    for (size_t i = 0; i <= mask_; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  MPMCQueue(const MPMCQueue&) = delete;
+  MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+  bool try_push(T value) {
+    Slot *slot;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = std::move(value);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T *value) {
+    Slot *slot;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    *value = std::move(slot->value);
+    slot->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  static size_t round_up(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  typedef char cacheline_pad_t[CACHE_LINE_SIZE];
+
+  cacheline_pad_t pad0_ __attribute__((__unused__));
+  const size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  cacheline_pad_t pad1_ __attribute__((__unused__));
+  std::atomic<size_t> enqueue_pos_;
+  cacheline_pad_t pad2_ __attribute__((__unused__));
+  std::atomic<size_t> dequeue_pos_;
+  cacheline_pad_t pad3_ __attribute__((__unused__));
+};
+
+}
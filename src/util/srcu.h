@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "port/port_posix.h"
+#include "util/core_local.h"
+
+namespace zlog {
+
+// Sleepable read-copy-update.
+//
+// Readers bracket a read-side critical section with read_lock and read_unlock.
+// A critical section may be long-lived (e.g. span an asynchronous I/O), and
+// may end on a different thread or core than it started on. Each core has its
+// own cache line of lock/unlock counters, so readers never write to memory
+// shared with readers on other cores, and never block.
+//
+// Writers publish a new version of an object and then retire the old one. A
+// retired object may be reclaimed once every reader that could have observed
+// it has exited its critical section. Rather than blocking until that happens,
+// writers call try_advance to make progress on grace periods, and use
+// retire_seq / reclaimable to decide when a retired object is safe to reclaim.
+// The writer side is not thread-safe and must be serialized by the caller.
+class SRCU {
+ public:
+  SRCU() :
+    idx_(0),
+    draining_(false),
+    draining_idx_(0),
+    completed_(0)
+  {
+    for (size_t i = 0; i < counters_.Size(); i++) {
+      auto c = counters_.AccessAtCore(i);
+      for (int j = 0; j < 2; j++) {
+        c->lock[j].store(0, std::memory_order_relaxed);
+        c->unlock[j].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  SRCU(const SRCU&) = delete;
+  SRCU& operator=(const SRCU&) = delete;
+
+  // returns the index that must be passed to read_unlock, along with the core
+  // slot that was used. the increment is sequentially consistent so that loads
+  // of published pointers made inside the critical section are ordered after
+  // it.
+  int read_lock(size_t *core) {
+    const int idx = idx_.load(std::memory_order_relaxed);
+    auto c = counters_.AccessElementAndIndex();
+    c.first->lock[idx].fetch_add(1, std::memory_order_seq_cst);
+    *core = c.second;
+    return idx;
+  }
+
+  // the unlock is counted in the slot used by read_lock. only the sums across
+  // all slots matter, so this is correct even if the reader has migrated, and
+  // it avoids looking up the core id again.
+  void read_unlock(int idx, size_t core) {
+    counters_.AccessAtCore(core)->unlock[idx].fetch_add(1,
+        std::memory_order_seq_cst);
+  }
+
+  // sequence number to associate with an object that was just retired (i.e.
+  // after the pointer to it has been replaced).
+  uint64_t retire_seq() const {
+    return completed_ + (draining_ ? 1 : 0);
+  }
+
+  // true if an object retired with the given sequence number may be reclaimed.
+  // two full grace period steps that started after the object was retired are
+  // required, because a reader may load the index just before a flip and
+  // increment its counter just after the flip's drain check.
+  bool reclaimable(uint64_t seq) const {
+    return completed_ >= seq + 2;
+  }
+
+  // advance grace period processing without blocking. a step flips the index
+  // used by new readers and completes once the readers using the previous
+  // index have drained.
+  void try_advance() {
+    if (draining_) {
+      if (!drained(draining_idx_)) {
+        return;
+      }
+      draining_ = false;
+      completed_++;
+    }
+
+    draining_idx_ = idx_.load(std::memory_order_relaxed);
+    idx_.store(draining_idx_ ^ 1, std::memory_order_seq_cst);
+    draining_ = true;
+
+    if (drained(draining_idx_)) {
+      draining_ = false;
+      completed_++;
+    }
+  }
+
+  // true if there are no readers in a critical section
+  bool idle() const {
+    return drained(0) && drained(1);
+  }
+
+ private:
+  // unlocks are summed before locks. a reader that is counted by the unlock sum
+  // is also counted by the lock sum, so the sums can only be equal when every
+  // reader that entered with this index has exited.
+  bool drained(int idx) const {
+    uint64_t unlocks = 0;
+    for (size_t i = 0; i < counters_.Size(); i++) {
+      unlocks += counters_.AccessAtCore(i)->unlock[idx].load(
+          std::memory_order_seq_cst);
+    }
+    uint64_t locks = 0;
+    for (size_t i = 0; i < counters_.Size(); i++) {
+      locks += counters_.AccessAtCore(i)->lock[idx].load(
+          std::memory_order_seq_cst);
+    }
+    return locks == unlocks;
+  }
+
+  // padded to a cache line, so that counters of different cores don't share
+  // a line.
+  struct Counters {
+    std::atomic<uint64_t> lock[2];
+    std::atomic<uint64_t> unlock[2];
+    char padding[CACHE_LINE_SIZE - 4 * sizeof(std::atomic<uint64_t>)]
+      __attribute__((__unused__));
+  };
+
+  std::atomic<int> idx_;
+  CoreLocalArray<Counters> counters_;
+
+  // writer side state
+  bool draining_;
+  int draining_idx_;
+  uint64_t completed_;
+};
+
+}
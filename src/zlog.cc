@@ -68,6 +68,7 @@ int main(int argc, char **argv)
   }
 
   uint64_t epoch = 1;
+  std::shared_ptr<zlog::View> view;
   while (true) {
     std::map<uint64_t, std::string> views;
     ret = backend->ReadViews(hoid, epoch, 1, &views);
@@ -80,9 +81,11 @@ int main(int argc, char **argv)
       break;
     }
 
+    // views before the oldest full view may have been trimmed
     assert(views.size() == 1u);
-    auto it = views.find(epoch);
-    assert(it != views.end());
+    auto it = views.cbegin();
+    assert(it->first >= epoch);
+    epoch = it->first;
 
     zlog_proto::View view_src;
     if (!view_src.ParseFromString(it->second)) {
@@ -90,12 +93,17 @@ int main(int argc, char **argv)
       exit(1);
     }
 
-    auto view = std::make_shared<zlog::View>(prefix, it->first, view_src);
+    if (view_src.delta()) {
+      view = std::make_shared<zlog::View>(*view, it->first, view_src);
+    } else {
+      view = std::make_shared<zlog::View>(prefix, it->first, view_src);
+    }
 
     std::cout << "view@" << view->epoch() << std::endl;
-    for (auto it : view->object_map.stripes()) {
-      std::cout << "   stripe@" << it.second.id() << " [" << it.first
-        << ", " << it.second.max_position() << "]" << std::endl;
+    for (size_t i = 0; i < view->object_map.num_stripes(); i++) {
+      const auto stripe = view->object_map.stripe(i);
+      std::cout << "   stripe@" << stripe.id() << " [" << stripe.min_position()
+        << ", " << stripe.max_position() << "]" << std::endl;
     }
 
     epoch++;